@@ -0,0 +1,282 @@
+// Copyright (C) 2006-2009 by Tor Andersson, Jesse McGrew.
+// Copyright (C) 2010 by Ben Cressey, Chris Spiegel.
+//
+// This file is part of Gargoyle.
+//
+// Gargoyle is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Gargoyle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gargoyle; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+// Gamma-correct glyph blending, with SSE2 and NEON versions picked at
+// runtime.
+//
+// For each channel, the blend is
+//
+//     inv[fg + ((map[bg] - fg) * invalf + 2^(GAMMA_BITS - 1) - 1) / GAMMA_MAX]
+//
+// where invalf = GAMMA_MAX - alpha * GAMMA_MAX / 255, and both
+// divisions truncate toward zero. The SIMD versions must match the
+// scalar one bit for bit. They do the second division in single
+// precision, which is exact here: the dividends are integers below
+// 2^23, so they convert exactly, and the quotients are below 2^11, so
+// a correctly rounded quotient is within 2^-13 of the true one. A true
+// quotient which isn't an integer is at least 1/GAMMA_MAX from one, so
+// rounding can't carry it across an integer, and truncation gives the
+// same result as integer division.
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "blend.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GARGLK_BLEND_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define GARGLK_BLEND_NEON
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang need to be told which functions may use instructions
+// beyond the baseline; MSVC allows any intrinsics anywhere.
+#if defined(__GNUC__) || defined(__clang__)
+#define GARGLK_TARGET(isa) __attribute__((target(isa)))
+#else
+#define GARGLK_TARGET(isa)
+#endif
+
+garglk::GammaTables::GammaTables(double gamma)
+{
+    for (int i = 0; i < 256; i++) {
+        map[i] = std::round(std::pow(i / 255.0, gamma) * GAMMA_MAX);
+    }
+
+    for (int i = 0; i <= GAMMA_MAX; i++) {
+        inv[i] = std::round(std::pow(i / static_cast<double>(GAMMA_MAX), 1.0 / gamma) * 255.0);
+    }
+}
+
+namespace {
+
+using garglk::GAMMA_BITS;
+using garglk::GAMMA_MAX;
+using garglk::GammaTables;
+
+using Foreground = std::array<std::uint16_t, 3>;
+
+constexpr int ROUNDING = (1 << (GAMMA_BITS - 1)) - 1;
+
+unsigned char blend_channel(const GammaTables &gamma, unsigned char bg, unsigned char alpha, std::uint16_t fg)
+{
+    int gbg = gamma.map[bg];
+
+    // Shortcuts for the common cases of fully transparent and fully
+    // opaque glyph pixels, which give the same results as the full
+    // calculation below: with an inverse alpha of GAMMA_MAX, the
+    // division yields gbg - fg if gbg >= fg, else gbg - fg + 1; and
+    // with an inverse alpha of 0 it yields 0.
+    if (alpha == 0) {
+        return gamma.inv[gbg + (gbg < fg ? 1 : 0)];
+    }
+    if (alpha == 255) {
+        return gamma.inv[fg];
+    }
+
+    int invalf = GAMMA_MAX - (alpha * GAMMA_MAX / 255);
+
+    return gamma.inv[fg + ((gbg - fg) * invalf + ROUNDING) / GAMMA_MAX];
+}
+
+// Blend n channels, the first of which is channel number "phase" (0 for
+// red, 1 for green, 2 for blue). The SIMD versions use this for the
+// channels left over after their last full vector.
+void blend_channels(const GammaTables &gamma, unsigned char *dst, const unsigned char *alpha, int n, const Foreground &fg, int phase)
+{
+    for (int i = 0; i < n; i++) {
+        dst[i] = blend_channel(gamma, dst[i], alpha[i], fg[phase]);
+        phase = phase == 2 ? 0 : phase + 1;
+    }
+}
+
+void blend_span_scalar(const GammaTables &gamma, unsigned char *dst, const unsigned char *alpha, int n, const Foreground &fg)
+{
+    for (int i = 0; i < n; i += 3) {
+        dst[i + 0] = blend_channel(gamma, dst[i + 0], alpha[i + 0], fg[0]);
+        dst[i + 1] = blend_channel(gamma, dst[i + 1], alpha[i + 1], fg[1]);
+        dst[i + 2] = blend_channel(gamma, dst[i + 2], alpha[i + 2], fg[2]);
+    }
+}
+
+// The SIMD versions work on 8 channels at a time. Since a pixel is 3
+// channels, the foreground color's channels repeat every 3 vectors;
+// this returns the foreground value for each lane of the vector that
+// starts at channel 8 * phase.
+std::array<std::uint16_t, 8> foreground_lanes(const Foreground &fg, int phase)
+{
+    std::array<std::uint16_t, 8> lanes;
+
+    for (int i = 0; i < 8; i++) {
+        lanes[i] = fg[(8 * phase + i) % 3];
+    }
+
+    return lanes;
+}
+
+#ifdef GARGLK_BLEND_X86
+
+// alpha * GAMMA_MAX / 255 for alpha <= 255, in 16 bits. GAMMA_MAX is
+// 8 * 255 + 7, and x / 255 is (x + 1 + (x >> 8)) >> 8 for x < 65535.
+static_assert(GAMMA_MAX == 8 * 255 + 7, "alpha scaling assumes 11-bit gamma");
+
+GARGLK_TARGET("sse2")
+void blend_span_sse2(const GammaTables &gamma, unsigned char *dst, const unsigned char *alpha, int n, const Foreground &fg)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i seven = _mm_set1_epi16(7);
+    const __m128i gamma_max = _mm_set1_epi16(GAMMA_MAX);
+    const __m128i rounding = _mm_set1_epi32(ROUNDING);
+    const __m128 divisor = _mm_set1_ps(GAMMA_MAX);
+    __m128i fgv[3];
+    int phase = 0;
+    int i;
+
+    for (int j = 0; j < 3; j++) {
+        auto lanes = foreground_lanes(fg, j);
+        fgv[j] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lanes.data()));
+    }
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        // SSE2 has no gathers, so the table lookups are done one at a time.
+        __m128i gbg = _mm_setr_epi16(
+            gamma.map[dst[i + 0]], gamma.map[dst[i + 1]], gamma.map[dst[i + 2]], gamma.map[dst[i + 3]],
+            gamma.map[dst[i + 4]], gamma.map[dst[i + 5]], gamma.map[dst[i + 6]], gamma.map[dst[i + 7]]);
+
+        __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(&alpha[i])), zero);
+        __m128i a7 = _mm_mullo_epi16(a, seven);
+        __m128i scaled = _mm_add_epi16(_mm_slli_epi16(a, 3),
+                                       _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(a7, one), _mm_srli_epi16(a7, 8)), 8));
+        __m128i invalf = _mm_sub_epi16(gamma_max, scaled);
+
+        // (gbg - fg) * invalf needs 23 bits, so widen the products.
+        __m128i diff = _mm_sub_epi16(gbg, fgv[phase]);
+        __m128i lo = _mm_mullo_epi16(diff, invalf);
+        __m128i hi = _mm_mulhi_epi16(diff, invalf);
+        __m128i p0 = _mm_add_epi32(_mm_unpacklo_epi16(lo, hi), rounding);
+        __m128i p1 = _mm_add_epi32(_mm_unpackhi_epi16(lo, hi), rounding);
+        __m128i q0 = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(p0), divisor));
+        __m128i q1 = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(p1), divisor));
+
+        alignas(16) std::uint16_t index[8];
+        _mm_store_si128(reinterpret_cast<__m128i *>(index), _mm_add_epi16(fgv[phase], _mm_packs_epi32(q0, q1)));
+        for (int j = 0; j < 8; j++) {
+            dst[i + j] = gamma.inv[index[j]];
+        }
+
+        phase = phase == 2 ? 0 : phase + 1;
+    }
+
+    blend_channels(gamma, &dst[i], &alpha[i], n - i, fg, i % 3);
+}
+
+bool has_sse2()
+{
+#if defined(__x86_64__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif
+
+#ifdef GARGLK_BLEND_NEON
+
+static_assert(GAMMA_MAX == 8 * 255 + 7, "alpha scaling assumes 11-bit gamma");
+
+void blend_span_neon(const GammaTables &gamma, unsigned char *dst, const unsigned char *alpha, int n, const Foreground &fg)
+{
+    const int16x8_t gamma_max = vdupq_n_s16(GAMMA_MAX);
+    const int32x4_t rounding = vdupq_n_s32(ROUNDING);
+    const float32x4_t divisor = vdupq_n_f32(GAMMA_MAX);
+    int16x8_t fgv[3];
+    int phase = 0;
+    int i;
+
+    for (int j = 0; j < 3; j++) {
+        auto lanes = foreground_lanes(fg, j);
+        fgv[j] = vreinterpretq_s16_u16(vld1q_u16(lanes.data()));
+    }
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        std::uint16_t lookup[8];
+        for (int j = 0; j < 8; j++) {
+            lookup[j] = gamma.map[dst[i + j]];
+        }
+        int16x8_t gbg = vreinterpretq_s16_u16(vld1q_u16(lookup));
+
+        // alpha * GAMMA_MAX / 255, as in the SSE2 version.
+        uint16x8_t a = vmovl_u8(vld1_u8(&alpha[i]));
+        uint16x8_t a7 = vmulq_n_u16(a, 7);
+        uint16x8_t scaled = vaddq_u16(vshlq_n_u16(a, 3),
+                                      vshrq_n_u16(vaddq_u16(vaddq_u16(a7, vdupq_n_u16(1)), vshrq_n_u16(a7, 8)), 8));
+        int16x8_t invalf = vsubq_s16(gamma_max, vreinterpretq_s16_u16(scaled));
+
+        int16x8_t diff = vsubq_s16(gbg, fgv[phase]);
+        int32x4_t p0 = vaddq_s32(vmull_s16(vget_low_s16(diff), vget_low_s16(invalf)), rounding);
+        int32x4_t p1 = vaddq_s32(vmull_s16(vget_high_s16(diff), vget_high_s16(invalf)), rounding);
+        int32x4_t q0 = vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(p0), divisor));
+        int32x4_t q1 = vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(p1), divisor));
+
+        std::uint16_t index[8];
+        vst1q_u16(index, vreinterpretq_u16_s16(vaddq_s16(fgv[phase], vcombine_s16(vmovn_s32(q0), vmovn_s32(q1)))));
+        for (int j = 0; j < 8; j++) {
+            dst[i + j] = gamma.inv[index[j]];
+        }
+
+        phase = phase == 2 ? 0 : phase + 1;
+    }
+
+    blend_channels(gamma, &dst[i], &alpha[i], n - i, fg, i % 3);
+}
+
+#endif
+
+}
+
+std::vector<garglk::BlendKernel> garglk::blend_kernels()
+{
+    std::vector<BlendKernel> kernels = {{"scalar", blend_span_scalar}};
+
+#ifdef GARGLK_BLEND_X86
+    if (has_sse2()) {
+        kernels.push_back({"sse2", blend_span_sse2});
+    }
+#endif
+
+#ifdef GARGLK_BLEND_NEON
+    kernels.push_back({"neon", blend_span_neon});
+#endif
+
+    return kernels;
+}
@@ -0,0 +1,61 @@
+// Copyright (C) 2006-2009 by Tor Andersson, Jesse McGrew.
+// Copyright (C) 2010 by Ben Cressey, Chris Spiegel.
+//
+// This file is part of Gargoyle.
+//
+// Gargoyle is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Gargoyle is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Gargoyle; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#ifndef GARGLK_BLEND_H
+#define GARGLK_BLEND_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace garglk {
+
+constexpr int GAMMA_BITS = 11;
+constexpr int GAMMA_MAX = (1 << GAMMA_BITS) - 1;
+
+// Lookup tables for gamma-correct blending: map converts an 8-bit
+// color channel to linear light with GAMMA_BITS of precision, and inv
+// converts back.
+struct GammaTables {
+    GammaTables() = default;
+    explicit GammaTables(double gamma);
+
+    std::array<std::uint16_t, 256> map{};
+    std::array<unsigned char, GAMMA_MAX + 1> inv{};
+};
+
+// Blend a span of n channels of an RGB framebuffer row toward a
+// foreground color, one alpha value per channel. The span must start
+// on a pixel (red) boundary, and n must be a multiple of 3. fg is the
+// foreground color already converted with GammaTables::map.
+using BlendSpan = void (*)(const GammaTables &gamma, unsigned char *dst, const unsigned char *alpha, int n, const std::array<std::uint16_t, 3> &fg);
+
+struct BlendKernel {
+    const char *name;
+    BlendSpan blend;
+};
+
+// The span blenders usable on this CPU, starting with the portable
+// scalar one and ending with the fastest. They all give identical
+// results.
+std::vector<BlendKernel> blend_kernels();
+
+}
+
+#endif
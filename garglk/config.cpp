@@ -199,6 +199,8 @@ int gli_rows = 25;
 bool gli_conf_lockcols = false;
 bool gli_conf_lockrows = false;
 
+int gli_conf_scrollback = 10000;
+
 bool gli_conf_save_window_size = false;
 bool gli_conf_save_window_location = false;
 
@@ -661,6 +663,8 @@ static void readoneconfig(const std::string &fname, const std::string &argv0, co
                 gli_conf_lockrows = asbool(arg);
             } else if (cmd == "lockcols") {
                 gli_conf_lockcols = asbool(arg);
+            } else if (cmd == "scrollback") {
+                gli_conf_scrollback = config_atleast(parse_int(arg), SCROLLBACK);
             } else if (cmd == "save_window") {
                 std::stringstream ss(arg);
                 std::string entry;
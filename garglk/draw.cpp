@@ -21,8 +21,10 @@
 #include <array>
 #include <cmath>
 #include <cstddef>
+#include <cstring>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
@@ -34,6 +36,7 @@
 
 #include "glk.h"
 #include "garglk.h"
+#include "blend.h"
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -49,11 +52,7 @@ using namespace std::literals;
 
 #define UNICODE_QUESTION_MARK 63
 
-#define GAMMA_BITS 11
-#define GAMMA_MAX ((1 << GAMMA_BITS) - 1)
-
 #define mul255(a, b) ((static_cast<short>(a) * (b) + 127) / 255)
-#define mulhigh(a, b) ((static_cast<int>(a) * (b) + (1 << (GAMMA_BITS - 1)) - 1) / GAMMA_MAX)
 #define grayscale(r, g, b) ((30 * (r) + 59 * (g) + 11 * (b)) / 100)
 
 static std::string convert_ft_error(FT_Error err, const std::string &basemsg);
@@ -62,14 +61,122 @@ namespace {
 
 struct Bitmap {
     int w, h, lsb, top, pitch;
-    std::vector<unsigned char> data;
+    std::size_t offset; // into the pixel arena of a GlyphAtlas
 };
 
+class Font;
+
+// A glyph's bitmaps are rendered separately for each subpixel position
+// (phase) at which it's drawn, and only when it's first drawn at that
+// position: text in grid windows, for example, is always drawn at whole
+// pixels, so only ever needs one phase. The bits of “phases” indicate
+// which entries of “glyph” have been rendered.
 struct FontEntry {
     int adv;
+    Font *font;
+    glui32 gid;
+    unsigned int phases = 0;
     std::array<Bitmap, GLI_SUBPIX> glyph;
 };
 
+// Rendered glyphs for a font face, including any glyphs borrowed from
+// substitution fonts. The bitmaps for all subpixel positions of all
+// glyphs are stored in a single pixel arena. Glyphs in the Basic
+// Multilingual Plane are found through a two-level direct-indexed
+// table, and anything else through a hash table.
+//
+// Glyphs are rendered differently depending on whether LCD mode is
+// enabled, so the atlas is emptied if that changes. Zoom is baked into
+// the font size, so a zoom change means new Font objects and thus new
+// atlases; gamma is only applied when drawing, so doesn't matter here.
+class GlyphAtlas {
+public:
+    GlyphAtlas() : m_generation(next_generation++) {
+    }
+
+    // Return the index of the glyph for “c”, or -1 if it's not cached.
+    int find(glui32 c) const {
+        int index = -1;
+
+        if (c < 0x10000) {
+            const auto &page = m_pages[c >> 8];
+            if (page) {
+                index = (*page)[c & 0xff];
+            }
+        } else {
+            auto it = m_astral.find(c);
+            if (it != m_astral.end()) {
+                index = it->second;
+            }
+        }
+
+        return index;
+    }
+
+    int insert(glui32 c, const FontEntry &entry) {
+        int index = m_entries.size();
+
+        m_entries.push_back(entry);
+
+        if (c < 0x10000) {
+            auto &page = m_pages[c >> 8];
+            if (!page) {
+                page = std::make_unique<Page>();
+                page->fill(-1);
+            }
+            (*page)[c & 0xff] = index;
+        } else {
+            m_astral.emplace(c, index);
+        }
+
+        return index;
+    }
+
+    FontEntry &entry(int index) {
+        return m_entries[index];
+    }
+
+    const Bitmap &bitmap(FontEntry &entry, int phase);
+
+    const unsigned char *data(const Bitmap &b) const {
+        return m_pixels.data() + b.offset;
+    }
+
+    void validate(bool lcd) {
+        if (lcd != m_lcd) {
+            for (auto &page : m_pages) {
+                page.reset();
+            }
+            m_astral.clear();
+            m_entries.clear();
+            m_pixels.clear();
+            m_lcd = lcd;
+            m_generation = next_generation++;
+        }
+    }
+
+    // Glyph indices are valid until the atlas is emptied, at which
+    // point its generation changes. Generations are unique across all
+    // atlases.
+    unsigned long generation() const {
+        return m_generation;
+    }
+
+private:
+    using Page = std::array<int, 256>;
+
+    std::array<std::unique_ptr<Page>, 256> m_pages;
+    std::unordered_map<glui32, int> m_astral;
+    std::vector<FontEntry> m_entries;
+    std::vector<unsigned char> m_pixels;
+    bool m_lcd = false;
+    unsigned long m_generation;
+
+    static unsigned long next_generation;
+};
+
+unsigned long GlyphAtlas::next_generation = 0;
+
 struct UniqueFaceDeleter {
     void operator()(FT_Face face) const {
         FT_Done_Face(face);
@@ -104,17 +211,35 @@ public:
     Font(FontFace fontface, UniqueFace face, const std::string &fontpath);
 
     FontEntry getglyph(glui32 cid);
+    Bitmap rasterize(glui32 gid, int phase, std::vector<unsigned char> &pixels);
     int charkern(glui32 c0, glui32 c1);
+    bool has_ligature(glui32 lig) const {
+        return m_ligatures[lig - UNI_LIG_FF];
+    }
     const UniqueFace &face() {
         return m_face;
     }
+    GlyphAtlas &atlas() {
+        return m_atlas;
+    }
 
 private:
     UniqueFace m_face;
     bool m_make_bold = false;
     bool m_make_oblique = false;
     bool m_kerned = false;
+    std::array<bool, UNI_LIG_FFL - UNI_LIG_FF + 1> m_ligatures;
+
+    // Kerning between printable ASCII characters is stored in a matrix
+    // built when the font is loaded; anything else is looked up as
+    // needed and cached.
+    static constexpr glui32 KERN_FIRST = 32;
+    static constexpr glui32 KERN_COUNT = 127 - KERN_FIRST;
+    std::vector<int> m_kernmatrix;
     std::unordered_map<unsigned long long, int> m_kerncache;
+    int kerning(glui32 c0, glui32 c1);
+
+    GlyphAtlas m_atlas;
 };
 
 }
@@ -125,8 +250,8 @@ private:
 
 std::unordered_map<FontFace, std::vector<std::string>> gli_conf_glyph_substitution_files;
 
-static std::array<std::uint16_t, 256> gammamap;
-static std::array<unsigned char, 1 << GAMMA_BITS> gammainv;
+static garglk::GammaTables gamma_tables;
+static garglk::BlendSpan blend_glyph_span;
 
 static std::unordered_map<FontFace, Font> gfont_table;
 static std::unordered_map<FontFace, std::vector<Font>> glyph_substitution_fonts;
@@ -188,67 +313,101 @@ static std::string convert_ft_error(FT_Error err, const std::string &basemsg)
 
 namespace {
 
+// Look up a glyph and its advance. The glyph's bitmaps aren't
+// rendered until they're needed (see GlyphAtlas::bitmap()).
 FontEntry Font::getglyph(glui32 cid)
 {
     FT_Vector v;
     int err;
-    glui32 gid;
     FontEntry entry;
-    std::size_t datasize;
 
-    gid = FT_Get_Char_Index(m_face.get(), cid);
-    if (gid == 0) {
+    entry.gid = FT_Get_Char_Index(m_face.get(), cid);
+    if (entry.gid == 0) {
         throw std::out_of_range(Format("no glyph for {}", cid));
     }
 
-    for (int x = 0; x < GLI_SUBPIX; x++) {
-        v.x = (x * 64) / GLI_SUBPIX;
-        v.y = 0;
+    v.x = 0;
+    v.y = 0;
 
-        FT_Set_Transform(m_face.get(), nullptr, &v);
+    FT_Set_Transform(m_face.get(), nullptr, &v);
 
-        err = FT_Load_Glyph(m_face.get(), gid,
-                FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING);
-        if (err != 0) {
-            throw std::runtime_error(convert_ft_error(err, "FT_Load_Glyph"));
-        }
+    err = FT_Load_Glyph(m_face.get(), entry.gid,
+            FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING);
+    if (err != 0) {
+        throw std::runtime_error(convert_ft_error(err, "FT_Load_Glyph"));
+    }
 
-        if (m_make_bold) {
-            FT_Outline_Embolden(&m_face->glyph->outline, FT_MulFix(m_face->units_per_EM, m_face->size->metrics.y_scale) / 24);
-        }
+    entry.font = this;
+    entry.adv = (m_face->glyph->advance.x * GLI_SUBPIX + 32) / 64;
 
-        if (m_make_oblique) {
-            FT_Outline_Transform(&m_face->glyph->outline, &ftmat);
-        }
+    return entry;
+}
 
-        if (gli_conf_lcd) {
-            if (use_freetype_preset_filter) {
-                FT_Library_SetLcdFilter(ftlib, freetype_preset_filter);
-            } else {
-                FT_Library_SetLcdFilterWeights(ftlib, gli_conf_lcd_weights.data());
-            }
+// Render a glyph at the specified subpixel position, appending the
+// bitmap to “pixels”.
+Bitmap Font::rasterize(glui32 gid, int phase, std::vector<unsigned char> &pixels)
+{
+    FT_Vector v;
+    int err;
+    Bitmap bitmap;
+    std::size_t datasize;
+
+    v.x = (phase * 64) / GLI_SUBPIX;
+    v.y = 0;
+
+    FT_Set_Transform(m_face.get(), nullptr, &v);
+
+    err = FT_Load_Glyph(m_face.get(), gid,
+            FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING);
+    if (err != 0) {
+        throw std::runtime_error(convert_ft_error(err, "FT_Load_Glyph"));
+    }
+
+    if (m_make_bold) {
+        FT_Outline_Embolden(&m_face->glyph->outline, FT_MulFix(m_face->units_per_EM, m_face->size->metrics.y_scale) / 24);
+    }
 
-            err = FT_Render_Glyph(m_face->glyph, FT_RENDER_MODE_LCD);
+    if (m_make_oblique) {
+        FT_Outline_Transform(&m_face->glyph->outline, &ftmat);
+    }
+
+    if (gli_conf_lcd) {
+        if (use_freetype_preset_filter) {
+            FT_Library_SetLcdFilter(ftlib, freetype_preset_filter);
         } else {
-            err = FT_Render_Glyph(m_face->glyph, FT_RENDER_MODE_LIGHT);
+            FT_Library_SetLcdFilterWeights(ftlib, gli_conf_lcd_weights.data());
         }
 
-        if (err != 0) {
-            throw std::runtime_error(convert_ft_error(err, "FT_Render_Glyph"));
-        }
+        err = FT_Render_Glyph(m_face->glyph, FT_RENDER_MODE_LCD);
+    } else {
+        err = FT_Render_Glyph(m_face->glyph, FT_RENDER_MODE_LIGHT);
+    }
+
+    if (err != 0) {
+        throw std::runtime_error(convert_ft_error(err, "FT_Render_Glyph"));
+    }
 
-        datasize = m_face->glyph->bitmap.pitch * m_face->glyph->bitmap.rows;
-        entry.adv = (m_face->glyph->advance.x * GLI_SUBPIX + 32) / 64;
+    datasize = m_face->glyph->bitmap.pitch * m_face->glyph->bitmap.rows;
+
+    bitmap.lsb = m_face->glyph->bitmap_left;
+    bitmap.top = m_face->glyph->bitmap_top;
+    bitmap.w = m_face->glyph->bitmap.width;
+    bitmap.h = m_face->glyph->bitmap.rows;
+    bitmap.pitch = m_face->glyph->bitmap.pitch;
+    bitmap.offset = pixels.size();
+    pixels.insert(pixels.end(), &m_face->glyph->bitmap.buffer[0], &m_face->glyph->bitmap.buffer[datasize]);
+
+    return bitmap;
+}
 
-        entry.glyph[x].lsb = m_face->glyph->bitmap_left;
-        entry.glyph[x].top = m_face->glyph->bitmap_top;
-        entry.glyph[x].w = m_face->glyph->bitmap.width;
-        entry.glyph[x].h = m_face->glyph->bitmap.rows;
-        entry.glyph[x].pitch = m_face->glyph->bitmap.pitch;
-        entry.glyph[x].data.assign(&m_face->glyph->bitmap.buffer[0], &m_face->glyph->bitmap.buffer[datasize]);
+const Bitmap &GlyphAtlas::bitmap(FontEntry &entry, int phase)
+{
+    if ((entry.phases & (1U << phase)) == 0) {
+        entry.glyph[phase] = entry.font->rasterize(entry.gid, phase, m_pixels);
+        entry.phases |= 1U << phase;
     }
 
-    return entry;
+    return entry.glyph[phase];
 }
 
 }
@@ -412,6 +571,35 @@ Font::Font(FontFace fontface, UniqueFace face, const std::string &fontpath) :
 
     m_kerned = FT_HAS_KERNING(m_face);
 
+    if (m_kerned) {
+        std::array<FT_UInt, KERN_COUNT> gids;
+        for (glui32 i = 0; i < KERN_COUNT; i++) {
+            gids[i] = FT_Get_Char_Index(m_face.get(), KERN_FIRST + i);
+        }
+
+        m_kernmatrix.assign(KERN_COUNT * KERN_COUNT, 0);
+        for (glui32 i = 0; i < KERN_COUNT; i++) {
+            for (glui32 j = 0; j < KERN_COUNT; j++) {
+                FT_Vector v;
+
+                if (gids[i] == 0 || gids[j] == 0) {
+                    continue;
+                }
+
+                err = FT_Get_Kerning(m_face.get(), gids[i], gids[j], FT_KERNING_UNFITTED, &v);
+                if (err != 0) {
+                    throw LoadError(err, fontpath, "FT_Get_Kerning");
+                }
+
+                m_kernmatrix[i * KERN_COUNT + j] = (v.x * GLI_SUBPIX) / 64.0;
+            }
+        }
+    }
+
+    for (glui32 lig = UNI_LIG_FF; lig <= UNI_LIG_FFL; lig++) {
+        m_ligatures[lig - UNI_LIG_FF] = FT_Get_Char_Index(m_face.get(), lig) != 0;
+    }
+
     m_make_bold = fontface.bold && ((m_face->style_flags & FT_STYLE_FLAG_BOLD) == 0);
     m_make_oblique = fontface.italic && ((m_face->style_flags & FT_STYLE_FLAG_ITALIC) == 0);
 }
@@ -420,13 +608,8 @@ void gli_initialize_fonts()
 {
     int err;
 
-    for (int i = 0; i < 256; i++) {
-        gammamap[i] = std::round(std::pow(i / 255.0, gli_conf_gamma) * GAMMA_MAX);
-    }
-
-    for (int i = 0; i <= GAMMA_MAX; i++) {
-        gammainv[i] = std::round(std::pow(i / static_cast<double>(GAMMA_MAX), 1.0 / gli_conf_gamma) * 255.0);
-    }
+    gamma_tables = garglk::GammaTables(gli_conf_gamma);
+    blend_glyph_span = garglk::blend_kernels().back().blend;
 
     err = FT_Init_FreeType(&ftlib);
     if (err != 0) {
@@ -526,78 +709,71 @@ void gli_draw_pixel(int x, int y, const Color &rgb)
     gli_image_rgb[y][x] = rgb;
 }
 
-static void draw_pixel_gamma(int x, int y, unsigned char alpha, const Color &rgb)
-{
-    if (x < 0 || x >= gli_image_rgb.width()) {
-        return;
-    }
-    if (y < 0 || y >= gli_image_rgb.height()) {
-        return;
+namespace {
+
+// The foreground color of a string, converted once per string for
+// gamma-correct blending.
+struct GammaColor {
+    explicit GammaColor(const Color &rgb) :
+        fg{gamma_tables.map[rgb[0]], gamma_tables.map[rgb[1]], gamma_tables.map[rgb[2]]}
+    {
     }
 
-    std::uint16_t invalf = GAMMA_MAX - (alpha * GAMMA_MAX / 255);
-    std::array<std::uint16_t, 3> bg = {
-        gammamap[gli_image_rgb[y][x][0]],
-        gammamap[gli_image_rgb[y][x][1]],
-        gammamap[gli_image_rgb[y][x][2]]
-    };
-    std::array<std::uint16_t, 3> fg = {
-        gammamap[rgb[0]],
-        gammamap[rgb[1]],
-        gammamap[rgb[2]]
-    };
+    std::array<std::uint16_t, 3> fg;
+};
 
-    gli_image_rgb[y][x] = Pixel<3>(gammainv[fg[0] + mulhigh(static_cast<int>(bg[0]) - fg[0], invalf)],
-                                   gammainv[fg[1] + mulhigh(static_cast<int>(bg[1]) - fg[1], invalf)],
-                                   gammainv[fg[2] + mulhigh(static_cast<int>(bg[2]) - fg[2], invalf)]);
 }
 
-static void draw_pixel_lcd_gamma(int x, int y, const unsigned char *alpha, const Color &rgb)
+// Composite a glyph onto the framebuffer. The glyph is clipped to the
+// framebuffer once up front, and then blended a row at a time.
+static void draw_bitmap_gamma(const Bitmap &b, const unsigned char *data, int x, int y, const GammaColor &color)
 {
-    if (x < 0 || x >= gli_image_rgb.width()) {
-        return;
-    }
-    if (y < 0 || y >= gli_image_rgb.height()) {
+    static std::vector<unsigned char> alpha3;
+    int x0 = x + b.lsb;
+    int y0 = y - b.top;
+    int i0 = std::max(0, -x0);
+    int i1 = std::min(b.w, gli_image_rgb.width() - x0);
+    int k0 = std::max(0, -y0);
+    int k1 = std::min(b.h, gli_image_rgb.height() - y0);
+
+    if (i0 >= i1) {
         return;
     }
 
-    std::array<std::uint16_t, 3> invalf = {
-        static_cast<std::uint16_t>(GAMMA_MAX - (alpha[0] * GAMMA_MAX / 255)),
-        static_cast<std::uint16_t>(GAMMA_MAX - (alpha[1] * GAMMA_MAX / 255)),
-        static_cast<std::uint16_t>(GAMMA_MAX - (alpha[2] * GAMMA_MAX / 255)),
-    };
-    std::array<std::uint16_t, 3> bg = {
-        gammamap[gli_image_rgb[y][x][0]],
-        gammamap[gli_image_rgb[y][x][1]],
-        gammamap[gli_image_rgb[y][x][2]]
-    };
-    std::array<std::uint16_t, 3> fg = {
-        gammamap[rgb[0]],
-        gammamap[rgb[1]],
-        gammamap[rgb[2]]
-    };
+    alpha3.resize(3 * (i1 - i0));
 
-    gli_image_rgb[y][x] = Pixel<3>(gammainv[fg[0] + mulhigh(static_cast<int>(bg[0]) - fg[0], invalf[0])],
-                                   gammainv[fg[1] + mulhigh(static_cast<int>(bg[1]) - fg[1], invalf[1])],
-                                   gammainv[fg[2] + mulhigh(static_cast<int>(bg[2]) - fg[2], invalf[2])]);
-}
+    for (int k = k0; k < k1; k++) {
+        const unsigned char *alpha = &data[k * b.pitch];
+        unsigned char *row = gli_image_rgb.data() + (y0 + k) * gli_image_rgb.stride() + x0 * 3;
 
-static void draw_bitmap_gamma(const Bitmap &b, int x, int y, const Color &rgb)
-{
-    for (int k = 0; k < b.h; k++) {
-        for (int i = 0; i < b.w; i++) {
-            auto c = b.data[k * b.pitch + i];
-            draw_pixel_gamma(x + b.lsb + i, y - b.top + k, c, rgb);
+        // The span blender takes an alpha value per channel.
+        for (int i = i0; i < i1; i++) {
+            std::memset(&alpha3[3 * (i - i0)], alpha[i], 3);
         }
+
+        blend_glyph_span(gamma_tables, &row[i0 * 3], alpha3.data(), 3 * (i1 - i0), color.fg);
     }
 }
 
-static void draw_bitmap_lcd_gamma(const Bitmap &b, int x, int y, const Color &rgb)
+// LCD glyphs have three alpha values (one per subpixel) for each pixel.
+static void draw_bitmap_lcd_gamma(const Bitmap &b, const unsigned char *data, int x, int y, const GammaColor &color)
 {
-    for (int k = 0; k < b.h; k++) {
-        for (int i = 0, j = 0; i < b.w; i += 3, j++) {
-            draw_pixel_lcd_gamma(x + b.lsb + j, y - b.top + k, b.data.data() + k * b.pitch + i, rgb);
-        }
+    int x0 = x + b.lsb;
+    int y0 = y - b.top;
+    int j0 = std::max(0, -x0);
+    int j1 = std::min((b.w + 2) / 3, gli_image_rgb.width() - x0);
+    int k0 = std::max(0, -y0);
+    int k1 = std::min(b.h, gli_image_rgb.height() - y0);
+
+    if (j0 >= j1) {
+        return;
+    }
+
+    for (int k = k0; k < k1; k++) {
+        const unsigned char *alpha = &data[k * b.pitch];
+        unsigned char *row = gli_image_rgb.data() + (y0 + k) * gli_image_rgb.stride() + x0 * 3;
+
+        blend_glyph_span(gamma_tables, &row[j0 * 3], &alpha[j0 * 3], 3 * (j1 - j0), color.fg);
     }
 }
 
@@ -624,20 +800,34 @@ void gli_draw_rect(int x0, int y0, int w, int h, const Color &rgb)
 
 int Font::charkern(glui32 c0, glui32 c1)
 {
-    FT_Vector v;
-    int err;
-    int g0, g1;
-
     if (!m_kerned) {
         return 0;
     }
 
+    // c0 and c1 are unsigned, so anything below KERN_FIRST wraps around
+    // and fails the range check.
+    if (c0 - KERN_FIRST < KERN_COUNT && c1 - KERN_FIRST < KERN_COUNT) {
+        return m_kernmatrix[(c0 - KERN_FIRST) * KERN_COUNT + (c1 - KERN_FIRST)];
+    }
+
     unsigned long long key = (static_cast<unsigned long long>(c0) << 32) | c1;
-    try {
-        return m_kerncache.at(key);
-    } catch (const std::out_of_range &) {
+    auto it = m_kerncache.find(key);
+    if (it != m_kerncache.end()) {
+        return it->second;
     }
 
+    int value = kerning(c0, c1);
+    m_kerncache.emplace(key, value);
+
+    return value;
+}
+
+int Font::kerning(glui32 c0, glui32 c1)
+{
+    FT_Vector v;
+    int err;
+    int g0, g1;
+
     g0 = FT_Get_Char_Index(m_face.get(), c0);
     g1 = FT_Get_Char_Index(m_face.get(), c1);
 
@@ -650,130 +840,188 @@ int Font::charkern(glui32 c0, glui32 c1)
         throw std::runtime_error(convert_ft_error(err, "FT_Get_Kerning"));
     }
 
-    int value = (v.x * GLI_SUBPIX) / 64.0;
-    m_kerncache.emplace(key, value);
+    return (v.x * GLI_SUBPIX) / 64.0;
+}
 
-    return value;
+// If “s” starts with a sequence that can be replaced by a ligature,
+// store the ligature in “lig” and return the length of the sequence;
+// otherwise return 0. Longer sequences take precedence.
+static std::size_t match_ligature(const glui32 *s, std::size_t n, glui32 &lig)
+{
+    if (n < 2 || s[0] != 'f') {
+        return 0;
+    }
+
+    switch (s[1]) {
+    case 'f':
+        if (n >= 3 && s[2] == 'i') {
+            lig = UNI_LIG_FFI;
+            return 3;
+        } else if (n >= 3 && s[2] == 'l') {
+            lig = UNI_LIG_FFL;
+            return 3;
+        }
+
+        lig = UNI_LIG_FF;
+        return 2;
+    case 'i':
+        lig = UNI_LIG_FI;
+        return 2;
+    case 'l':
+        lig = UNI_LIG_FL;
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+// Return the atlas index of the FontEntry corresponding to the specific
+// glyph. If that glyph is unavailable, log a warning and select a
+// question mark instead. If a question mark can't be loaded, abort with
+// an error message.
+static int lookup_glyph(FontFace fontface, Font &f, glui32 c)
+{
+    auto &atlas = f.atlas();
+
+    int index = atlas.find(c);
+    if (index != -1) {
+        return index;
+    }
+
+    try {
+        return atlas.insert(c, f.getglyph(c));
+    } catch (const std::out_of_range &) {
+    }
+
+    for (auto &font : glyph_substitution_fonts[fontface]) {
+        try {
+            return atlas.insert(c, font.getglyph(c));
+        } catch (const std::out_of_range &) {
+        }
+    }
+
+    auto msg = Format("Unable to look up glyph {} for {}", c, fontface_to_name(fontface));
+    std::cerr << msg << std::endl;
+    try {
+        return atlas.insert(c, f.getglyph(UNICODE_QUESTION_MARK));
+    } catch (const std::out_of_range &) {
+        garglk::winabort(Format("{}, and substituting '?' failed", msg));
+    }
 }
 
-static const std::vector<std::pair<std::vector<glui32>, glui32>> ligatures = {
-    {{'f', 'f', 'i'}, UNI_LIG_FFI},
-    {{'f', 'f', 'l'}, UNI_LIG_FFL},
-    {{'f', 'f'}, UNI_LIG_FF},
-    {{'f', 'i'}, UNI_LIG_FI},
-    {{'f', 'l'}, UNI_LIG_FL},
+namespace {
+
+// A run of text converted to glyphs: the atlas index of each glyph, and
+// its position relative to the start of the run.
+struct ShapedGlyph {
+    int x;
+    int index;
+};
+
+struct ShapedRun {
+    const Font *font = nullptr;
+    unsigned long generation = 0;
+    int spw = 0;
+    std::vector<glui32> text;
+    std::vector<ShapedGlyph> glyphs;
+    int width = 0;
 };
 
-static int gli_string_impl(int x, FontFace fontface, const glui32 *s, std::size_t n, int spw, const std::function<void(int, const std::array<Bitmap, GLI_SUBPIX> &)> &callback)
+}
+
+// Convert text to positioned glyphs, applying ligatures and kerning.
+// Text is generally measured shortly before it's drawn (see
+// win_textbuffer_redraw()), so the last few runs are kept, and the
+// returned run is valid until the next call.
+static const ShapedRun &shape(FontFace fontface, const glui32 *s, std::size_t n, int spw)
 {
+    static std::array<ShapedRun, 16> cache;
+    static std::size_t next = 0;
+
     auto &f = gfont_table.at(fontface);
+    auto &atlas = f.atlas();
+
+    atlas.validate(gli_conf_lcd);
+
+    for (const auto &run : cache) {
+        if (run.font == &f && run.generation == atlas.generation() && run.spw == spw &&
+            run.text.size() == n && std::equal(s, s + n, run.text.begin())) {
+            return run;
+        }
+    }
+
+    auto &run = cache[next];
+    next = (next + 1) % cache.size();
+
+    run.font = &f;
+    run.generation = atlas.generation();
+    run.spw = spw;
+    run.text.assign(s, s + n);
+    run.glyphs.clear();
+
     bool dolig = !FT_IS_FIXED_WIDTH(f.face());
+    int x = 0;
     int prev = -1;
-    glui32 c;
 
     while (n > 0) {
-        auto it = ligatures.end();
-        if (dolig) {
-            it = std::find_if(ligatures.begin(), ligatures.end(), [s, n](const std::pair<std::vector<glui32>, glui32> &ligentry) {
-                const auto &ligature = ligentry.first;
-                if (ligature.size() > n) {
-                    return false;
-                }
+        glui32 c;
+        std::size_t len = dolig ? match_ligature(s, n, c) : 0;
 
-                for (std::size_t i = 0; i < ligature.size(); i++) {
-                    if (s[i] != ligature[i]) {
-                        return false;
-                    }
-                }
-
-                return true;
-            });
-        }
-
-        if (it != ligatures.end() && FT_Get_Char_Index(f.face().get(), it->second) != 0) {
-            c = it->second;
-            s += it->first.size();
-            n -= it->first.size();
+        if (len != 0 && f.has_ligature(c)) {
+            s += len;
+            n -= len;
         } else {
             c = *s++;
             n--;
         }
 
-        // Return a FontEntry corresponding to the specific glyph. If
-        // that glyph is unavailable, log a warning and select a
-        // question mark instead. If a question mark can't be loaded,
-        // abort with an error message. Lookups are cached.
-        auto glyph = [&f, &fontface](glui32 c) -> const FontEntry & {
-            static std::unordered_map<std::pair<FontFace, glui32>, FontEntry> fallback_cache;
-
-            auto key = std::make_pair(fontface, c);
-
-            auto it = fallback_cache.find(key);
-            if (it == fallback_cache.end()) {
-                try {
-                    it = fallback_cache.emplace(key, f.getglyph(c)).first;
-                } catch (const std::out_of_range &) {
-                    for (auto &font : glyph_substitution_fonts[fontface]) {
-                        try {
-                            it = fallback_cache.emplace(key, font.getglyph(c)).first;
-                            break;
-                        } catch (const std::out_of_range &) {
-                        }
-                    }
-                }
-
-                if (it == fallback_cache.end()) {
-                    auto msg = Format("Unable to look up glyph {} for {}", c, fontface_to_name(fontface));
-                    std::cerr << msg << std::endl;
-                    try {
-                        it = fallback_cache.emplace(key, f.getglyph(UNICODE_QUESTION_MARK)).first;
-                    } catch (const std::out_of_range &) {
-                        garglk::winabort(Format("{}, and substituting '?' failed", msg));
-                    }
-                }
-            }
-
-            return it->second;
-        };
-
         if (prev != -1) {
             x += f.charkern(prev, c);
         }
 
-        const auto &entry = glyph(c);
+        int index = lookup_glyph(fontface, f, c);
 
-        callback(x, entry.glyph);
+        run.glyphs.push_back({x, index});
 
         if (spw >= 0 && c == ' ') {
             x += spw;
         } else {
-            x += entry.adv;
+            x += atlas.entry(index).adv;
         }
 
         prev = c;
     }
 
-    return x;
+    run.width = x;
+
+    return run;
 }
 
 int gli_draw_string_uni(int x, int y, FontFace face, const Color &rgb,
                         const glui32 *text, int len, int spacewidth)
 {
-    return gli_string_impl(x, face, text, len, spacewidth, [&y, &rgb](int x, const std::array<Bitmap, GLI_SUBPIX> &glyphs) {
-        int px = x / GLI_SUBPIX;
-        int sx = x % GLI_SUBPIX;
+    const auto &run = shape(face, text, len, spacewidth);
+    auto &atlas = gfont_table.at(face).atlas();
+    GammaColor color(rgb);
+
+    for (const auto &glyph : run.glyphs) {
+        int px = (x + glyph.x) / GLI_SUBPIX;
+        int sx = (x + glyph.x) % GLI_SUBPIX;
+        const Bitmap &b = atlas.bitmap(atlas.entry(glyph.index), sx);
 
         if (gli_conf_lcd) {
-            draw_bitmap_lcd_gamma(glyphs[sx], px, y, rgb);
+            draw_bitmap_lcd_gamma(b, atlas.data(b), px, y, color);
         } else {
-            draw_bitmap_gamma(glyphs[sx], px, y, rgb);
+            draw_bitmap_gamma(b, atlas.data(b), px, y, color);
         }
-    });
+    }
+
+    return x + run.width;
 }
 
 int gli_string_width_uni(FontFace face, const glui32 *text, int len, int spacewidth)
 {
-    return gli_string_impl(0, face, text, len, spacewidth, [](int, const std::array<Bitmap, GLI_SUBPIX> &) {});
+    return shape(face, text, len, spacewidth).width;
 }
 
 void gli_draw_caret(int x, int y)
@@ -797,6 +1045,63 @@ void gli_draw_caret(int x, int y)
     }
 }
 
+static void blend_span(unsigned char *dst, const unsigned char *src, int n)
+{
+    for (int x = 0; x < n; x++, src += 4, dst += 3) {
+        unsigned char sa = src[3];
+        unsigned char na = 255 - sa;
+        dst[0] = mul255(src[0], sa) + mul255(dst[0], na);
+        dst[1] = mul255(src[1], sa) + mul255(dst[1], na);
+        dst[2] = mul255(src[2], sa) + mul255(dst[2], na);
+    }
+}
+
+static void copy_span(unsigned char *dst, const unsigned char *src, int n)
+{
+    for (int x = 0; x < n; x++) {
+        dst[x * 3 + 0] = src[x * 4 + 0];
+        dst[x * 3 + 1] = src[x * 4 + 1];
+        dst[x * 3 + 2] = src[x * 4 + 2];
+    }
+}
+
+// Composite a row of RGBA source pixels onto RGB destination pixels.
+// Fully opaque pictures are copied outright. Otherwise the row is
+// looked at in small chunks: chunks that are entirely opaque are
+// copied, entirely transparent ones are skipped, and the rest are
+// blended. Copying and skipping give the same result blending would,
+// since mul255(c, 255) == c and mul255(c, 0) == 0. Working in chunks
+// rather than runs keeps pictures with noisy alpha from being slowed
+// down by branching on every pixel.
+static void composite_row(unsigned char *dst, const unsigned char *src, int w, bool opaque)
+{
+    constexpr int chunk = 8;
+
+    if (opaque) {
+        copy_span(dst, src, w);
+        return;
+    }
+
+    int x = 0;
+    for (; x + chunk <= w; x += chunk) {
+        const unsigned char *s = &src[x * 4];
+        unsigned int all = 255, any = 0;
+
+        for (int i = 0; i < chunk; i++) {
+            all &= s[i * 4 + 3];
+            any |= s[i * 4 + 3];
+        }
+
+        if (all == 255) {
+            copy_span(&dst[x * 3], s, chunk);
+        } else if (any != 0) {
+            blend_span(&dst[x * 3], s, chunk);
+        }
+    }
+
+    blend_span(&dst[x * 3], &src[x * 4], w - x);
+}
+
 void gli_draw_picture(const picture_t *pic, int x0, int y0, int dx0, int dy0, int dx1, int dy1)
 {
     int x1, y1, sx0, sy0, sx1, sy1;
@@ -835,16 +1140,7 @@ void gli_draw_picture(const picture_t *pic, int x0, int y0, int dx0, int dy0, in
     h = sy1 - sy0;
 
     for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            auto existing = gli_image_rgb[y + y0][x + x0];
-            unsigned char sa = pic->rgba[y + sy0][x + sx0][3];
-            unsigned char na = 255 - sa;
-            unsigned char sr = mul255(pic->rgba[y + sy0][x + sx0][0], sa);
-            unsigned char sg = mul255(pic->rgba[y + sy0][x + sx0][1], sa);
-            unsigned char sb = mul255(pic->rgba[y + sy0][x + sx0][2], sa);
-            gli_image_rgb[y + y0][x + x0] = Pixel<3>(sr + mul255(existing[0], na),
-                                                     sg + mul255(existing[1], na),
-                                                     sb + mul255(existing[2], na));
-        }
+        unsigned char *dst = gli_image_rgb.data() + (y + y0) * gli_image_rgb.stride() + x0 * 3;
+        composite_row(dst, pic->rgba[y + sy0][sx0], w, pic->opaque);
     }
 }
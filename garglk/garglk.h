@@ -512,12 +512,23 @@ struct picture_t {
         h(rgba.height()),
         scaled(scaled_)
     {
+        const unsigned char *data = rgba.data();
+        for (std::size_t i = 3; i < rgba.size(); i += 4) {
+            if (data[i] != 255) {
+                opaque = false;
+                break;
+            }
+        }
     }
 
     unsigned long id;
     Canvas<4> rgba;
     int w, h;
     bool scaled;
+
+    // True if every pixel has full alpha, so drawing the picture can
+    // skip blending entirely.
+    bool opaque = true;
 };
 
 struct style_t {
@@ -622,6 +633,8 @@ extern int gli_rows;
 extern bool gli_conf_lockcols;
 extern bool gli_conf_lockrows;
 
+extern int gli_conf_scrollback;
+
 extern bool gli_conf_save_window_size;
 extern bool gli_conf_save_window_location;
 
@@ -928,17 +941,101 @@ struct window_textgrid_t {
     Styles styles = gli_gstyles;
 };
 
+// A run of characters in a text buffer line which share the same
+// attributes. The run starts at character “start” and extends to the
+// start of the next run, or to the end of the line.
+struct attrrun_t {
+    int start;
+    attr_t attr;
+};
+
+// One line of a text buffer window. Apart from line 0, which is the
+// line currently being written to (see window_textbuffer_t::chars),
+// lines store their text compactly: only as many characters as the line
+// holds, and attributes as runs, since an entire line usually shares a
+// single style.
 struct tbline_t {
-    tbline_t() {
-        chars.fill(' ');
-    }
+    // Unique to the line's contents, which don't change once it's
+    // scrolled into history; 0 for the current line.
+    unsigned long id = 0;
     int len = 0;
     bool newline = false, dirty = false, repaint = false;
     std::shared_ptr<picture_t> lpic, rpic;
     glui32 lhyper = 0, rhyper = 0;
     int lm = 0, rm = 0;
-    std::array<glui32, TBLINELEN> chars;
-    std::array<attr_t, TBLINELEN> attrs;
+    std::vector<glui32> chars;
+    std::vector<attrrun_t> attrs;
+
+    void store(const glui32 *chars_, const attr_t *attrs_, int len_);
+    void expand(glui32 *chars_, attr_t *attrs_) const;
+    void discard();
+    std::size_t memory() const;
+};
+
+// A hyperlink drawn in a text buffer row, in pixels.
+struct tblink_t {
+    glui32 link;
+    int x0, x1;
+};
+
+// What was last drawn in a row of a text buffer window: the line (by
+// id, or 0 if the row can't be reused), and its hyperlinks.
+struct tbrow_t {
+    unsigned long id = 0;
+    std::vector<tblink_t> links;
+};
+
+// The lines of a text buffer window. These are stored in a circular
+// buffer so that scrolling the window by one line is a constant-time
+// operation, regardless of how much scrollback there is. Logical index
+// 0 is the current (bottom) line, and each higher index is one line
+// further back in history.
+class Scrollback {
+public:
+    tbline_t &operator[](std::size_t i) {
+        return m_lines[physical(i)];
+    }
+
+    const tbline_t &operator[](std::size_t i) const {
+        return m_lines[physical(i)];
+    }
+
+    std::size_t size() const {
+        return m_lines.size();
+    }
+
+    // Grow (or shrink) the buffer, preserving logical order. Lines are
+    // added or removed at the oldest end.
+    void resize(std::size_t size) {
+        std::rotate(m_lines.begin(), m_lines.begin() + m_head, m_lines.end());
+        m_head = 0;
+        m_lines.resize(size);
+    }
+
+    // Scroll by one line: every line moves one index back, and the
+    // oldest line is recycled as the new line 0. The recycled line
+    // still holds its old contents, so the caller must reset it.
+    void push_front() {
+        m_head = m_head == 0 ? m_lines.size() - 1 : m_head - 1;
+    }
+
+    std::size_t memory() const {
+        std::size_t total = m_lines.capacity() * sizeof(tbline_t);
+        for (const auto &line : m_lines) {
+            total += line.memory();
+        }
+
+        return total;
+    }
+
+private:
+    std::size_t physical(std::size_t i) const {
+        std::size_t p = m_head + i;
+        return p >= m_lines.size() ? p - m_lines.size() : p;
+    }
+
+    std::vector<tbline_t> m_lines;
+    std::size_t m_head = 0;
 };
 
 struct window_textbuffer_t {
@@ -946,10 +1043,12 @@ struct window_textbuffer_t {
         owner(owner_)
     {
         lines.resize(scrollback);
-        chars = lines[0].chars.data();
-        attrs = lines[0].attrs.data();
+        linechars.fill(' ');
     }
 
+    window_textbuffer_t(const window_textbuffer_t &) = delete;
+    window_textbuffer_t &operator=(const window_textbuffer_t &) = delete;
+
     ~window_textbuffer_t() {
         if (inbuf != nullptr && gli_unregister_arr != nullptr) {
             const char *typedesc = (inunicode ? "&+#!Iu" : "&+#!Cn");
@@ -963,12 +1062,17 @@ struct window_textbuffer_t {
     int spaced = 0;
     int dashed = 0;
 
-    std::vector<tbline_t> lines;
+    Scrollback lines;
     int scrollback = SCROLLBACK;
 
-    int numchars = 0; // number of chars in last line: lines[0]
-    glui32 *chars;    // alias to lines[0].chars
-    attr_t *attrs;    // alias to lines[0].attrs
+    // The line currently being written to (lines[0]). It's kept in
+    // fixed-size buffers since it's edited in place; once it scrolls
+    // up, it's stored compactly in its tbline_t.
+    std::array<glui32, TBLINELEN> linechars;
+    std::array<attr_t, TBLINELEN> lineattrs;
+    int numchars = 0;                 // number of chars in last line: lines[0]
+    glui32 *chars = linechars.data(); // alias to linechars
+    attr_t *attrs = lineattrs.data(); // alias to lineattrs
 
     // adjust margins temporarily for images
     int ladjw = 0;
@@ -999,6 +1103,23 @@ struct window_textbuffer_t {
 
     // for copy selection
     std::vector<glui32> copybuf;
+
+    // for reflow: the first reflowlen characters are logical text,
+    // older than anything in the scrollback, which hasn't yet been
+    // rewrapped to the current width
+    std::vector<glui32> reflowchars;
+    std::vector<attr_t> reflowattrs;
+    int reflowlen = 0;
+
+    // for redrawing: what's drawn in each row of the window, from the
+    // top, so rows can be moved rather than redrawn when scrolling
+    std::vector<tbrow_t> rows;
+    rect_t rowsbox = {0, 0, 0, 0};
+    bool rowspics = false;
+
+    // the height of the tallest margin image ever placed in the window,
+    // which bounds how far above the window a visible image can start
+    int maxpich = 0;
 };
 
 struct window_graphics_t {
@@ -1194,6 +1315,9 @@ void gli_edit_config();
 
 nonstd::optional<std::vector<char>> gli_get_scrollback();
 std::vector<char> gli_get_text(window_textbuffer_t *dwin);
+std::size_t gli_textbuffer_memory(const window_textbuffer_t *dwin);
+std::string gli_get_stats();
+void gli_record_blit(std::size_t bytes);
 
 const std::map<glui32, std::vector<unsigned char>> &gli_get_resource_map(glui32 usage);
 
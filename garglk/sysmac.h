@@ -42,6 +42,7 @@
 #define NSKEY_E         0x0e
 #define NSKEY_F         0x03
 #define NSKEY_H         0x04
+#define NSKEY_I         0x22
 #define NSKEY_N         0x2d
 #define NSKEY_P         0x23
 #define NSKEY_S         0x01
@@ -534,6 +534,10 @@ void winrefresh()
                                   width: gli_image_rgb.width()
                                  height: gli_image_rgb.height()];
 
+    if (refreshed) {
+        gli_record_blit(gli_image_rgb.size());
+    }
+
     gli_refresh_needed = !refreshed;
 }
 
@@ -593,6 +597,11 @@ static void show_themes()
     show_info(@"Themes", text);
 }
 
+static void show_stats()
+{
+    show_info(@"Statistics", gli_get_stats());
+}
+
 void winkey(NSEvent *evt)
 {
     NSEventModifierFlags modifiers = [evt modifierFlags];
@@ -623,6 +632,7 @@ void winkey(NSEvent *evt)
         // info
         {{NSEventModifierFlagCommand, NSKEY_PERIOD}, show_paths},
         {{NSEventModifierFlagShift | NSEventModifierFlagCommand, NSKEY_T}, show_themes},
+        {{NSEventModifierFlagShift | NSEventModifierFlagCommand, NSKEY_I}, show_stats},
 
         // readline/emacs-style controls
         {{NSEventModifierFlagControl, NSKEY_A}, []{ gli_input_handle_key(keycode_Home); }},
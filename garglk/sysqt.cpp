@@ -35,6 +35,7 @@
 #include <QObject>
 #include <QPainter>
 #include <QPalette>
+#include <QRegion>
 #include <QProcess>
 #include <QResizeEvent>
 #include <QSettings>
@@ -115,6 +116,13 @@ static garglk::Window *window;
 
 static bool refresh_needed = true;
 
+// The parts of the framebuffer which have changed since they were last
+// copied to the screen, as reported by winrepaint(). Lots of small
+// rectangles are slower to copy than their bounding box, so past a
+// certain point they're merged.
+static QRegion damage;
+static constexpr int DAMAGE_MAX_RECTS = 32;
+
 static constexpr int TICK_PERIOD_MILLIS = 10;
 static std::atomic<bool> process_events(false);
 
@@ -348,7 +356,11 @@ void garglk::View::refresh()
         gli_drawselect = false;
     }
 
-    update();
+    if (!damage.isEmpty()) {
+        update(damage);
+        damage = QRegion();
+    }
+
     refresh_needed = false;
 }
 
@@ -356,7 +368,19 @@ void garglk::View::paintEvent(QPaintEvent *event)
 {
     QImage image(gli_image_rgb.data(), gli_image_rgb.width(), gli_image_rgb.height(), gli_image_rgb.stride(), QImage::Format_RGB888);
     QPainter painter(this);
-    painter.drawImage(QPoint(0, 0), image);
+    std::size_t bytes = 0;
+
+    // Only copy the parts of the framebuffer that need painting: either
+    // what's been damaged, or what Qt itself wants repainted (e.g. after
+    // the window is uncovered).
+    for (const auto &rect : event->region()) {
+        auto clipped = rect.intersected(image.rect());
+        painter.drawImage(clipped.topLeft(), image, clipped);
+        bytes += clipped.width() * clipped.height() * 3;
+    }
+
+    gli_record_blit(bytes);
+
     event->accept();
 }
 
@@ -464,6 +488,13 @@ static void show_themes()
     box.exec();
 }
 
+static void show_stats()
+{
+    QMessageBox box(QMessageBox::Icon::Information, "Statistics", QString::fromStdString(gli_get_stats()));
+    box.setTextFormat(Qt::TextFormat::PlainText);
+    box.exec();
+}
+
 void garglk::View::keyPressEvent(QKeyEvent *event)
 {
     Qt::KeyboardModifiers modmasked = event->modifiers() & (Qt::ShiftModifier | Qt::ControlModifier | Qt::AltModifier | Qt::MetaModifier);
@@ -502,6 +533,7 @@ void garglk::View::keyPressEvent(QKeyEvent *event)
 #endif
 
         {{Qt::ShiftModifier | Qt::ControlModifier, Qt::Key_T}, [] { show_themes(); }},
+        {{Qt::ShiftModifier | Qt::ControlModifier, Qt::Key_I}, show_stats},
 
         {{Qt::ShiftModifier, Qt::Key_Backspace}, []{ gli_input_handle_key(keycode_Delete); }},
 
@@ -739,6 +771,13 @@ void wintitle()
 
 void winrepaint(int x0, int y0, int x1, int y1)
 {
+    QRect rect = QRect(x0, y0, x1 - x0, y1 - y0).intersected(QRect(0, 0, gli_image_rgb.width(), gli_image_rgb.height()));
+
+    damage += rect;
+    if (damage.rectCount() > DAMAGE_MAX_RECTS) {
+        damage = damage.boundingRect();
+    }
+
     refresh_needed = true;
 }
 
@@ -0,0 +1,111 @@
+// Check that every SIMD glyph blender usable on this CPU gives exactly
+// the same results as the scalar one, and that the scalar one's
+// shortcuts match the plain blend formula.
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "blend.h"
+
+using garglk::GAMMA_BITS;
+using garglk::GAMMA_MAX;
+
+using Foreground = std::array<std::uint16_t, 3>;
+
+static unsigned char reference(const garglk::GammaTables &gamma, unsigned char bg, unsigned char alpha, std::uint16_t fg)
+{
+    int invalf = GAMMA_MAX - (alpha * GAMMA_MAX / 255);
+
+    return gamma.inv[fg + ((gamma.map[bg] - fg) * invalf + (1 << (GAMMA_BITS - 1)) - 1) / GAMMA_MAX];
+}
+
+static int failures = 0;
+
+static void check(const char *what, const char *kernel, double gamma, const std::vector<unsigned char> &expected, const std::vector<unsigned char> &actual)
+{
+    for (std::size_t i = 0; i < expected.size(); i++) {
+        if (actual[i] != expected[i]) {
+            std::printf("%s: %s differs at gamma %g, channel %zu: expected %d, got %d\n",
+                    what, kernel, gamma, i, expected[i], actual[i]);
+            failures++;
+            return;
+        }
+    }
+}
+
+int main()
+{
+    auto kernels = garglk::blend_kernels();
+
+    for (const auto &kernel : kernels) {
+        std::printf("testing %s\n", kernel.name);
+    }
+
+    for (double g : {0.5, 1.0, 1.8, 2.2, 3.0}) {
+        garglk::GammaTables gamma(g);
+
+        // Every combination of background, alpha, and channel, for a
+        // range of foreground colors. Since 256 and 3 are coprime,
+        // channel i covers each (background, alpha) pair once as each
+        // of red, green, and blue.
+        std::vector<unsigned char> bg(3 * 65536), alpha(3 * 65536);
+        for (std::size_t i = 0; i < bg.size(); i++) {
+            bg[i] = i & 0xff;
+            alpha[i] = (i >> 8) & 0xff;
+        }
+
+        for (int f = 0; f < 256; f += 15) {
+            Foreground fg = {gamma.map[f], gamma.map[255 - f], gamma.map[(f * 37) & 0xff]};
+
+            std::vector<unsigned char> expected(bg);
+            for (std::size_t i = 0; i < expected.size(); i++) {
+                expected[i] = reference(gamma, bg[i], alpha[i], fg[i % 3]);
+            }
+
+            for (const auto &kernel : kernels) {
+                std::vector<unsigned char> actual(bg);
+                kernel.blend(gamma, actual.data(), alpha.data(), static_cast<int>(actual.size()), fg);
+                check("exhaustive", kernel.name, g, expected, actual);
+            }
+        }
+
+        // Short spans, like glyph rows, starting at every pixel offset.
+        // Alpha is mostly fully transparent or fully opaque, as it is in
+        // real glyphs.
+        std::mt19937 rng(1);
+        for (int iter = 0; iter < 20000; iter++) {
+            int start = 3 * (rng() % 8);
+            int n = 3 * (rng() % 40);
+            Foreground fg = {gamma.map[rng() & 0xff], gamma.map[rng() & 0xff], gamma.map[rng() & 0xff]};
+            std::vector<unsigned char> row(start + n + 24), span_alpha(n);
+
+            for (auto &c : row) {
+                c = rng() & 0xff;
+            }
+            for (auto &a : span_alpha) {
+                auto r = rng() % 4;
+                a = r == 0 ? 0 : r == 1 ? 255 : rng() & 0xff;
+            }
+
+            std::vector<unsigned char> expected(row);
+            kernels[0].blend(gamma, &expected[start], span_alpha.data(), n, fg);
+
+            for (const auto &kernel : kernels) {
+                std::vector<unsigned char> actual(row);
+                kernel.blend(gamma, &actual[start], span_alpha.data(), n, fg);
+                check("spans", kernel.name, g, expected, actual);
+            }
+        }
+    }
+
+    if (failures != 0) {
+        std::printf("%d failures\n", failures);
+        return 1;
+    }
+
+    std::printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,110 @@
+// Time gli_draw_string_uni() and gli_string_width_uni() on a paragraph
+// of text in several faces, using the bundled fonts. This links against
+// draw.cpp alone, so the configuration and the few frontend functions
+// the font loader needs are defined here.
+//
+// Usage: drawbench [iterations]
+//
+// Set LCD in the environment to time subpixel rendering.
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "optional.hpp"
+
+#include "glk.h"
+#include "garglk.h"
+
+int gli_baseline = 15;
+int gli_leading = 20;
+Color gli_caret_color(0, 0, 0);
+int gli_caret_shape = 2;
+double gli_conf_gamma = 1.8;
+bool gli_conf_lcd = std::getenv("LCD") != nullptr;
+std::array<unsigned char, 5> gli_conf_lcd_weights = {28, 56, 85, 56, 28};
+FontFiles gli_conf_prop, gli_conf_mono;
+std::string gli_conf_monofont = DEFAULT_MONO_FONT;
+std::string gli_conf_propfont = DEFAULT_PROP_FONT;
+double gli_conf_monosize = 12.6;
+double gli_conf_propsize = 14.7;
+double gli_conf_monoaspect = 1.0;
+double gli_conf_propaspect = 1.0;
+
+void fontload()
+{
+}
+
+void fontunload()
+{
+}
+
+std::string garglk::windatadir()
+{
+    return DRAWBENCH_FONT_DIR;
+}
+
+nonstd::optional<std::string> garglk::winfontpath(const std::string &filename)
+{
+    return std::string(DRAWBENCH_FONT_DIR) + "/" + filename;
+}
+
+bool garglk::fontreplace(const std::string &, FontType)
+{
+    return false;
+}
+
+void garglk::winabort(const std::string &msg)
+{
+    std::fprintf(stderr, "drawbench: %s\n", msg.c_str());
+    std::exit(1);
+}
+
+void garglk::winwarning(const std::string &, const std::string &msg)
+{
+    std::fprintf(stderr, "drawbench: %s\n", msg.c_str());
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 2000;
+
+    gli_initialize_fonts();
+    gli_image_rgb.resize(1600, 200, false);
+    gli_image_rgb.fill(Color(255, 255, 255));
+
+    // A mix of ligatures, kerning pairs, and non-ASCII punctuation.
+    const std::vector<glui32> text = {
+        'T', 'h', 'e', ' ', 'q', 'u', 'i', 'c', 'k', ' ', 'b', 'r', 'o', 'w', 'n', ' ',
+        'f', 'o', 'x', ' ', 'j', 'u', 'm', 'p', 's', ' ', 'o', 'v', 'e', 'r', ' ',
+        't', 'h', 'e', ' ', 'l', 'a', 'z', 'y', ' ', 'd', 'o', 'g', '.', ' ',
+        0x201c, 'O', 'f', 'f', 'i', 'c', 'e', ' ', 'a', 'f', 'f', 'l', 'u', 'e', 'n', 't', 0x201d, ' ',
+        0x2014, ' ', 'w', 'a', 'f', 'f', 'l', 'e', 's', ',', ' ', 'f', 'j', 'o', 'r', 'd', 's', ' ',
+        '&', ' ', '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', ';', ' ',
+        'A', 'V', ' ', 'W', 'a', ' ', 'T', 'o', '.',
+    };
+    const int len = static_cast<int>(text.size());
+    const std::array<FontFace, 4> faces = {FontFace::propr(), FontFace::propi(), FontFace::monor(), FontFace::monob()};
+
+    long checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        for (std::size_t f = 0; f < faces.size(); f++) {
+            int y = 40 * static_cast<int>(f + 1);
+            checksum += gli_draw_string_uni(16 * GLI_SUBPIX, y, faces[f], Color(0, 0, 0), text.data(), len, -1);
+            checksum += gli_string_width_uni(faces[f], text.data(), len, -1);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double us = std::chrono::duration<double, std::micro>(end - start).count();
+    std::printf("%d strings of %d characters (%s): %.3f us per string (checksum %ld)\n",
+            iterations * static_cast<int>(faces.size()), len,
+            gli_conf_lcd ? "lcd" : "grayscale",
+            us / (iterations * faces.size()), checksum);
+
+    return 0;
+}
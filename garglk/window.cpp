@@ -19,7 +19,9 @@
 
 #include <algorithm>
 #include <new>
+#include <string>
 
+#include "format.h"
 #include "optional.hpp"
 
 #include "glk.h"
@@ -71,6 +73,47 @@ nonstd::optional<std::vector<char>> gli_get_scrollback() {
     return text;
 }
 
+// Frontends call this each time they copy (part of) the framebuffer to
+// the screen.
+static unsigned long blit_frames = 0;
+static unsigned long long blit_bytes = 0;
+static std::size_t blit_last = 0;
+
+void gli_record_blit(std::size_t bytes)
+{
+    blit_frames++;
+    blit_bytes += bytes;
+    blit_last = bytes;
+}
+
+// Return a human-readable summary of memory used by text buffer
+// windows, and of how much is copied to the screen per frame.
+std::string gli_get_stats()
+{
+    std::string stats;
+    std::size_t total = 0;
+
+    for (auto *win = glk_window_iterate(nullptr, nullptr); win != nullptr; win = glk_window_iterate(win, nullptr)) {
+        if (win->type == wintype_TextBuffer) {
+            auto *dwin = win->winbuffer();
+            auto memory = gli_textbuffer_memory(dwin);
+            stats += Format("Text buffer (rock {}): {} of {} lines, {:.1f} KiB\n",
+                    win->rock, dwin->scrollmax + 1, dwin->scrollback, memory / 1024.0);
+            total += memory;
+        }
+    }
+
+    stats += Format("Total: {:.1f} KiB\n", total / 1024.0);
+
+    if (blit_frames != 0) {
+        stats += Format("\nFrames: {}, last {:.1f} KiB, average {:.1f} KiB (full frame {:.1f} KiB)\n",
+                blit_frames, blit_last / 1024.0, blit_bytes / 1024.0 / blit_frames,
+                gli_image_rgb.size() / 1024.0);
+    }
+
+    return stats;
+}
+
 static void gli_windows_rearrange()
 {
     if (gli_rootwin != nullptr) {
@@ -152,6 +152,15 @@ void gli_move_selection(int x, int y)
     tx = x < gli_mask.hor ? x : gli_mask.hor;
     ty = y < gli_mask.ver ? y : gli_mask.ver;
 
+    // Windows only report rows to winrepaint() when they are touched or
+    // when they leave the selection, so rows joining it must be
+    // repainted here. They all lie between the anchor and the old or
+    // new end of the selection.
+    int oldy = gli_mask.select.y1 != 0 ? gli_mask.select.y1 : gli_mask.select.y0;
+    int top = std::min({gli_mask.select.y0, oldy, ty});
+    int bottom = std::max({gli_mask.select.y0, oldy, ty});
+    winrepaint(0, top - gli_leading, gli_mask.hor, bottom + gli_leading);
+
     gli_mask.select.x1 = last_x = tx;
     gli_mask.select.y1 = last_y = ty;
 
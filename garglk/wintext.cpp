@@ -37,6 +37,8 @@ static void
 put_text_uni(window_textbuffer_t *dwin, glui32 *buf, int len, int pos, int oldlen);
 static bool
 put_picture(window_textbuffer_t *dwin, const std::shared_ptr<picture_t> &pic, glui32 align, glui32 linkval);
+static void
+put_char(window_t *win, window_textbuffer_t *dwin, glui32 ch);
 
 static void touch(window_textbuffer_t *dwin, int line)
 {
@@ -58,16 +60,105 @@ static void touchscroll(window_textbuffer_t *dwin)
     }
 }
 
+static unsigned long tbline_next_id = 0;
+
+void tbline_t::store(const glui32 *chars_, const attr_t *attrs_, int len_)
+{
+    id = ++tbline_next_id;
+    len = len_;
+
+    // Copy into fresh vectors so the capacity exactly matches the
+    // length of the line.
+    std::vector<glui32>(chars_, chars_ + len).swap(chars);
+
+    std::vector<attrrun_t> runs;
+    for (int i = 0; i < len; i++) {
+        if (i == 0 || attrs_[i] != runs.back().attr) {
+            runs.push_back({i, attrs_[i]});
+        }
+    }
+    runs.shrink_to_fit();
+    attrs.swap(runs);
+}
+
+// Expand the stored text into flat arrays, which must be able to hold
+// at least TBLINELEN entries. As with the current line, an empty line
+// has a default attribute at index 0.
+void tbline_t::expand(glui32 *chars_, attr_t *attrs_) const
+{
+    std::copy(chars.begin(), chars.end(), chars_);
+
+    if (attrs.empty()) {
+        attrs_[0] = attr_t{};
+    }
+
+    for (std::size_t run = 0; run < attrs.size(); run++) {
+        int end = run + 1 < attrs.size() ? attrs[run + 1].start : len;
+        std::fill(attrs_ + attrs[run].start, attrs_ + end, attrs[run].attr);
+    }
+}
+
+void tbline_t::discard()
+{
+    id = 0;
+    len = 0;
+    std::vector<glui32>().swap(chars);
+    std::vector<attrrun_t>().swap(attrs);
+}
+
+std::size_t tbline_t::memory() const
+{
+    return chars.capacity() * sizeof(glui32) + attrs.capacity() * sizeof(attrrun_t);
+}
+
+// Fetch the text of a line as flat arrays able to hold TBLINELEN
+// entries. Line 0 lives in the window's line buffer; all others are
+// stored compactly and need to be expanded.
+static void line_text(const window_textbuffer_t *dwin, int line, glui32 *chars, attr_t *attrs)
+{
+    if (line == 0) {
+        int n = std::max(dwin->numchars, 1);
+        std::copy(dwin->chars, dwin->chars + n, chars);
+        std::copy(dwin->attrs, dwin->attrs + n, attrs);
+    } else {
+        dwin->lines[line].expand(chars, attrs);
+    }
+}
+
+std::size_t gli_textbuffer_memory(const window_textbuffer_t *dwin)
+{
+    std::size_t history = 0;
+    for (const auto &entry : dwin->history) {
+        history += entry.capacity() * sizeof(glui32);
+    }
+
+    return sizeof(*dwin) + dwin->lines.memory() + history +
+        dwin->copybuf.capacity() * sizeof(glui32) +
+        dwin->reflowchars.capacity() * sizeof(glui32) +
+        dwin->reflowattrs.capacity() * sizeof(attr_t);
+}
+
 std::vector<char> gli_get_text(window_textbuffer_t *dwin)
 {
-    int s = dwin->scrollmax < SCROLLBACK ? dwin->scrollmax : SCROLLBACK - 1;
+    int s = std::min(dwin->scrollmax, dwin->scrollback - 1);
 
     std::vector<char> text;
+
+    // Text which hasn't been rewrapped since the last reflow is older
+    // than anything in the scrollback.
+    for (int charidx = 0; charidx < dwin->reflowlen; charidx++) {
+        std::array<char, 4> buf;
+        auto n = gli_encode_utf8(dwin->reflowchars[charidx], buf.data(), 4);
+        text.insert(text.end(), buf.begin(), buf.begin() + n);
+    }
+
     for (int lineidx = s; lineidx >= 0; lineidx--) {
-        auto line = dwin->lines[lineidx];
-        for (int charidx = 0; charidx < line.len; charidx++) {
+        const auto &line = dwin->lines[lineidx];
+        const glui32 *chars = lineidx == 0 ? dwin->chars : line.chars.data();
+        int len = lineidx == 0 ? dwin->numchars : line.len;
+        for (int charidx = 0; charidx < len; charidx++) {
             std::array<char, 4> buf;
-            auto n = gli_encode_utf8(line.chars[charidx], buf.data(), 4);
+            auto n = gli_encode_utf8(chars[charidx], buf.data(), 4);
             for (int i = 0; i < n; i++) {
                 text.push_back(buf[i]);
             }
@@ -81,6 +172,83 @@ std::vector<char> gli_get_text(window_textbuffer_t *dwin)
     return text;
 }
 
+// Find where to split logical text for reflowing: the start of the
+// paragraph such that the text from there to “end” contains at least
+// “paragraphs” paragraph breaks (or the start of the text if there
+// aren't that many).
+static int reflow_split(const std::vector<glui32> &chars, int end, int paragraphs)
+{
+    int found = 0;
+
+    for (int i = end; i > 0; i--) {
+        if (chars[i - 1] == '\n') {
+            if (found == paragraphs) {
+                return i;
+            }
+            found++;
+        }
+    }
+
+    return 0;
+}
+
+// Rewrap older text left over from the last reflow, a chunk of
+// paragraphs at a time, until at least “wanted” lines of scrollback are
+// available (or there's nothing left to rewrap). Each chunk is wrapped
+// in a scratch buffer and its lines are then added to the top of the
+// scrollback. The window is only repainted if something was rewrapped.
+static void reflow_history(window_t *win, int wanted)
+{
+    window_textbuffer_t *dwin = win->winbuffer();
+    attr_t oldattr = win->attr;
+    int rewrapped = 0;
+
+    while (dwin->reflowlen > 0 && dwin->scrollmax < wanted) {
+        int end = dwin->reflowlen;
+        int start = reflow_split(dwin->reflowchars, end, dwin->height * 2);
+
+        window_textbuffer_t scratch(win);
+        scratch.width = dwin->width;
+        scratch.height = dwin->height;
+        scratch.styles = dwin->styles;
+
+        for (int i = start; i < end; i++) {
+            win->attr = dwin->reflowattrs[i];
+            put_char(win, &scratch, dwin->reflowchars[i]);
+        }
+
+        // The chunk ends with a paragraph break, so scratch line 0 is
+        // empty, and lines 1 through scrollmax hold the wrapped text.
+        int n = std::min(scratch.scrollmax, gli_conf_scrollback - 1 - dwin->scrollmax);
+        if (dwin->scrollmax + n + 1 > dwin->scrollback) {
+            dwin->scrollback = std::min(dwin->scrollmax + n + 1 + SCROLLBACK, gli_conf_scrollback);
+            dwin->lines.resize(dwin->scrollback);
+        }
+
+        for (int i = 1; i <= n; i++) {
+            std::swap(dwin->lines[dwin->scrollmax + i], scratch.lines[i]);
+        }
+
+        dwin->scrollmax += n;
+        rewrapped += n;
+
+        // If the scrollback is full, anything older is dropped.
+        dwin->reflowlen = n < scratch.scrollmax ? 0 : start;
+    }
+
+    win->attr = oldattr;
+
+    if (rewrapped > 0) {
+        touchscroll(dwin);
+    }
+}
+
+// Rewrap the window's text after its width has changed. Only the most
+// recent text (enough to fill the window a couple of times over) is
+// rewrapped immediately; older text is kept as logical paragraphs in
+// dwin->reflowchars and rewrapped by reflow_history() when the user
+// scrolls back into it. Margin images can affect the wrapping of the
+// text around them, so if there are any, everything is rewrapped.
 static void reflow(window_t *win)
 {
     window_textbuffer_t *dwin = win->winbuffer();
@@ -88,6 +256,7 @@ static void reflow(window_t *win)
     attr_t curattr;
     attr_t oldattr;
     int i, k, p, s;
+    int start;
     int x;
 
     if (dwin->height < 4 || dwin->width < 20) {
@@ -96,69 +265,74 @@ static void reflow(window_t *win)
 
     dwin->lines[0].len = dwin->numchars;
 
-    std::vector<attr_t> attrbuf;
-    std::vector<glui32> charbuf;
+    std::vector<attr_t> &attrbuf = dwin->reflowattrs;
+    std::vector<glui32> &charbuf = dwin->reflowchars;
     std::vector<int> alignbuf;
     std::vector<std::shared_ptr<picture_t>> pictbuf;
     std::vector<glui32> hyperbuf;
     std::vector<int> offsetbuf;
+    std::array<glui32, TBLINELEN> lnchars;
+    std::array<attr_t, TBLINELEN> lnattrs;
 
-    // allocate temp buffers
-    try {
-        attrbuf.resize(SCROLLBACK * TBLINELEN);
-        charbuf.resize(SCROLLBACK * TBLINELEN);
-        alignbuf.resize(SCROLLBACK);
-        pictbuf.resize(SCROLLBACK);
-        hyperbuf.resize(SCROLLBACK);
-        offsetbuf.resize(SCROLLBACK);
-    } catch (const std::bad_alloc &) {
-        return;
-    }
-
-    // copy text to temp buffers
+    // copy text to temp buffers, after any text that's still waiting
+    // to be rewrapped from a previous reflow
 
     oldattr = win->attr;
     curattr.clear();
 
-    x = 0;
-    p = 0;
-    s = dwin->scrollmax < SCROLLBACK ? dwin->scrollmax : SCROLLBACK - 1;
+    charbuf.resize(dwin->reflowlen);
+    attrbuf.resize(dwin->reflowlen);
 
-    for (k = s; k >= 0; k--) {
-        if (k == 0 && win->line_request) {
-            inputbyte = p + dwin->infence;
-        }
+    s = std::min(dwin->scrollmax, dwin->scrollback - 1);
 
-        if (dwin->lines[k].lpic) {
-            offsetbuf[x] = p;
-            alignbuf[x] = imagealign_MarginLeft;
-            pictbuf[x] = dwin->lines[k].lpic;
-            hyperbuf[x] = dwin->lines[k].lhyper;
-            x++;
-        }
+    try {
+        for (k = s; k >= 0; k--) {
+            const tbline_t &ln = dwin->lines[k];
 
-        if (dwin->lines[k].rpic) {
-            offsetbuf[x] = p;
-            alignbuf[x] = imagealign_MarginRight;
-            pictbuf[x] = dwin->lines[k].rpic;
-            hyperbuf[x] = dwin->lines[k].rhyper;
-            x++;
-        }
+            if (k == 0 && win->line_request) {
+                inputbyte = charbuf.size() + dwin->infence;
+            }
 
-        for (i = 0; i < dwin->lines[k].len; i++) {
-            attrbuf[p] = curattr = dwin->lines[k].attrs[i];
-            charbuf[p] = dwin->lines[k].chars[i];
-            p++;
-        }
+            if (ln.lpic) {
+                offsetbuf.push_back(charbuf.size());
+                alignbuf.push_back(imagealign_MarginLeft);
+                pictbuf.push_back(ln.lpic);
+                hyperbuf.push_back(ln.lhyper);
+            }
+
+            if (ln.rpic) {
+                offsetbuf.push_back(charbuf.size());
+                alignbuf.push_back(imagealign_MarginRight);
+                pictbuf.push_back(ln.rpic);
+                hyperbuf.push_back(ln.rhyper);
+            }
+
+            line_text(dwin, k, lnchars.data(), lnattrs.data());
+            for (i = 0; i < ln.len; i++) {
+                attrbuf.push_back(curattr = lnattrs[i]);
+                charbuf.push_back(lnchars[i]);
+            }
 
-        if (dwin->lines[k].newline) {
-            attrbuf[p] = curattr;
-            charbuf[p] = '\n';
-            p++;
+            if (ln.newline) {
+                attrbuf.push_back(curattr);
+                charbuf.push_back('\n');
+            }
         }
+
+        offsetbuf.push_back(-1);
+    } catch (const std::bad_alloc &) {
+        charbuf.resize(dwin->reflowlen);
+        attrbuf.resize(dwin->reflowlen);
+        return;
     }
 
-    offsetbuf[x] = -1;
+    p = charbuf.size();
+
+    if (offsetbuf.size() > 1) {
+        start = 0;
+    } else {
+        start = reflow_split(charbuf, p, std::max(dwin->height, 1) * 2);
+    }
 
     // clear window
 
@@ -167,7 +341,7 @@ static void reflow(window_t *win)
     // and dump text back
 
     x = 0;
-    for (i = 0; i < p; i++) {
+    for (i = start; i < p; i++) {
         if (i == inputbyte) {
             break;
         }
@@ -178,7 +352,7 @@ static void reflow(window_t *win)
             x++;
         }
 
-        win_textbuffer_putchar_uni(win, charbuf[i]);
+        put_char(win, dwin, charbuf[i]);
     }
 
     // terribly sorry about this...
@@ -193,6 +367,14 @@ static void reflow(window_t *win)
 
     win->attr = oldattr;
 
+    // Keep the older text for reflow_history(), and the buffers'
+    // capacity for the next reflow.
+    dwin->reflowlen = start;
+    charbuf.resize(start);
+    attrbuf.resize(start);
+
+    reflow_history(win, dwin->height * 2);
+
     touchscroll(dwin);
 }
 
@@ -225,6 +407,8 @@ void win_textbuffer_rearrange(window_t *win, rect_t *box)
 
         dwin->height = newhgt;
 
+        reflow_history(win, dwin->scrollpos + dwin->height * 2);
+
         // keep window within 'valid' lines
         if (dwin->scrollpos > dwin->scrollmax - dwin->height + 1) {
             dwin->scrollpos = dwin->scrollmax - dwin->height + 1;
@@ -267,10 +451,102 @@ static int calcwidth(window_textbuffer_t *dwin,
     return calcwidth(dwin, chars.data(), attrs.data(), startchar, numchars, spw);
 }
 
+// Return the oldest line whose margin image could reach into the window.
+// Lines newer than the bottom row are below the window, and an image
+// can only reach down from a line above the top row by the height of the
+// tallest image ever placed, so only this range has to be searched.
+static int last_picture_line(const window_textbuffer_t *dwin)
+{
+    int reach = (dwin->maxpich + gli_leading - 1) / gli_leading;
+
+    return std::min(dwin->scrollback - 1, dwin->scrollpos + dwin->height - 1 + reach);
+}
+
+// Return true if any margin images are drawn in the window. These can
+// extend over multiple rows, so rows containing them can't be moved.
+static bool pictures_visible(const window_textbuffer_t *dwin, int y0, int y1)
+{
+    int last = last_picture_line(dwin);
+
+    for (int i = dwin->scrollpos; i <= last; i++) {
+        const tbline_t &ln = dwin->lines[i];
+        int y = y0 + (dwin->height - (i - dwin->scrollpos) - 1) * gli_leading;
+
+        if ((ln.lpic && y < y1 && y + ln.lpic->h > y0) ||
+            (ln.rpic && y < y1 && y + ln.rpic->h > y0)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// After scrolling, move rows which are still visible to where they now
+// belong, so they don't have to be redrawn. Rows are drawn from the
+// id of the line that belongs in the row, so the first row whose line
+// is still on screen gives the distance to move everything.
+static void move_rows(window_textbuffer_t *dwin, int px0, int px1, int y0)
+{
+    int height = dwin->height;
+    int delta = 0;
+
+    for (int row = 0; row < height && delta == 0; row++) {
+        int i = dwin->scrollpos + height - 1 - row;
+        unsigned long id = dwin->lines[i].id;
+
+        if (id == 0) {
+            continue;
+        }
+
+        for (int src = 0; src < height; src++) {
+            if (dwin->rows[src].id == id) {
+                delta = src - row;
+                break;
+            }
+        }
+    }
+
+    if (delta == 0) {
+        return;
+    }
+
+    px0 = garglk::clamp(px0, 0, gli_image_rgb.width());
+    px1 = garglk::clamp(px1, px0, gli_image_rgb.width());
+
+    auto move_row = [&](int row) {
+        for (int k = 0; k < gli_leading; k++) {
+            int dst = y0 + row * gli_leading + k;
+            int src = dst + delta * gli_leading;
+            if (dst >= 0 && dst < gli_image_rgb.height() && src >= 0 && src < gli_image_rgb.height()) {
+                std::memmove(gli_image_rgb.data() + dst * gli_image_rgb.stride() + px0 * 3,
+                             gli_image_rgb.data() + src * gli_image_rgb.stride() + px0 * 3,
+                             (px1 - px0) * 3);
+            }
+        }
+    };
+
+    std::vector<tbrow_t> rows(height);
+
+    for (int n = 0; n < height; n++) {
+        // When moving up, go top down so nothing is overwritten before
+        // it's moved, and vice versa.
+        int row = delta > 0 ? n : height - 1 - n;
+        int src = row + delta;
+
+        if (src >= 0 && src < height) {
+            move_row(row);
+            rows[row] = std::move(dwin->rows[src]);
+        }
+    }
+
+    dwin->rows.swap(rows);
+}
+
 void win_textbuffer_redraw(window_t *win)
 {
     window_textbuffer_t *dwin = win->winbuffer();
-    tbline_t ln;
+    std::array<glui32, TBLINELEN> lnchars;
+    std::array<attr_t, TBLINELEN> lnattrs;
     int linelen;
     int nsp, spw, pw;
     int x0, y0, x1, y1;
@@ -298,7 +574,24 @@ void win_textbuffer_redraw(window_t *win)
     // check if any part of buffer is selected
     selbuf = gli_check_selection(x0 / GLI_SUBPIX, y0, x1 / GLI_SUBPIX, y1);
 
+    // Rows can be reused only if nothing drawn on top of the text might
+    // have moved with it.
+    bool reuse = !gli_force_redraw && !selbuf && !dwin->rowspics &&
+        static_cast<int>(dwin->rows.size()) == dwin->height &&
+        dwin->rowsbox.x0 == win->bbox.x0 && dwin->rowsbox.y0 == win->bbox.y0 &&
+        dwin->rowsbox.x1 == win->bbox.x1 && dwin->rowsbox.y1 == win->bbox.y1 &&
+        !pictures_visible(dwin, y0, y1);
+
+    if (reuse) {
+        move_rows(dwin, x0 / GLI_SUBPIX, x1 / GLI_SUBPIX, y0);
+    } else {
+        dwin->rows.assign(std::max(dwin->height, 0), tbrow_t{});
+        dwin->rowsbox = win->bbox;
+    }
+
     for (i = dwin->scrollpos + dwin->height - 1; i >= dwin->scrollpos; i--) {
+        int row = dwin->height - (i - dwin->scrollpos) - 1;
+
         // top of line
         y = y0 + (dwin->height - (i - dwin->scrollpos) - 1) * gli_leading;
 
@@ -321,13 +614,15 @@ void win_textbuffer_redraw(window_t *win)
             dwin->lines[i].dirty = true;
         }
 
-        ln = dwin->lines[i];
+        const tbline_t &ln = dwin->lines[i];
 
         // skip if we can
         if (!ln.dirty && !ln.repaint && !gli_force_redraw && dwin->scrollpos == 0) {
             continue;
         }
 
+        bool reusable = reuse && !ln.repaint && ln.id != 0 && dwin->rows[row].id == ln.id;
+
         // repaint previously selected lines if needed
         if (ln.repaint && !gli_force_redraw) {
             gli_redraw_rect(x0 / GLI_SUBPIX, y, x1 / GLI_SUBPIX, y + gli_leading);
@@ -343,32 +638,48 @@ void win_textbuffer_redraw(window_t *win)
 
         // leave bottom line blank for [more] prompt
         if (i == dwin->scrollpos && i > 0) {
+            dwin->rows[row].id = 0;
+            continue;
+        }
+
+        // the line was moved here by move_rows(), so only its
+        // hyperlinks need to be restored
+        if (reusable) {
+            gli_put_hyperlink(0, x0 / GLI_SUBPIX, y,
+                    x1 / GLI_SUBPIX, y + gli_leading);
+            for (const auto &link : dwin->rows[row].links) {
+                gli_put_hyperlink(link.link, link.x0, y, link.x1, y + gli_leading);
+            }
             continue;
         }
 
+        dwin->rows[row].id = selrow ? 0 : ln.id;
+        dwin->rows[row].links.clear();
+
+        line_text(dwin, i, lnchars.data(), lnattrs.data());
         linelen = ln.len;
 
         // kill spaces at the end unless they're a different color
         Color color = gli_override_bg.has_value() ? gli_window_color : win->bgcolor;
-        while (i > 0 && linelen > 1 && ln.chars[linelen - 1] == ' '
-                && ln.attrs[linelen - 1].bgcolor == color
-                && !ln.attrs[linelen - 1].reverse) {
+        while (i > 0 && linelen > 1 && lnchars[linelen - 1] == ' '
+                && lnattrs[linelen - 1].bgcolor == color
+                && !lnattrs[linelen - 1].reverse) {
             linelen--;
         }
 
         // kill characters that would overwrite the scroll bar
-        while (linelen > 1 && calcwidth(dwin, ln.chars, ln.attrs, 0, linelen, -1) >= pw) {
+        while (linelen > 1 && calcwidth(dwin, lnchars, lnattrs, 0, linelen, -1) >= pw) {
             linelen--;
         }
 
         // count spaces and width for justification
         if (gli_conf_justify && !ln.newline && i > 0) {
             for (a = 0, nsp = 0; a < linelen; a++) {
-                if (ln.chars[a] == ' ') {
+                if (lnchars[a] == ' ') {
                     nsp++;
                 }
             }
-            w = calcwidth(dwin, ln.chars, ln.attrs, 0, linelen, 0);
+            w = calcwidth(dwin, lnchars, lnattrs, 0, linelen, 0);
             if (nsp != 0) {
                 spw = (x1 - x0 - ln.lm - ln.rm - 2 * SLOP - w) / nsp;
             } else {
@@ -386,20 +697,20 @@ void win_textbuffer_redraw(window_t *win)
             // optimized case for all chars selected
             if (selleft && selright) {
                 rsc = linelen > 0 ? linelen - 1 : 0;
-                selchar = ((calcwidth(dwin, ln.chars, ln.attrs, lsc, rsc, spw) / GLI_SUBPIX) != 0);
+                selchar = ((calcwidth(dwin, lnchars, lnattrs, lsc, rsc, spw) / GLI_SUBPIX) != 0);
             } else {
                 // optimized case for leftmost char selected
                 if (selleft) {
                     tsc = linelen > 0 ? linelen - 1 : 0;
-                    selchar = ((calcwidth(dwin, ln.chars, ln.attrs, lsc, tsc, spw) / GLI_SUBPIX) != 0);
+                    selchar = ((calcwidth(dwin, lnchars, lnattrs, lsc, tsc, spw) / GLI_SUBPIX) != 0);
                 } else {
                     // find the substring contained by the selection
                     tx = (x0 + SLOP + ln.lm) / GLI_SUBPIX;
                     // measure string widths until we find left char
                     for (tsc = 0; tsc < linelen; tsc++) {
-                        tsw = calcwidth(dwin, ln.chars, ln.attrs, 0, tsc, spw) / GLI_SUBPIX;
+                        tsw = calcwidth(dwin, lnchars, lnattrs, 0, tsc, spw) / GLI_SUBPIX;
                         if (tsw + tx >= sx0 ||
-                                (tsw + tx + GLI_SUBPIX >= sx0 && ln.chars[tsc] != ' ')) {
+                                (tsw + tx + GLI_SUBPIX >= sx0 && lnchars[tsc] != ' ')) {
                             lsc = tsc;
                             selchar = true;
                             break;
@@ -413,7 +724,7 @@ void win_textbuffer_redraw(window_t *win)
                     } else {
                         // measure string widths until we find right char
                         for (tsc = lsc; tsc < linelen; tsc++) {
-                            tsw = calcwidth(dwin, ln.chars, ln.attrs, lsc, tsc, spw) / GLI_SUBPIX;
+                            tsw = calcwidth(dwin, lnchars, lnattrs, lsc, tsc, spw) / GLI_SUBPIX;
                             if (tsw + sx0 < sx1) {
                                 rsc = tsc;
                             }
@@ -427,8 +738,8 @@ void win_textbuffer_redraw(window_t *win)
             // reverse colors for selected chars
             if (selchar) {
                 for (tsc = lsc; tsc <= rsc; tsc++) {
-                    ln.attrs[tsc].reverse = !ln.attrs[tsc].reverse;
-                    dwin->copybuf.push_back(ln.chars[tsc]);
+                    lnattrs[tsc].reverse = !lnattrs[tsc].reverse;
+                    dwin->copybuf.push_back(lnchars[tsc]);
                 }
             }
             // add newline only if this is a real paragraph break, not just a wrapped line
@@ -450,11 +761,11 @@ void win_textbuffer_redraw(window_t *win)
         x = x0 + SLOP + ln.lm;
         a = 0;
         for (b = 0; b < linelen; b++) {
-            if (ln.attrs[a] != ln.attrs[b]) {
-                link = ln.attrs[a].hyper;
-                auto font = ln.attrs[a].font(dwin->styles);
-                color = ln.attrs[a].bg(dwin->styles);
-                w = gli_string_width_uni(font, &ln.chars[a], b - a, spw);
+            if (lnattrs[a] != lnattrs[b]) {
+                link = lnattrs[a].hyper;
+                auto font = lnattrs[a].font(dwin->styles);
+                color = lnattrs[a].bg(dwin->styles);
+                w = gli_string_width_uni(font, &lnchars[a], b - a, spw);
                 gli_draw_rect(x / GLI_SUBPIX, y,
                         w / GLI_SUBPIX, gli_leading,
                         color);
@@ -467,15 +778,16 @@ void win_textbuffer_redraw(window_t *win)
                     gli_put_hyperlink(link, x / GLI_SUBPIX, y,
                             x / GLI_SUBPIX + w / GLI_SUBPIX,
                             y + gli_leading);
+                    dwin->rows[row].links.push_back({link, x / GLI_SUBPIX, x / GLI_SUBPIX + w / GLI_SUBPIX});
                 }
                 x += w;
                 a = b;
             }
         }
-        link = ln.attrs[a].hyper;
-        auto font = ln.attrs[a].font(dwin->styles);
-        color = ln.attrs[a].bg(dwin->styles);
-        w = gli_string_width_uni(font, &ln.chars[a], b - a, spw);
+        link = lnattrs[a].hyper;
+        auto font = lnattrs[a].font(dwin->styles);
+        color = lnattrs[a].bg(dwin->styles);
+        w = gli_string_width_uni(font, &lnchars[a], b - a, spw);
         gli_draw_rect(x / GLI_SUBPIX, y, w / GLI_SUBPIX,
                 gli_leading, color);
         if (link != 0) {
@@ -487,6 +799,7 @@ void win_textbuffer_redraw(window_t *win)
             gli_put_hyperlink(link, x / GLI_SUBPIX, y,
                     x / GLI_SUBPIX + w / GLI_SUBPIX,
                     y + gli_leading);
+            dwin->rows[row].links.push_back({link, x / GLI_SUBPIX, x / GLI_SUBPIX + w / GLI_SUBPIX});
         }
         x += w;
 
@@ -513,20 +826,20 @@ void win_textbuffer_redraw(window_t *win)
         x = x0 + SLOP + ln.lm;
         a = 0;
         for (b = 0; b < linelen; b++) {
-            if (ln.attrs[a] != ln.attrs[b]) {
-                link = ln.attrs[a].hyper;
-                font = ln.attrs[a].font(dwin->styles);
-                color = link != 0 ? gli_link_color : ln.attrs[a].fg(dwin->styles);
+            if (lnattrs[a] != lnattrs[b]) {
+                link = lnattrs[a].hyper;
+                font = lnattrs[a].font(dwin->styles);
+                color = link != 0 ? gli_link_color : lnattrs[a].fg(dwin->styles);
                 x = gli_draw_string_uni(x, y + gli_baseline,
-                        font, color, &ln.chars[a], b - a, spw);
+                        font, color, &lnchars[a], b - a, spw);
                 a = b;
             }
         }
-        link = ln.attrs[a].hyper;
-        font = ln.attrs[a].font(dwin->styles);
-        color = link != 0 ? gli_link_color : ln.attrs[a].fg(dwin->styles);
+        link = lnattrs[a].hyper;
+        font = lnattrs[a].font(dwin->styles);
+        color = link != 0 ? gli_link_color : lnattrs[a].fg(dwin->styles);
         gli_draw_string_uni(x, y + gli_baseline,
-                font, color, &ln.chars[a], linelen - a, spw);
+                font, color, &lnchars[a], linelen - a, spw);
     }
 
     //
@@ -572,13 +885,18 @@ void win_textbuffer_redraw(window_t *win)
     // draw the images
     //
 
-    for (i = 0; i < dwin->scrollback; i++) {
-        ln = dwin->lines[i];
+    dwin->rowspics = false;
+
+    int lastpic = last_picture_line(dwin);
+
+    for (i = dwin->scrollpos; i <= lastpic; i++) {
+        const tbline_t &ln = dwin->lines[i];
 
         y = y0 + (dwin->height - (i - dwin->scrollpos) - 1) * gli_leading;
 
         if (ln.lpic) {
             if (y < y1 && y + ln.lpic->h > y0) {
+                dwin->rowspics = true;
                 gli_draw_picture(ln.lpic.get(),
                         x0 / GLI_SUBPIX, y,
                         x0 / GLI_SUBPIX, y0, x1 / GLI_SUBPIX, y1);
@@ -595,6 +913,7 @@ void win_textbuffer_redraw(window_t *win)
 
         if (ln.rpic) {
             if (y < y1 && y + ln.rpic->h > y0) {
+                dwin->rowspics = true;
                 gli_draw_picture(ln.rpic.get(),
                         x1 / GLI_SUBPIX - ln.rpic->w, y,
                         x0 / GLI_SUBPIX, y0, x1 / GLI_SUBPIX, y1);
@@ -665,31 +984,22 @@ void win_textbuffer_redraw(window_t *win)
     }
 }
 
+// Grow the scrollback, SCROLLBACK lines at a time, until the configured
+// limit is reached. After that, the oldest line is dropped each time a
+// new line is added.
 static void scrollresize(window_textbuffer_t *dwin)
 {
-    int i;
-
-    dwin->lines.resize(dwin->scrollback + SCROLLBACK);
-
-    dwin->chars = dwin->lines[0].chars.data();
-    dwin->attrs = dwin->lines[0].attrs.data();
+    int grow = std::min(SCROLLBACK, gli_conf_scrollback - dwin->scrollback);
 
-    for (i = dwin->scrollback; i < (dwin->scrollback + SCROLLBACK); i++) {
-        dwin->lines[i].dirty = false;
-        dwin->lines[i].repaint = false;
-        dwin->lines[i].lm = 0;
-        dwin->lines[i].rm = 0;
-        dwin->lines[i].lpic.reset();
-        dwin->lines[i].rpic.reset();
-        dwin->lines[i].lhyper = 0;
-        dwin->lines[i].rhyper = 0;
-        dwin->lines[i].len = 0;
-        dwin->lines[i].newline = false;
-        dwin->lines[i].chars.fill(' ');
-        dwin->lines[i].attrs.fill(attr_t{});
+    if (grow <= 0) {
+        dwin->scrollmax = std::min(dwin->scrollmax, dwin->scrollback - 1);
+        dwin->lastseen = std::min(dwin->lastseen, dwin->scrollback - 1);
+        dwin->reflowlen = 0;
+        return;
     }
 
-    dwin->scrollback += SCROLLBACK;
+    dwin->lines.resize(dwin->scrollback + grow);
+    dwin->scrollback += grow;
 }
 
 static void scrolloneline(window_textbuffer_t *dwin, bool forced)
@@ -720,14 +1030,12 @@ static void scrolloneline(window_textbuffer_t *dwin, bool forced)
     }
     dwin->spaced = 0;
 
-    dwin->lines[0].len = dwin->numchars;
+    dwin->lines[0].store(dwin->chars, dwin->attrs, dwin->numchars);
     dwin->lines[0].newline = forced;
 
-    for (i = dwin->scrollback - 1; i > 0; i--) {
-        dwin->lines[i] = dwin->lines[i - 1];
-        if (i < dwin->height) {
-            touch(dwin, i);
-        }
+    dwin->lines.push_front();
+    for (i = 1; i < dwin->height && i < dwin->scrollback; i++) {
+        touch(dwin, i);
     }
 
     if (dwin->radjn != 0) {
@@ -744,7 +1052,8 @@ static void scrolloneline(window_textbuffer_t *dwin, bool forced)
     }
 
     touch(dwin, 0);
-    dwin->lines[0].len = 0;
+    dwin->lines[0].repaint = false;
+    dwin->lines[0].discard();
     dwin->lines[0].newline = false;
     dwin->lines[0].lm = dwin->ladjw;
     dwin->lines[0].rm = dwin->radjw;
@@ -752,9 +1061,9 @@ static void scrolloneline(window_textbuffer_t *dwin, bool forced)
     dwin->lines[0].rpic.reset();
     dwin->lines[0].lhyper = 0;
     dwin->lines[0].rhyper = 0;
-    dwin->lines[0].chars.fill(' ');
-    dwin->lines[0].attrs.fill(attr_t{});
 
+    dwin->linechars.fill(' ');
+    dwin->lineattrs.fill(attr_t{});
     dwin->numchars = 0;
 
     touchscroll(dwin);
@@ -856,15 +1165,6 @@ static bool leftquote(std::uint32_t c)
 
 void win_textbuffer_putchar_uni(window_t *win, glui32 ch)
 {
-    window_textbuffer_t *dwin = win->winbuffer();
-    std::array<glui32, TBLINELEN> bchars;
-    std::array<attr_t, TBLINELEN> battrs;
-    int pw;
-    int bpoint;
-    int saved;
-    int i;
-    int linelen;
-
     // Don't speak if the current text style is input, under the
     // assumption that the interpreter is trying to display the user's
     // input. This is how Bocfel uses style_Input, and without this
@@ -888,6 +1188,22 @@ void win_textbuffer_putchar_uni(window_t *win, glui32 ch)
         gli_tts_speak(&ch, 1);
     }
 
+    put_char(win, win->winbuffer(), ch);
+}
+
+// Add a character to the text buffer, wrapping as necessary. This is
+// split out from win_textbuffer_putchar_uni() so that reflowing can
+// replay text, possibly into a scratch buffer, without speaking it.
+static void put_char(window_t *win, window_textbuffer_t *dwin, glui32 ch)
+{
+    std::array<glui32, TBLINELEN> bchars;
+    std::array<attr_t, TBLINELEN> battrs;
+    int pw;
+    int bpoint;
+    int saved;
+    int i;
+    int linelen;
+
     pw = (win->bbox.x1 - win->bbox.x0 - gli_tmarginx * 2 - gli_scroll_width) * GLI_SUBPIX;
     pw = pw - 2 * SLOP - dwin->radjw - dwin->ladjw;
 
@@ -980,7 +1296,7 @@ void win_textbuffer_putchar_uni(window_t *win, glui32 ch)
                 dwin->spaced = 2;
             } else if (ch != ' ' && dwin->spaced == 2) {
                 dwin->spaced = 0;
-                win_textbuffer_putchar_uni(win, ' ');
+                put_char(win, dwin, ' ');
             } else {
                 dwin->spaced = 0;
             }
@@ -1054,7 +1370,7 @@ void win_textbuffer_clear(window_t *win)
     dwin->numchars = 0;
 
     for (i = 0; i < dwin->scrollback; i++) {
-        dwin->lines[i].len = 0;
+        dwin->lines[i].discard();
 
         dwin->lines[i].lpic.reset();
         dwin->lines[i].rpic.reset();
@@ -1071,6 +1387,7 @@ void win_textbuffer_clear(window_t *win)
     dwin->lastseen = 0;
     dwin->scrollpos = 0;
     dwin->scrollmax = 0;
+    dwin->reflowlen = 0;
 
     for (i = 0; i < dwin->height; i++) {
         touch(dwin, i);
@@ -1241,6 +1558,8 @@ bool gcmd_accept_scroll(window_t *win, glui32 arg)
         break;
     }
 
+    reflow_history(win, dwin->scrollpos + dwin->height * 2);
+
     if (dwin->scrollpos > dwin->scrollmax - dwin->height + 1) {
         dwin->scrollpos = dwin->scrollmax - dwin->height + 1;
     }
@@ -1571,6 +1890,7 @@ static bool put_picture(window_textbuffer_t *dwin, const std::shared_ptr<picture
         dwin->radjw = (pic->w + gli_tmarginx) * GLI_SUBPIX;
         dwin->radjn = (pic->h + gli_cellh - 1) / gli_cellh;
         dwin->lines[0].rpic = pic;
+        dwin->maxpich = std::max(dwin->maxpich, pic->h);
         dwin->lines[0].rm = dwin->radjw;
         dwin->lines[0].rhyper = linkval;
     }
@@ -1587,6 +1907,7 @@ static bool put_picture(window_textbuffer_t *dwin, const std::shared_ptr<picture
         dwin->ladjw = (pic->w + gli_tmarginx) * GLI_SUBPIX;
         dwin->ladjn = (pic->h + gli_cellh - 1) / gli_cellh;
         dwin->lines[0].lpic = pic;
+        dwin->maxpich = std::max(dwin->maxpich, pic->h);
         dwin->lines[0].lm = dwin->ladjw;
         dwin->lines[0].lhyper = linkval;
 
@@ -2,9 +2,10 @@
 //
 // SPDX-License-Identifier: MIT
 
+#include <algorithm>
 #include <array>
 #include <cstdlib>
-#include <cstring>
+#include <unordered_map>
 #include <vector>
 
 #include "dict.h"
@@ -16,20 +17,34 @@
 #include "util.h"
 #include "zterp.h"
 
+// Dictionaries are consulted once per token, and some stories tokenize
+// a lot, or build their own dictionaries, which can be unsorted and so
+// have to be searched linearly. Instead of searching the dictionary
+// itself, then, each dictionary is parsed the first time it’s used and
+// an index of its entries, keyed on their encoded form, is built.
 struct Dictionary {
     explicit Dictionary(uint16_t addr) :
         m_addr(addr),
         m_num_separators(user_byte(m_addr)),
         m_entry_length(user_byte(m_addr + m_num_separators + 1)),
-        m_num_entries(as_signed(user_word(m_addr + m_num_separators + 2))),
-        m_base(m_addr + 1 + m_num_separators + 1 + 2) {
-            ZASSERT(m_entry_length >= (zversion <= 3 ? 4 : 6), "dictionary entry length (%d) too small", m_entry_length);
-            ZASSERT(m_base + (labs(m_num_entries) * m_entry_length) < memory_size, "reported dictionary length extends beyond memory size");
+        m_num_entries(labs(as_signed(user_word(m_addr + m_num_separators + 2)))),
+        m_base(m_addr + 1 + m_num_separators + 1 + 2),
+        m_key_length(zversion <= 3 ? 4 : 6) {
+            ZASSERT(m_entry_length >= m_key_length, "dictionary entry length (%d) too small", m_entry_length);
+            ZASSERT(end() < memory_size, "reported dictionary length extends beyond memory size");
 
             m_separators[ZSCII_SPACE] = true;
             for (uint8_t i = 0; i < m_num_separators; i++) {
                 m_separators[byte(m_addr + 1 + i)] = true;
             }
+
+            // If there are duplicate entries, the first one wins, which
+            // is what a linear search of an unsorted dictionary finds.
+            m_index.reserve(m_num_entries);
+            for (long i = 0; i < m_num_entries; i++) {
+                uint32_t entry = m_base + (i * m_entry_length);
+                m_index.emplace(key(&memory[entry]), entry);
+            }
         }
 
     uint16_t find(const uint8_t *token, size_t len) const;
@@ -38,6 +53,11 @@ struct Dictionary {
         return m_separators[c];
     };
 
+    // One past the last byte of the dictionary.
+    uint32_t end() const {
+        return m_base + (m_num_entries * m_entry_length);
+    }
+
 private:
     uint16_t m_addr;
     uint8_t m_num_separators;
@@ -45,8 +65,93 @@ private:
     uint8_t m_entry_length;
     long m_num_entries;
     uint16_t m_base;
+    int m_key_length;
+    std::unordered_map<uint64_t, uint16_t> m_index;
+
+    uint64_t key(const uint8_t *encoded) const {
+        uint64_t k = 0;
+
+        for (int i = 0; i < m_key_length; i++) {
+            k = (k << 8) | encoded[i];
+        }
+
+        return k;
+    }
 };
 
+// Dictionaries which have been parsed, by address. A dictionary in
+// dynamic memory can be changed by the story, so the dynamic memory
+// covered by cached dictionaries is tracked in dict_cache_start and
+// dict_cache_end, and a write there (or a restart or restore) drops
+// every dictionary in dynamic memory.
+static std::unordered_map<uint16_t, Dictionary> dictionaries;
+static bool dict_cache_stale = false;
+static bool dict_cache_stale_all = false;
+
+// There’s no real limit on how many dictionaries a story can use (any
+// address can be passed to @tokenise), so if this is reached, start
+// over.
+static constexpr size_t MAX_DICTIONARIES = 64;
+
+// Like the string cache in screen.cpp, this can be called while a
+// dictionary is in use (if the parse buffer overlaps it), so just mark
+// the cache as stale here, and clean it up the next time it’s used.
+void dict_invalidate_cache()
+{
+    dict_cache_stale = true;
+    dict_cache_start = dict_cache_end = 0;
+}
+
+// Cheats can freeze words anywhere, including in static memory, so when
+// they change, drop every dictionary.
+void dict_invalidate_all()
+{
+    dict_invalidate_cache();
+    dict_cache_stale_all = true;
+}
+
+static const Dictionary &dictionary_at(uint16_t addr)
+{
+    if (dict_cache_stale) {
+        for (auto it = dictionaries.begin(); it != dictionaries.end(); ) {
+            if (dict_cache_stale_all || it->first < header.static_start) {
+                it = dictionaries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        dict_cache_stale = false;
+        dict_cache_stale_all = false;
+    }
+
+    auto cached = dictionaries.find(addr);
+    if (cached != dictionaries.end()) {
+        return cached->second;
+    }
+
+    if (dictionaries.size() >= MAX_DICTIONARIES) {
+        dictionaries.clear();
+        dict_cache_start = dict_cache_end = 0;
+    }
+
+    const auto &dictionary = dictionaries.emplace(addr, Dictionary(addr)).first->second;
+
+    if (addr < header.static_start) {
+        uint32_t end = std::min<uint32_t>(dictionary.end(), header.static_start);
+
+        if (dict_cache_start == dict_cache_end) {
+            dict_cache_start = addr;
+            dict_cache_end = end;
+        } else {
+            dict_cache_start = std::min<uint32_t>(dict_cache_start, addr);
+            dict_cache_end = std::max(dict_cache_end, end);
+        }
+    }
+
+    return dictionary;
+}
+
 // Encode the text at “s”, of length “len” (there is not necessarily a
 // terminating null character), returning it.
 //
@@ -116,31 +221,14 @@ static std::array<uint8_t, 6> encode_string(const uint8_t *s, size_t len)
 }
 
 uint16_t Dictionary::find(const uint8_t *token, size_t len) const {
-    const uint8_t *ret = nullptr;
-    auto dict_compar = [](const void *a, const void *b) {
-        return std::memcmp(a, b, zversion <= 3 ? 4 : 6);
-    };
-
     auto encoded = encode_string(token, len);
+    auto entry = m_index.find(key(encoded.data()));
 
-    if (m_num_entries > 0) {
-        ret = static_cast<uint8_t *>(std::bsearch(encoded.data(), &memory[m_base], m_num_entries, m_entry_length, dict_compar));
-    } else {
-        for (long i = 0; i < -m_num_entries; i++) {
-            const uint8_t *entry = &memory[m_base + (i * m_entry_length)];
-
-            if (dict_compar(encoded.data(), entry) == 0) {
-                ret = entry;
-                break;
-            }
-        }
-    }
-
-    if (ret == nullptr) {
+    if (entry == m_index.end()) {
         return 0;
     }
 
-    return m_base + (ret - &memory[m_base]);
+    return entry->second;
 }
 
 static uint16_t lookup_replacement(uint16_t original, const std::vector<uint8_t> &replacement, const Dictionary &dictionary)
@@ -156,25 +244,31 @@ static uint16_t lookup_replacement(uint16_t original, const std::vector<uint8_t>
     return d;
 }
 
-static void handle_token(const uint8_t *base, const uint8_t *token, size_t len, uint16_t parse, const Dictionary &dictionary, int found, bool ignore_unknown, bool start_of_sentence)
+struct Token {
+    const uint8_t *start;
+    size_t len;
+    bool start_of_sentence;
+};
+
+static void handle_token(const uint8_t *base, const Token &token, uint16_t parse, const Dictionary &dictionary, int found, bool ignore_unknown)
 {
     uint16_t d;
 
-    d = dictionary.find(token, len);
+    d = dictionary.find(token.start, token.len);
 
-    if (len == 1 && is_game(Game::Infocom1234) && start_of_sentence && !options.disable_abbreviations) {
+    if (token.len == 1 && is_game(Game::Infocom1234) && token.start_of_sentence && !options.disable_abbreviations) {
         const std::vector<uint8_t> examine = { 'e', 'x', 'a', 'm', 'i', 'n', 'e' };
         const std::vector<uint8_t> again = { 'a', 'g', 'a', 'i', 'n' };
         const std::vector<uint8_t> wait = { 'w', 'a', 'i', 't' };
         const std::vector<uint8_t> oops = { 'o', 'o', 'p', 's' };
 
-        if (*token == 'x') {
+        if (*token.start == 'x') {
             d = lookup_replacement(d, examine, dictionary);
-        } else if (*token == 'g') {
+        } else if (*token.start == 'g') {
             d = lookup_replacement(d, again, dictionary);
-        } else if (*token == 'z') {
+        } else if (*token.start == 'z') {
             d = lookup_replacement(d, wait, dictionary);
-        } else if (*token == 'o') {
+        } else if (*token.start == 'o') {
             d = lookup_replacement(d, oops, dictionary);
         }
     }
@@ -187,12 +281,12 @@ static void handle_token(const uint8_t *base, const uint8_t *token, size_t len,
 
     user_store_word(parse, d);
 
-    user_store_byte(parse + 2, len);
+    user_store_byte(parse + 2, token.len);
 
     if (zversion <= 4) {
-        user_store_byte(parse + 3, token - base + 1);
+        user_store_byte(parse + 3, token.start - base + 1);
     } else {
-        user_store_byte(parse + 3, token - base + 2);
+        user_store_byte(parse + 3, token.start - base + 2);
     }
 }
 
@@ -219,9 +313,9 @@ void tokenize(uint16_t text, uint16_t parse, uint16_t dictaddr, bool ignore_unkn
     const uint8_t *p, *lastp;
     const uint8_t *string;
     uint32_t text_len = 0;
-    const int maxwords = user_byte(parse);
+    const size_t maxwords = user_byte(parse);
     bool in_word = false;
-    int found = 0;
+    std::vector<Token> tokens;
     bool start_of_sentence = true;
 
     if (dictaddr == 0) {
@@ -230,7 +324,7 @@ void tokenize(uint16_t text, uint16_t parse, uint16_t dictaddr, bool ignore_unkn
 
     ZASSERT(dictaddr != 0, "attempt to tokenize without a valid dictionary");
 
-    Dictionary dictionary(dictaddr);
+    const auto &dictionary = dictionary_at(dictaddr);
 
     if (zversion >= 5) {
         text_len = user_byte(text + 1);
@@ -257,14 +351,14 @@ void tokenize(uint16_t text, uint16_t parse, uint16_t dictaddr, bool ignore_unkn
         }
 
         if (text_len == 0 || dictionary.is_sep(*p)) {
-            if (in_word && found < maxwords) {
-                handle_token(string, lastp, p - lastp, parse, dictionary, found++, ignore_unknown, start_of_sentence);
+            if (in_word && tokens.size() < maxwords) {
+                tokens.push_back({lastp, static_cast<size_t>(p - lastp), start_of_sentence});
                 start_of_sentence = false;
             }
 
             // §13.6.1: Separators (apart from a space) are tokens too.
-            if (text_len != 0 && *p != ZSCII_SPACE && found < maxwords) {
-                handle_token(string, p, 1, parse, dictionary, found++, ignore_unknown, start_of_sentence);
+            if (text_len != 0 && *p != ZSCII_SPACE && tokens.size() < maxwords) {
+                tokens.push_back({p, 1, start_of_sentence});
                 start_of_sentence = *p == ZSCII_PERIOD;
             }
 
@@ -273,9 +367,16 @@ void tokenize(uint16_t text, uint16_t parse, uint16_t dictaddr, bool ignore_unkn
 
         p++;
 
-    } while (text_len-- > 0 && found < maxwords);
+    } while (text_len-- > 0 && tokens.size() < maxwords);
+
+    // The whole buffer is split up before anything is looked up, so the
+    // lookups all happen together, and the text is never read after
+    // the parse buffer has been written to.
+    for (size_t i = 0; i < tokens.size(); i++) {
+        handle_token(string, tokens[i], parse, dictionary, i, ignore_unknown);
+    }
 
-    user_store_byte(parse + 1, found);
+    user_store_byte(parse + 1, tokens.size());
 }
 
 static void encode_text(uint32_t text, uint16_t len, uint16_t coded)
@@ -5,6 +5,8 @@
 
 #include "types.h"
 
+void dict_invalidate_cache();
+void dict_invalidate_all();
 void tokenize(uint16_t text, uint16_t parse, uint16_t dictaddr, bool ignore_unknown);
 
 void ztokenise();
@@ -10,6 +10,7 @@
 
 #include "memory.h"
 #include "branch.h"
+#include "dict.h"
 #include "meta.h"
 #include "process.h"
 #include "screen.h"
@@ -27,6 +28,13 @@
 uint8_t *memory, *dynamic_memory;
 uint32_t memory_size;
 
+// Decoded strings cached by screen.cpp can depend on this range of
+// dynamic memory (the abbreviations); writing to it drops the cache.
+uint32_t string_cache_start, string_cache_end;
+
+// Likewise for dictionaries parsed by dict.cpp.
+uint32_t dict_cache_start, dict_cache_end;
+
 bool in_globals(uint16_t addr)
 {
     return addr >= header.globals && addr < header.globals + 480;
@@ -62,6 +70,14 @@ uint8_t byte(uint32_t addr)
 
 void store_byte(uint32_t addr, uint8_t val)
 {
+    if (addr >= string_cache_start && addr < string_cache_end) {
+        screen_invalidate_string_cache();
+    }
+
+    if (addr >= dict_cache_start && addr < dict_cache_end) {
+        dict_invalidate_cache();
+    }
+
     memory[addr] = val;
 }
 
@@ -123,6 +139,14 @@ void store_word(uint32_t addr, uint16_t val)
     }
 #endif
 
+    if (addr + 1 >= string_cache_start && addr < string_cache_end) {
+        screen_invalidate_string_cache();
+    }
+
+    if (addr + 1 >= dict_cache_start && addr < dict_cache_end) {
+        dict_invalidate_cache();
+    }
+
     memory[addr + 0] = val >> 8;
     memory[addr + 1] = val & 0xff;
 }
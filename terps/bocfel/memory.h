@@ -9,6 +9,8 @@
 
 extern uint8_t *memory, *dynamic_memory;
 extern uint32_t memory_size;
+extern uint32_t string_cache_start, string_cache_end;
+extern uint32_t dict_cache_start, dict_cache_end;
 
 bool in_globals(uint16_t addr);
 bool is_global(uint16_t addr);
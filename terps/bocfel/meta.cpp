@@ -13,6 +13,7 @@
 #include <vector>
 
 #include "meta.h"
+#include "dict.h"
 #include "io.h"
 #include "memory.h"
 #include "objects.h"
@@ -277,6 +278,11 @@ bool cheat_add(const std::string &how, bool print)
         }
 
         frozen_addresses[addr] = {true, value};
+
+        // Frozen values are seen by word(), which is used to decode
+        // strings and to build the dictionary index.
+        screen_invalidate_string_cache();
+        dict_invalidate_all();
     } else {
         return false;
     }
@@ -295,6 +301,9 @@ static bool cheat_remove(uint16_t addr)
     }
 
     frozen_addresses[addr] = {false, 0};
+    screen_invalidate_string_cache();
+    dict_invalidate_all();
+
     return true;
 }
 
@@ -540,6 +549,12 @@ static void meta_info()
     screen_printf("File: %s\n", game_file.c_str());
     screen_printf("Z-machine version: %d\n", memory[0]);
     screen_printf("ID: %s\n", get_story_id().c_str());
+
+    unsigned long long executed, predecoded;
+    double per_second;
+    instruction_stats(executed, predecoded, per_second);
+    screen_printf("Instructions executed: %llu (%llu from the decode cache)\n", executed, predecoded);
+    screen_printf("Instructions per second: %.0f\n", per_second);
 }
 
 static std::vector<char> meta_notes;
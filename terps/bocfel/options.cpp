@@ -187,6 +187,7 @@ Options::Options() {
     NUMBER('n', "Set the interpreter number (see 11.1.3 in The Z-machine Standards Document 1.1)", true, int_number, Range(1, 11));
     CHAR  ('N', "Set the interpreter version to the single-character version (see 11.1.3.1 in The Z-machine Standards Document 1.1)", true, int_version);
     BOOL  ('p', "Disable the application of patches", true, disable_patches);
+    BOOL  ('P', "Disable the predecoded instruction cache", true, disable_decode_cache);
     BOOL  ('r', "Play back a command record", true, replay_on);
     STRING('R', "Specify the filename for the command record replay", true, replay_name);
     BOOL  ('s', "Turn on command recording", true, record_on);
@@ -45,6 +45,7 @@ struct Options {
     unsigned long int_number = 1; // DEC
     unsigned char int_version = 'C';
     bool disable_patches = false;
+    bool disable_decode_cache = false;
     bool replay_on = false;
     std::unique_ptr<std::string> replay_name = nullptr;
     bool record_on = false;
@@ -3,7 +3,9 @@
 // SPDX-License-Identifier: MIT
 
 #include <array>
+#include <ctime>
 #include <functional>
+#include <vector>
 
 #ifdef ZTERP_GLK_TICK
 extern "C" {
@@ -33,6 +35,10 @@ unsigned long current_instruction;
 std::array<uint16_t, 8> zargs;
 int znargs;
 
+static unsigned long long instructions_executed;
+static unsigned long long instructions_predecoded;
+static std::clock_t instruction_clock;
+
 // Track the current processing level: 1 for the “main” loop, 2 if
 // inside of an interrupt, 3 if inside of an interrupt inside of an
 // interrupt, and so on.
@@ -99,6 +105,99 @@ enum class Opcount {
 #define op_call(opcode)		opcodes[opcode]()
 #define extended_call(opcode)	ext_opcodes[opcode]()
 
+static void zextended();
+
+// Decoded instructions are cached by address in a direct-mapped table,
+// so that the instructions of a busy loop can be dispatched without
+// going back through byte()/word() to decode their operand types and
+// operands every time. Variable operands are stored as variable
+// numbers, and are still read when the instruction is executed.
+//
+// Only instructions in static or high memory are cached. These can’t
+// be written to by the story, so their entries never go stale. Code in
+// dynamic memory, which is unusual but legal, is decoded fresh each
+// time it’s executed, so writes there need no invalidation.
+struct DecodedInstruction {
+    unsigned long pc = 0;
+    unsigned long next_pc = 0;
+    void (*handler)() = nullptr;
+    uint8_t nargs = 0;
+    uint8_t variables = 0; // Bit n is set if argument n is a variable number.
+    std::array<uint16_t, 8> args;
+};
+
+static constexpr unsigned long DECODE_CACHE_SIZE = 16384;
+static std::vector<DecodedInstruction> decode_cache;
+
+// Returns true if decoded, false otherwise (omitted)
+static bool predecode_base(DecodedInstruction &insn, uint8_t type)
+{
+    switch (type) {
+    case 0: // Large constant.
+        insn.args[insn.nargs++] = word(pc);
+        pc += 2;
+        break;
+    case 1: // Small constant.
+        insn.args[insn.nargs++] = byte(pc++);
+        break;
+    case 2: // Variable.
+        insn.variables |= 1U << insn.nargs;
+        insn.args[insn.nargs++] = byte(pc++);
+        break;
+    default: // Omitted.
+        return false;
+    }
+
+    return true;
+}
+
+static void predecode_var(DecodedInstruction &insn, uint8_t types)
+{
+    for (int i = 6; i >= 0; i -= 2) {
+        if (!predecode_base(insn, (types >> i) & 0x03)) {
+            return;
+        }
+    }
+}
+
+// Decode the instruction at “pc” into the cache, the same way
+// process_instructions() does, but without reading variables.
+static const DecodedInstruction &predecode()
+{
+    DecodedInstruction &insn = decode_cache[pc % DECODE_CACHE_SIZE];
+    uint8_t opcode = byte(pc++);
+
+    insn.pc = current_instruction;
+    insn.handler = opcodes[opcode];
+    insn.nargs = 0;
+    insn.variables = 0;
+
+    if (opcode < 0x80) { // long 2OP
+        predecode_base(insn, (opcode & 0x40) == 0x40 ? 2 : 1);
+        predecode_base(insn, (opcode & 0x20) == 0x20 ? 2 : 1);
+    } else if (opcode < 0xb0) { // short 1OP
+        predecode_base(insn, (opcode >> 4) & 0x03);
+    } else if (opcode < 0xc0) { // short 0OP (plus EXT)
+        if (insn.handler == zextended) {
+            insn.handler = ext_opcodes[byte(pc++)];
+            predecode_var(insn, byte(pc++));
+        }
+    } else if (opcode == 0xec || opcode == 0xfa) { // Double variable VAR
+        uint8_t types1, types2;
+
+        types1 = byte(pc++);
+        types2 = byte(pc++);
+        predecode_var(insn, types1);
+        predecode_var(insn, types2);
+    } else { // variable 2OP and VAR
+        predecode_var(insn, byte(pc++));
+    }
+
+    insn.next_pc = pc;
+
+    return insn;
+}
+
 // This nifty trick is from Frotz.
 static void zextended()
 {
@@ -150,6 +249,11 @@ void setup_opcodes()
 {
     opcodes.fill(illegal_opcode);
 
+    decode_cache.assign(options.disable_decode_cache ? 0 : DECODE_CACHE_SIZE, DecodedInstruction());
+    instructions_executed = 0;
+    instructions_predecoded = 0;
+    instruction_clock = std::clock();
+
     // §14.2.1
     ext_opcodes.fill(znop);
 
@@ -313,12 +417,46 @@ void process_instructions()
 
     while (true) {
         uint8_t opcode;
+        void (*handler)();
 
 #ifdef ZTERP_GLK_TICK
         glk_tick();
 #endif
 
         current_instruction = pc;
+        instructions_executed++;
+
+        if (!decode_cache.empty() && pc >= header.static_start) {
+            const DecodedInstruction *insn = &decode_cache[pc % DECODE_CACHE_SIZE];
+
+            if (insn->pc == pc) {
+                instructions_predecoded++;
+            } else {
+                insn = &predecode();
+            }
+
+            znargs = insn->nargs;
+            for (int i = 0; i < znargs; i++) {
+                if ((insn->variables & (1U << i)) != 0) {
+                    zargs[i] = variable(insn->args[i]);
+                } else {
+                    zargs[i] = insn->args[i];
+                }
+            }
+
+            pc = insn->next_pc;
+            handler = insn->handler;
+
+            try {
+                handler();
+            } catch (const Operation::Return &) {
+                processing_level--;
+                return;
+            }
+
+            continue;
+        }
+
         opcode = byte(pc++);
 
         if (opcode < 0x80) { // long 2OP
@@ -372,6 +510,19 @@ void process_instructions()
     }
 }
 
+// Report how many instructions have been executed since the story
+// started, how many were dispatched straight from the decode cache,
+// and the rate in instructions per second of processor time (which
+// does not advance while waiting for input).
+void instruction_stats(unsigned long long &executed, unsigned long long &predecoded, double &per_second)
+{
+    double seconds = static_cast<double>(std::clock() - instruction_clock) / CLOCKS_PER_SEC;
+
+    executed = instructions_executed;
+    predecoded = instructions_predecoded;
+    per_second = seconds > 0 ? instructions_executed / seconds : 0;
+}
+
 // A wrapper around process_instructions() which is responsible for
 // dealing with restart, restore, and quit.
 void process_loop()
@@ -51,5 +51,6 @@ bool in_interrupt();
 void setup_opcodes();
 void process_instructions();
 void process_loop();
+void instruction_stats(unsigned long long &executed, unsigned long long &predecoded, double &per_second);
 
 #endif
@@ -546,6 +546,21 @@ static void xglk_put_char_stream(strid_t s, uint32_t c)
         glk_put_char_stream_uni(s, c);
     }
 }
+
+static void xglk_put_buffer(std::vector<glui32> &buf)
+{
+    if (!have_unicode) {
+        std::vector<char> latin1;
+
+        for (const auto c : buf) {
+            latin1.push_back(unicode_to_latin1[c]);
+        }
+
+        glk_put_buffer(latin1.data(), latin1.size());
+    } else {
+        glk_put_buffer_uni(buf.data(), buf.size());
+    }
+}
 #endif
 
 static bool set_force_fixed = false;
@@ -911,6 +926,46 @@ void put_char(uint8_t c)
     put_char_base(c, false);
 }
 
+// Print a span of ZSCII characters, just as calling put_char() on each
+// of them would. In the common case, where text is only going to the
+// main window, the whole span is handed to Glk at once, instead of
+// going through the stream and font checks of put_char_base() for
+// every character.
+static void put_chars(const std::vector<uint8_t> &zscii)
+{
+#ifdef ZTERP_GLK
+    if (!streams.test(OSTREAM_MEMORY) && curwin == mainwin && (curwin->font != Window::Font::Character || options.disable_graphics_font)) {
+        static std::vector<glui32> buf;
+
+        buf.clear();
+        for (const auto c : zscii) {
+            // See put_char_base() for why tab and sentence space are
+            // skipped.
+            if (c == 0 || (zversion != 6 && (c == 9 || c == 11)) || zscii_to_unicode[c] == 0) {
+                continue;
+            }
+
+            buf.push_back(zscii_to_unicode[c]);
+        }
+
+        if (streams.test(OSTREAM_SCREEN) && curwin->id != nullptr && !buf.empty()) {
+            xglk_put_buffer(buf);
+        }
+
+        for (const auto c : buf) {
+            history.add_char(c);
+            transcribe(c);
+        }
+
+        return;
+    }
+#endif
+
+    for (const auto c : zscii) {
+        put_char(c);
+    }
+}
+
 // Glk doesn’t allow control characters (apart from newline) to be
 // written (§2.2). In most cases this isn’t a problem, but there are a
 // couple of places where user-provided strings need to be printed out
@@ -1430,12 +1485,15 @@ static void check_terminators(const Window *window)
 }
 #endif
 
-// Decode and print a zcode string at address “addr”. This can be
-// called recursively thanks to abbreviations; the initial call should
-// have “in_abbr” set to false.
-// Each time a character is decoded, it is passed to the function
-// “outc”.
-static int print_zcode(uint32_t addr, bool in_abbr, void (*outc)(uint8_t))
+static const std::vector<uint8_t> &abbreviation(int n);
+
+// Decode and print a zcode string at address “addr”. This is called
+// with “in_abbr” set to true to decode an abbreviation, and false
+// otherwise.
+// Each time a character is decoded, it is passed to “outc”, which is
+// either a function or a lambda.
+template <typename Outc>
+static int print_zcode(uint32_t addr, bool in_abbr, Outc outc)
 {
     enum class TenBit { None, Start, Half } tenbit = TenBit::None;
     int abbrev = 0, shift = 0;
@@ -1459,12 +1517,9 @@ static int print_zcode(uint32_t addr, bool in_abbr, void (*outc)(uint8_t))
                 outc((lastc << 5) | c);
                 tenbit = TenBit::None;
             } else if (abbrev != 0) {
-                uint32_t new_addr;
-
-                new_addr = user_word(header.abbr + 64 * (abbrev - 1) + 2 * c);
-
-                // new_addr is a word address, so multiply by 2
-                print_zcode(new_addr * 2, true, outc);
+                for (const auto abbr_c : abbreviation(32 * (abbrev - 1) + c)) {
+                    outc(abbr_c);
+                }
 
                 abbrev = 0;
             } else {
@@ -1526,13 +1581,140 @@ static int print_zcode(uint32_t addr, bool in_abbr, void (*outc)(uint8_t))
     return counter - addr;
 }
 
+// Decoded strings are cached as spans of ZSCII characters, so that
+// strings which are printed over and over (room descriptions, stock
+// messages) need only be decoded once.
+//
+// Only strings in static or high memory are cached, since the story
+// can’t change them. Strings in dynamic memory, such as object names,
+// are decoded every time they’re printed. Abbreviations are cached too,
+// even though they, and the abbreviation table, are usually in dynamic
+// memory: the dynamic memory they were decoded from is tracked in
+// string_cache_start and string_cache_end, and a write there (or a
+// restart or restore) drops the whole cache, since cached strings have
+// abbreviations expanded in them.
+struct DecodedString {
+    std::vector<uint8_t> zscii;
+    int length; // The size of the encoded string, in bytes.
+};
+
+static std::unordered_map<uint32_t, DecodedString> string_cache;
+static size_t string_cache_size;
+static std::array<std::vector<uint8_t>, 96> abbr_cache;
+static std::bitset<96> abbr_cached;
+static bool string_cache_stale = false;
+
+// Strings are cached as they’re printed, so it would take a very large
+// story to reach this, but if it is reached, start over.
+static constexpr size_t STRING_CACHE_MAX = 1024 * 1024;
+
+// This can be called while a cached string is being printed (if it’s
+// going to a memory stream), so just mark the cache as stale here, and
+// empty it the next time it’s used.
+void screen_invalidate_string_cache()
+{
+    string_cache_stale = true;
+    string_cache_start = string_cache_end = 0;
+}
+
+static void check_string_cache()
+{
+    if (string_cache_stale) {
+        string_cache.clear();
+        string_cache_size = 0;
+        abbr_cached.reset();
+        string_cache_stale = false;
+    }
+}
+
+// Record that cached strings depend on “n” bytes at “addr”.
+static void watch_string_memory(uint32_t addr, uint32_t n)
+{
+    if (addr >= header.static_start) {
+        return;
+    }
+
+    uint32_t end = std::min<uint32_t>(addr + n, header.static_start);
+
+    if (string_cache_start == string_cache_end) {
+        string_cache_start = addr;
+        string_cache_end = end;
+    } else {
+        string_cache_start = std::min(string_cache_start, addr);
+        string_cache_end = std::max(string_cache_end, end);
+    }
+}
+
+// Return the expansion of abbreviation “n” (where n is 32 * (z - 1) + x
+// for abbreviation z, x in §3.3), decoding it if need be.
+static const std::vector<uint8_t> &abbreviation(int n)
+{
+    auto &expansion = abbr_cache[n];
+
+    check_string_cache();
+
+    if (!abbr_cached.test(n)) {
+        uint16_t entry = header.abbr + 2 * n;
+
+        // This is a word address, so multiply by 2.
+        uint32_t addr = user_word(entry) * 2;
+
+        expansion.clear();
+        int length = print_zcode(addr, true, [&expansion](uint8_t c) {
+            expansion.push_back(c);
+        });
+
+        watch_string_memory(entry, 2);
+        watch_string_memory(addr, length);
+        abbr_cached.set(n);
+    }
+
+    return expansion;
+}
+
+static const DecodedString &decoded_string(uint32_t addr)
+{
+    check_string_cache();
+
+    auto cached = string_cache.find(addr);
+    if (cached != string_cache.end()) {
+        return cached->second;
+    }
+
+    if (string_cache_size > STRING_CACHE_MAX) {
+        string_cache.clear();
+        string_cache_size = 0;
+    }
+
+    DecodedString decoded;
+    decoded.length = print_zcode(addr, false, [&decoded](uint8_t c) {
+        decoded.zscii.push_back(c);
+    });
+    string_cache_size += decoded.zscii.size();
+
+    return string_cache.emplace(addr, std::move(decoded)).first->second;
+}
+
 // Prints the string at addr “addr”.
 //
-// Returns the number of bytes the string took up. “outc” is passed as
-// the character-print function to print_zcode(); if it is null,
-// put_char is used.
+// Returns the number of bytes the string took up. “outc” is the
+// character-print function; if it is null, put_char is used.
 int print_handler(uint32_t addr, void (*outc)(uint8_t))
 {
+    if (addr >= header.static_start) {
+        const auto &decoded = decoded_string(addr);
+
+        if (outc == nullptr) {
+            put_chars(decoded.zscii);
+        } else {
+            for (const auto c : decoded.zscii) {
+                outc(c);
+            }
+        }
+
+        return decoded.length;
+    }
+
     return print_zcode(addr, false, outc != nullptr ? outc : put_char);
 }
 
@@ -4884,6 +5066,8 @@ void create_graphicswin()
 
 void init_screen(bool first_run)
 {
+    screen_invalidate_string_cache();
+
     for (auto &window : windows) {
         window.style.reset();
         window.fg_color = window.bg_color = Color();
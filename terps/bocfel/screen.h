@@ -108,6 +108,7 @@ bool input_stream(int which);
 
 int print_handler(uint32_t addr, void (*outc)(uint8_t));
 void put_char(uint8_t c);
+void screen_invalidate_string_cache();
 
 std::string screen_format_time(long hours, long minutes);
 void screen_read_scrn(IO &io, uint32_t size);
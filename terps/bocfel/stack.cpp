@@ -21,6 +21,7 @@
 
 #include "stack.h"
 #include "branch.h"
+#include "dict.h"
 #include "iff.h"
 #include "io.h"
 #include "memory.h"
@@ -78,12 +79,31 @@ static uint16_t pop_stack()
     return *--sp;
 }
 
+// Dynamic memory is not stored in the Quetzal image of each save
+// state. Instead, each save stack holds a copy of dynamic memory as it
+// is in its most recent state, and each state holds the pages which
+// differ between it and the state below it, as they are in the state
+// below. Pushing a state thus costs a page-by-page comparison and a
+// copy of only the pages that changed; popping one applies its pages to
+// the stack’s copy, which brings that copy back to the next state down.
+// Full Quetzal images are assembled only when the stacks are written to
+// an autosave, and each state’s memory chunk is compressed only once.
+static constexpr uint32_t SAVE_PAGE_SIZE = 64;
+
 struct SaveState {
 public:
     SaveType savetype;
     std::vector<uint8_t> quetzal;
+    std::vector<uint16_t> pagenums;
+    std::vector<uint8_t> pages;
     std::string desc;
 
+    // The Quetzal memory chunk for this state, built the first time the
+    // state is written to an autosave (or kept from the autosave it was
+    // read from). A state never changes once it’s on a stack, so neither
+    // does its memory chunk.
+    std::vector<uint8_t> memchunk;
+
     SaveState(SaveType savetype_, const char *desc_, std::vector<uint8_t> quetzal_) :
         savetype(savetype_),
         quetzal(std::move(quetzal_)),
@@ -91,6 +111,41 @@ public:
     {
     }
 
+    // Record the pages of “prev” (dynamic memory in the state below
+    // this one) which differ from “mem”. On failure, std::bad_alloc is
+    // thrown.
+    void save_pages(const std::vector<uint8_t> &prev, const uint8_t *mem) {
+        for (uint32_t addr = 0; addr < prev.size(); addr += SAVE_PAGE_SIZE) {
+            uint32_t n = std::min<uint32_t>(SAVE_PAGE_SIZE, prev.size() - addr);
+
+            if (std::memcmp(&prev[addr], &mem[addr], n) != 0) {
+                pagenums.push_back(addr / SAVE_PAGE_SIZE);
+                pages.insert(pages.end(), prev.begin() + addr, prev.begin() + addr + n);
+            }
+        }
+    }
+
+    // Turn a copy of dynamic memory in this state into a copy of
+    // dynamic memory in the state below it.
+    void apply_pages(std::vector<uint8_t> &mem) const {
+        size_t offset = 0;
+
+        for (auto pagenum : pagenums) {
+            uint32_t addr = pagenum * SAVE_PAGE_SIZE;
+            uint32_t n = std::min<uint32_t>(SAVE_PAGE_SIZE, mem.size() - addr);
+
+            std::memcpy(&mem[addr], &pages[offset], n);
+            offset += n;
+        }
+    }
+
+    void drop_pages() {
+        pagenums.clear();
+        pagenums.shrink_to_fit();
+        pages.clear();
+        pages.shrink_to_fit();
+    }
+
 private:
     static std::string format_time() {
         auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
@@ -116,9 +171,13 @@ private:
 
 struct SaveStack {
     std::deque<SaveState> states;
+    std::vector<uint8_t> memory;
     unsigned long max = 0;
 
-    void push(SaveState state) {
+    // Push a state whose dynamic memory is “mem”. On failure,
+    // std::bad_alloc is thrown, and the stack is left as it was (apart
+    // from possibly having dropped its oldest state).
+    void push(SaveState state, const uint8_t *mem) {
         // If the maximum number has been reached, drop the last element.
         //
         // Small note: calling @restore_undo twice should succeed both times
@@ -129,23 +188,47 @@ struct SaveStack {
         // with the slot count set to 1. By default, the number of save slots
         // is 100, so this will not be an issue unless a game goes out of its
         // way to cause problems.
+        if (states.empty()) {
+            memory.assign(mem, mem + header.static_start);
+        } else {
+            state.save_pages(memory, mem);
+        }
+
         if (max > 0 && states.size() == max) {
             states.pop_back();
+
+            // The bottom state has nothing below it to go back to.
+            if (states.empty()) {
+                state.drop_pages();
+            } else {
+                states.back().drop_pages();
+            }
         }
 
         states.push_front(std::move(state));
+        std::memcpy(memory.data(), mem, memory.size());
+    }
+
+    // Remove the most recent save.
+    void pop() {
+        states.front().apply_pages(memory);
+        states.pop_front();
     }
 
     // Remove the first “n” saves from the specified stack. If there are
     // not enough saves available, remove all saves.
     void trim_saves(size_t n) {
-        states.erase(states.begin(), n > states.size() ? states.end() : states.begin() + n);
+        for (size_t i = 0; i < n && !states.empty(); i++) {
+            pop();
+        }
         states.shrink_to_fit();
     }
 
     void clear() {
         states.clear();
         states.shrink_to_fit();
+        memory.clear();
+        memory.shrink_to_fit();
     }
 };
 static std::unordered_map<SaveStackType, SaveStack, EnumClassHash> save_stacks;
@@ -447,7 +530,7 @@ void zpush_stack()
 
 // Compress dynamic memory according to Quetzal. On failure,
 // std::bad_alloc is thrown.
-static std::vector<uint8_t> compress_memory()
+static std::vector<uint8_t> compress_memory(const uint8_t *mem)
 {
     long i = 0;
     std::vector<uint8_t> compressed;
@@ -460,7 +543,7 @@ static std::vector<uint8_t> compress_memory()
         // Count zeroes. Stop counting when:
         // • The end of dynamic memory is reached, or
         // • A non-zero value is found
-        while (i < header.static_start && (byte(i) ^ dynamic_memory[i]) == 0) {
+        while (i < header.static_start && (mem[i] ^ dynamic_memory[i]) == 0) {
             i++;
         }
 
@@ -480,7 +563,7 @@ static std::vector<uint8_t> compress_memory()
         }
 
         // The current byte differs from the story, so write it.
-        compressed.push_back(byte(i) ^ dynamic_memory[i]);
+        compressed.push_back(mem[i] ^ dynamic_memory[i]);
 
         i++;
     }
@@ -489,18 +572,18 @@ static std::vector<uint8_t> compress_memory()
 }
 
 // Reverse of the above function.
-static bool uncompress_memory(const uint8_t *compressed, uint32_t size)
+static bool uncompress_memory(const uint8_t *compressed, uint32_t size, uint8_t *mem)
 {
     uint32_t memory_index = 0;
 
-    std::memcpy(memory, dynamic_memory, header.static_start);
+    std::memcpy(mem, dynamic_memory, header.static_start);
 
     for (uint32_t i = 0; i < size; i++) {
         if (compressed[i] != 0) {
             if (memory_index == header.static_start) {
                 return false;
             }
-            store_byte(memory_index, byte(memory_index) ^ compressed[i]);
+            mem[memory_index] ^= compressed[i];
             memory_index++;
         } else {
             if (++i == size) {
@@ -542,15 +625,14 @@ static IFF::TypeID write_intd(IO &savefile)
     return IFF::TypeID("IntD");
 }
 
-static IFF::TypeID write_mem(IO &savefile)
+static IFF::TypeID write_mem(IO &savefile, const uint8_t *mem)
 {
     std::vector<uint8_t> compressed;
     uint32_t memsize = header.static_start;
-    const uint8_t *mem = memory;
     IFF::TypeID type = IFF::TypeID("UMem");
 
     try {
-        compressed = compress_memory();
+        compressed = compress_memory(mem);
         // It is possible for the compressed memory size to be larger than
         // uncompressed; in this case, don’t use compressed memory.
         if (compressed.size() < header.static_start) {
@@ -629,14 +711,124 @@ static IFF::TypeID write_args(IO &savefile, SaveOpcode saveopcode)
     return IFF::TypeID("Args");
 }
 
-static void write_undo_msav(IO &savefile, SaveStackType type)
+template<typename... Types>
+static void write_chunk(IO &io, IFF::TypeID (*writefunc)(IO &savefile, Types... args), Types... args);
+
+// Save states on the stacks don’t include dynamic memory (see
+// SaveState), so a full Quetzal image is the state’s image with this
+// memory chunk appended.
+static std::vector<uint8_t> memory_chunk(const uint8_t *mem)
+{
+    IO io(std::vector<uint8_t>(), IO::Mode::WriteOnly);
+
+    write_chunk(io, write_mem, mem);
+
+    return io.get_memory();
+}
+
+// Remove the memory chunk from the Quetzal image, storing its contents
+// in “mem” and the chunk itself in “chunk”. Returns false if no valid
+// memory chunk is found.
+static bool remove_memory(std::vector<uint8_t> &quetzal, std::vector<uint8_t> &mem, std::vector<uint8_t> &chunk)
+{
+    auto read32 = [&quetzal](size_t offset) {
+        return (static_cast<uint32_t>(quetzal[offset + 0]) << 24) |
+               (static_cast<uint32_t>(quetzal[offset + 1]) << 16) |
+               (static_cast<uint32_t>(quetzal[offset + 2]) <<  8) |
+               (static_cast<uint32_t>(quetzal[offset + 3]) <<  0);
+    };
+    bool found = false;
+    size_t offset = 12;
+
+    if (quetzal.size() < offset) {
+        return false;
+    }
+
+    mem.resize(header.static_start);
+
+    while (offset + 8 <= quetzal.size()) {
+        IFF::TypeID type(read32(offset));
+        size_t size = read32(offset + 4);
+        size_t padded = size + (size & 1);
+
+        if (offset + 8 + size > quetzal.size()) {
+            return false;
+        }
+
+        if (type != IFF::TypeID("CMem") && type != IFF::TypeID("UMem")) {
+            offset += 8 + padded;
+            continue;
+        }
+
+        if (found) {
+            return false;
+        }
+
+        if (type == IFF::TypeID("CMem")) {
+            if (!uncompress_memory(&quetzal[offset + 8], size, mem.data())) {
+                return false;
+            }
+        } else {
+            if (size != header.static_start) {
+                return false;
+            }
+            std::memcpy(mem.data(), &quetzal[offset + 8], size);
+        }
+
+        auto chunk_end = quetzal.begin() + std::min(offset + 8 + padded, quetzal.size());
+        chunk.assign(quetzal.begin() + offset, chunk_end);
+        chunk.resize(8 + padded);
+        quetzal.erase(quetzal.begin() + offset, chunk_end);
+        found = true;
+    }
+
+    uint32_t file_size = quetzal.size() - 8;
+    quetzal[4] = (file_size >> 24) & 0xff;
+    quetzal[5] = (file_size >> 16) & 0xff;
+    quetzal[6] = (file_size >>  8) & 0xff;
+    quetzal[7] = (file_size >>  0) & 0xff;
+
+    return found;
+}
+
+// Returns false if the full Quetzal images could not be built, in
+// which case nothing has been written.
+static bool write_undo_msav(IO &savefile, SaveStackType type)
 {
     SaveStack &s = save_stacks[type];
 
+    // Build the memory chunks of the states which don’t have one yet,
+    // which are usually just those pushed since the last autosave.
+    // Dynamic memory can only be rebuilt starting with the most recent
+    // state, so walk down as far as the oldest such state.
+    auto oldest = std::find_if(s.states.rbegin(), s.states.rend(), [](const SaveState &state) {
+        return state.memchunk.empty();
+    });
+
+    if (oldest != s.states.rend()) {
+        try {
+            std::vector<uint8_t> mem = s.memory;
+
+            for (auto state = s.states.begin(); state != oldest.base(); ++state) {
+                if (state->memchunk.empty()) {
+                    state->memchunk = memory_chunk(mem.data());
+                }
+                state->apply_pages(mem);
+            }
+        } catch (const std::bad_alloc &) {
+            return false;
+        } catch (const IO::IOError &) {
+            return false;
+        }
+    }
+
     savefile.write32(0); // Version
     savefile.write32(s.states.size());
 
+    // States are written oldest first.
     for (auto state = s.states.crbegin(); state != s.states.crend(); ++state) {
+        uint32_t quetzal_size = state->quetzal.size() + state->memchunk.size();
+
         if (type == SaveStackType::Game) {
             savefile.write8(static_cast<uint8_t>(state->savetype));
         } else if (type == SaveStackType::User) {
@@ -648,21 +840,32 @@ static void write_undo_msav(IO &savefile, SaveStackType type)
             }
         }
 
-        savefile.write32(state->quetzal.size());
-        savefile.write_exact(state->quetzal.data(), state->quetzal.size());
+        // The state’s image with the memory chunk appended, and the FORM
+        // size adjusted to match.
+        savefile.write32(quetzal_size);
+        savefile.write_exact(state->quetzal.data(), 4);
+        savefile.write32(quetzal_size - 8);
+        savefile.write_exact(&state->quetzal[8], state->quetzal.size() - 8);
+        savefile.write_exact(state->memchunk.data(), state->memchunk.size());
     }
+
+    return true;
 }
 
 static IFF::TypeID write_undo(IO &savefile)
 {
-    write_undo_msav(savefile, SaveStackType::Game);
+    if (!write_undo_msav(savefile, SaveStackType::Game)) {
+        return IFF::TypeID();
+    }
 
     return IFF::TypeID("Undo");
 }
 
 static IFF::TypeID write_msav(IO &savefile)
 {
-    write_undo_msav(savefile, SaveStackType::User);
+    if (!write_undo_msav(savefile, SaveStackType::User)) {
+        return IFF::TypeID();
+    }
 
     return IFF::TypeID("MSav");
 }
@@ -711,7 +914,10 @@ static bool save_quetzal(IO &savefile, SaveType savetype, SaveOpcode saveopcode,
 
         write_chunk(savefile, write_ifhd);
         write_chunk(savefile, write_intd);
-        write_chunk(savefile, write_mem);
+        // Save stacks track dynamic memory themselves; see SaveState.
+        if (!on_save_stack) {
+            write_chunk(savefile, write_mem, static_cast<const uint8_t *>(memory));
+        }
         write_chunk(savefile, write_stks);
         write_chunk(savefile, write_anno);
 
@@ -782,7 +988,7 @@ static void read_mem(IFF &iff)
             }
         }
 
-        if (!uncompress_memory(buf.data(), size)) {
+        if (!uncompress_memory(buf.data(), size, memory)) {
             throw RestoreError("memory cannot be uncompressed");
         }
     } else if (iff.find(IFF::TypeID("UMem"), size)) {
@@ -977,6 +1183,8 @@ static void read_undo_msav(IO &savefile, uint32_t size, SaveStackType type)
             std::string desc;
             uint32_t quetzal_size;
             std::vector<uint8_t> quetzal;
+            std::vector<uint8_t> mem;
+            std::vector<uint8_t> memchunk;
 
             if (type == SaveStackType::Game) {
                 savetype = savefile.read8();
@@ -1002,8 +1210,13 @@ static void read_undo_msav(IO &savefile, uint32_t size, SaveStackType type)
             savefile.read_exact(quetzal.data(), quetzal_size);
 
             if (count - i <= save_stack.max) {
+                if (!remove_memory(quetzal, mem, memchunk)) {
+                    return;
+                }
+
                 SaveState newstate(static_cast<SaveType>(savetype), desc.c_str(), quetzal);
-                temp.push(std::move(newstate));
+                newstate.memchunk = std::move(memchunk);
+                temp.push(std::move(newstate), mem.data());
             }
 
             actual_size += 4 + quetzal_size;
@@ -1066,7 +1279,10 @@ static bool instruction_has_stack_argument(uint32_t addr)
     return false;
 }
 
-static bool restore_quetzal(const std::shared_ptr<IO> &savefile, SaveType savetype, SaveOpcode &saveopcode, bool close_window)
+// If “mem” is not null, it is used as dynamic memory instead of the
+// save file’s memory chunk; this is used for save states on a stack,
+// which do not have memory chunks.
+static bool restore_quetzal(const std::shared_ptr<IO> &savefile, SaveType savetype, SaveOpcode &saveopcode, bool close_window, const uint8_t *mem = nullptr)
 {
     std::unique_ptr<IFF> iff;
     uint32_t size;
@@ -1138,7 +1354,14 @@ static bool restore_quetzal(const std::shared_ptr<IO> &savefile, SaveType savety
 
         stash.backup();
 
-        read_mem(*iff);
+        screen_invalidate_string_cache();
+        dict_invalidate_cache();
+
+        if (mem != nullptr) {
+            std::memcpy(memory, mem, header.static_start);
+        } else {
+            read_mem(*iff);
+        }
         read_stks(*iff);
 
         if (iff->find(IFF::TypeID("Bfnt"), size)) {
@@ -1340,7 +1563,7 @@ SaveResult push_save(SaveStackType type, SaveType savetype, SaveOpcode saveopcod
         }
 
         SaveState newstate(savetype, desc, savefile.get_memory());
-        s.push(std::move(newstate));
+        s.push(std::move(newstate), memory);
 
         return SaveResult::Success;
     } catch (const IO::OpenError &) {
@@ -1362,19 +1585,27 @@ bool pop_save(SaveStackType type, size_t saveno, SaveOpcode &saveopcode)
     }
 
     for (size_t i = 0; i < saveno; i++) {
-        s.states.pop_front();
+        s.pop();
+    }
+
+    std::vector<uint8_t> mem;
+    try {
+        mem = s.memory;
+    } catch (const std::bad_alloc &) {
+        return false;
     }
 
-    auto p = std::move(s.states.front());
-    s.states.pop_front();
+    auto savetype = s.states.front().savetype;
+    auto quetzal = std::move(s.states.front().quetzal);
+    s.pop();
 
     try {
-        savefile = std::make_shared<IO>(p.quetzal, IO::Mode::ReadOnly);
+        savefile = std::make_shared<IO>(quetzal, IO::Mode::ReadOnly);
     } catch (const IO::OpenError &) {
         return false;
     }
 
-    return restore_quetzal(savefile, p.savetype, saveopcode, false);
+    return restore_quetzal(savefile, savetype, saveopcode, false, mem.data());
 }
 
 // Wrapper around trim_saves which reports failure if the specified save
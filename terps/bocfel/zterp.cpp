@@ -22,6 +22,7 @@
 #include "zterp.h"
 #include "blorb.h"
 #include "branch.h"
+#include "dict.h"
 #include "iff.h"
 #include "io.h"
 #include "memory.h"
@@ -649,6 +650,7 @@ void start_story()
     // have been set during story processing, and those should persist.
     flags2 = word(0x10);
     std::memcpy(memory, dynamic_memory, header.static_start);
+    dict_invalidate_cache();
     store_word(0x10, flags2);
 
     write_header();
@@ -6,6 +6,14 @@
 #include <setjmp.h>
 #include <string.h>
 
+#ifdef USE_DISK_CACHE
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 // -------------------------------------------------------------
 // Constants
 
@@ -23,6 +31,9 @@ int gPeephole = 1;
 int gDebug = 0;
 int gCacheRAM = 0;
 
+git_uint32 gHotThreshold = 1000;
+const char * gHotReport = NULL;
+
 BlockHeader * gBlockHeader;
 
 const char * gLabelNames [] = {
@@ -70,6 +81,22 @@ static PatchNode * sPatch;
 static int sNextInstructionIsReferenced;
 static git_uint32 sLastAddr;
 
+static int sCompilingHot; // Are we recompiling a hot block?
+
+static void writeHotReport ();
+
+#ifdef USE_DISK_CACHE
+static Block  sDiskStart;    // Start of blocks loaded from the disk cache.
+static Block  sDiskTop;      // End of blocks loaded from the disk cache.
+static void * sDiskMap;      // The mapped disk cache file, if any.
+static size_t sDiskMapSize;  // Size of the mapping, in bytes.
+static char * sDiskPath;     // Path of the disk cache file.
+
+static void loadDiskCache ();
+static void saveDiskCache ();
+static void closeDiskCache ();
+#endif
+
 // -------------------------------------------------------------
 // Functions
 
@@ -109,10 +136,35 @@ void initCompiler (size_t size)
 
     sCodeStart = sCodeTop = (Block) (gHashTable + gHashSize);
     sTempStart = sTempEnd = (PatchNode*) (sBuffer + sBufferSize);
+
+#ifdef USE_DISK_CACHE
+    loadDiskCache ();
+
+    // The terp may not get to shut down cleanly (closing the window
+    // exits from inside glk), so make sure the cache still gets written
+    // out, including the first time, when there was nothing to load.
+    if (sDiskPath != NULL)
+    {
+        static int registered = 0;
+        if (!registered)
+            atexit (saveDiskCache);
+        registered = 1;
+    }
+#endif
+
+    if (gHotReport != NULL)
+        atexit (writeHotReport);
 }
 
 void shutdownCompiler ()
 {
+    writeHotReport ();
+
+#ifdef USE_DISK_CACHE
+    saveDiskCache ();
+    closeDiskCache ();
+#endif
+
     free (sBuffer);
 
     sBuffer = NULL;
@@ -143,10 +195,42 @@ void nextInstructionIsReferenced ()
     sNextInstructionIsReferenced = 1;
 }
 
+// Find the hash node that getCode() would use for an address.
+static HashNode * findHashNode (git_uint32 address)
+{
+    HashNode * n = gHashTable [address & (gHashSize-1)];
+    while (n != NULL && n->address != address)
+        n = n->u.next;
+    return n;
+}
+
+// Find the hash node for an address if it belongs to a hot block.
+static HashNode * findHotNode (git_uint32 address)
+{
+    HashNode * n = findHashNode (address);
+    if (n == NULL || !((BlockHeader*) ((git_uint32*)n + n->headerOffset))->isHot)
+        return NULL;
+    return n;
+}
+
 Block compile (git_uint32 pc)
 {
     git_uint32 endOfBlock;
     int i, numNodes;
+    HashNode * hot;
+
+    // A cold block must never shadow code that was already recompiled
+    // hot. Its hash node would be found first, so the cold copy would
+    // get hot in turn and the same code would be compiled twice. If we
+    // get here for an address with hot code (say, falling through from
+    // the end of another block), just use the hot code.
+
+    hot = sCompilingHot ? NULL : findHotNode (pc);
+    if (hot != NULL)
+    {
+        gBlockHeader = (BlockHeader*) ((git_uint32*)hot + hot->headerOffset);
+        return (git_uint32*)hot + hot->codeOffset;
+    }
 
     // Make sure we have enough room for, at a minimum:
     // - the block header
@@ -166,7 +250,7 @@ Block compile (git_uint32 pc)
 
     sLastAddr = 0;
     sNextInstructionIsReferenced = 1;
-    resetPeepholeOptimiser();
+    resetPeepholeOptimiser (sCompilingHot);
 
     sPatch = NULL;
 
@@ -287,7 +371,10 @@ Block compile (git_uint32 pc)
                 git_uint32 * by = constBranch + 1;
 
                 // Change the 'const' branch to a 'by' branch.
-                *op = *op - label_jump_const + label_jump_by;
+                if (*op >= label_jz_l_const && *op <= label_jle_ll_const)
+                    *op = *op - label_jz_l_const + label_jz_l_by;
+                else
+                    *op = *op - label_jump_const + label_jump_by;
 
                 // Turn the address into a relative offset.
                 *by = ((git_uint32*)gBlockHeader + p2->codeOffset) - (constBranch + 2);
@@ -327,9 +414,11 @@ Block compile (git_uint32 pc)
             continue;
 
         // If we're not skipping this instruction, and it's
-        // referenced somewhere, attach it to the hash table.
+        // referenced somewhere, attach it to the hash table
+        // (unless a hot block already handles it -- see above).
                 
-        if (sTempStart->u.isReferenced)
+        if (sTempStart->u.isReferenced
+            && (sCompilingHot || findHotNode (sTempStart->address) == NULL))
         {
             HashNode * node = (HashNode*) sCodeTop;
             sCodeTop = (git_uint32*) (node + 1);
@@ -353,6 +442,7 @@ Block compile (git_uint32 pc)
     gBlockHeader->compiledSize = sCodeTop - (git_uint32*) gBlockHeader;
     gBlockHeader->glulxSize = endOfBlock - pc;
     gBlockHeader->runCounter = 0;
+    gBlockHeader->isHot = sCompilingHot;
     
     assert(gBlockHeader->compiledSize > 0);
 
@@ -360,6 +450,23 @@ Block compile (git_uint32 pc)
     return (git_uint32*) (gBlockHeader + 1);
 }
 
+Block compileHotBlock (git_uint32 pc)
+{
+    Block code;
+
+    // gBlockHeader is the block that just got hot. Its hash node for
+    // this address will be shadowed by the new block, so reset its
+    // counter to let it age out of the cache.
+
+    gBlockHeader->runCounter = 0;
+
+    sCompilingHot = 1;
+    code = compile (pc);
+    sCompilingHot = 0;
+
+    return code;
+}
+
 #define END_OF_BLOCK(header) ((void*) (((git_uint32*)header) + header->compiledSize))
 
 static git_uint32 findCutoffPoint ()
@@ -425,14 +532,12 @@ static void compressWithCutoff (git_uint32 cutoff)
     }
 }
 
-static void rebuildHashTable ()
+static void linkBlocks (Block startBlock, Block topBlock)
 {
-    BlockHeader * start = (BlockHeader*) sCodeStart;
-    BlockHeader * top = (BlockHeader*) sCodeTop;
+    BlockHeader * start = (BlockHeader*) startBlock;
+    BlockHeader * top = (BlockHeader*) topBlock;
     BlockHeader * h;
 
-    memset (gHashTable, 0, gHashSize * sizeof(HashNode*));
-
     for (h = start ; h < top ; h = END_OF_BLOCK(h))
     {
         if (h->glulxSize > 0)
@@ -449,6 +554,16 @@ static void rebuildHashTable ()
     }
 }
 
+static void rebuildHashTable ()
+{
+    memset (gHashTable, 0, gHashSize * sizeof(HashNode*));
+
+#ifdef USE_DISK_CACHE
+    linkBlocks (sDiskStart, sDiskTop);
+#endif
+    linkBlocks (sCodeStart, sCodeTop);
+}
+
 static void removeHashNode (HashNode* deadNode)
 {
     HashNode* n = gHashTable [deadNode->address & (gHashSize-1)];
@@ -477,10 +592,10 @@ static void removeHashNode (HashNode* deadNode)
     }
 }
 
-void pruneCodeCache (git_uint32 address, git_uint32 size)
+static void pruneBlocks (Block startBlock, Block topBlock, git_uint32 address, git_uint32 size)
 {
-    BlockHeader * start = (BlockHeader*) sCodeStart;
-    BlockHeader * top = (BlockHeader*) sCodeTop;
+    BlockHeader * start = (BlockHeader*) startBlock;
+    BlockHeader * top = (BlockHeader*) topBlock;
     BlockHeader * h;
 
     // Step through the cache, looking for blocks that overlap the
@@ -511,6 +626,14 @@ void pruneCodeCache (git_uint32 address, git_uint32 size)
     }
 }
 
+void pruneCodeCache (git_uint32 address, git_uint32 size)
+{
+#ifdef USE_DISK_CACHE
+    pruneBlocks (sDiskStart, sDiskTop, address, size);
+#endif
+    pruneBlocks (sCodeStart, sCodeTop, address, size);
+}
+
 void compressCodeCache ()
 {
     git_uint32 n;
@@ -544,6 +667,87 @@ void resetCodeCache ()
     memset (sBuffer, 0, sBufferSize * 4);
     sCodeStart = sCodeTop = (Block) (gHashTable + gHashSize);
     sTempStart = sTempEnd = (PatchNode*) (sBuffer + sBufferSize);
+
+#ifdef USE_DISK_CACHE
+    linkBlocks (sDiskStart, sDiskTop);
+#endif
+}
+
+// -------------------------------------------------------------
+// Hot block report
+
+#define HOT_REPORT_BLOCKS 20
+
+static int addHotBlocks (BlockHeader ** hottest, int count, Block start, Block top)
+{
+    BlockHeader * h;
+
+    for (h = (BlockHeader*) start ; h < (BlockHeader*) top ; h = END_OF_BLOCK(h))
+    {
+        HashNode * node = END_OF_BLOCK(h);
+        int i;
+
+        if (h->glulxSize == 0 || h->numHashNodes == 0)
+            continue;
+
+        // Skip blocks that no longer handle their start address, such as
+        // cold blocks shadowed by a hot copy, so each address shows once.
+        if (findHashNode (node[-1].address) != &node[-1])
+            continue;
+
+        // Insertion sort, keeping the hottest blocks first.
+        if (count < HOT_REPORT_BLOCKS)
+            ++count;
+        else if (h->runCounter <= hottest [count - 1]->runCounter)
+            continue;
+
+        for (i = count - 1 ; i > 0 && hottest [i - 1]->runCounter < h->runCounter ; --i)
+            hottest [i] = hottest [i - 1];
+        hottest [i] = h;
+    }
+
+    return count;
+}
+
+static void writeHotReport ()
+{
+    static int written = 0;
+    BlockHeader * hottest [HOT_REPORT_BLOCKS];
+    int i, count = 0;
+    FILE * f;
+
+    // Only write the report once, whether from shutdownCompiler() or atexit().
+    if (written || gHotReport == NULL || sBuffer == NULL)
+        return;
+    written = 1;
+
+    f = fopen (gHotReport, "w");
+    if (f == NULL)
+        return;
+
+#ifdef USE_DISK_CACHE
+    count = addHotBlocks (hottest, count, sDiskStart, sDiskTop);
+#endif
+    count = addHotBlocks (hottest, count, sCodeStart, sCodeTop);
+
+    if (gHotThreshold != 0)
+        fprintf (f, "Hottest blocks (recompiled after %lu runs):\n\n", (unsigned long) gHotThreshold);
+    else
+        fprintf (f, "Hottest blocks (hot recompilation disabled):\n\n");
+    fprintf (f, "   address   bytes   words        runs\n");
+    for (i = 0 ; i < count ; ++i)
+    {
+        HashNode * node = END_OF_BLOCK(hottest [i]);
+        fprintf (f, "  %08lx  %6lu  %6u  %10lu%s\n",
+            (unsigned long) node[-1].address,
+            (unsigned long) hottest [i]->glulxSize,
+            (unsigned) hottest [i]->compiledSize,
+            (unsigned long) hottest [i]->runCounter,
+            hottest [i]->isHot ? "  hot" : "");
+    }
+
+    reportSuperinstructions (f);
+    fclose (f);
 }
 
 Block peekAtEmittedStuff (int numOpcodes)
@@ -553,9 +757,21 @@ Block peekAtEmittedStuff (int numOpcodes)
 
 void emitConstBranch (Label op, git_uint32 address)
 {
+    git_uint32 operands [2];
+    int i, numOperands;
+
+    // The peephole optimiser may fold the branch's operands into it,
+    // or find that it's never taken and can be dropped altogether.
+
+    op = fuseConstBranch (op, operands, &numOperands);
+    if (op == label_nop)
+        return;
+
     sPatch->branchOffset = sCodeTop - (git_uint32*)gBlockHeader;
     emitData (op);
     emitData (address);
+    for (i = 0 ; i < numOperands ; ++i)
+        emitData (operands [i]);
 
     if (sLastAddr < address)
         sLastAddr = address;
@@ -577,3 +793,281 @@ extern git_uint32 undoEmit ()
 {
     return *--sCodeTop;
 }
+
+// -------------------------------------------------------------
+// Disk cache
+//
+// Code compiled from ROM can't change for a given story file, so at
+// exit we write every block that lies entirely in ROM to a file keyed
+// by the story's checksum, and on the next launch we map that file
+// back in. Loaded blocks live outside the main buffer: they're linked
+// into the hash table like any other block but are never compressed
+// away, so they don't compete with RAM code or newly compiled code
+// for cache space. Code in RAM is always compiled live.
+//
+// The compiled code holds Label values and relative offsets, not host
+// pointers, so it can be reused as-is (the HashNode chain pointers are
+// relinked on load). This doesn't hold with USE_DIRECT_THREADING,
+// which is why config.h turns the disk cache off in that case.
+
+#ifdef USE_DISK_CACHE
+
+#define DISK_CACHE_MAGIC 0x47697443 // 'GitC'
+#define DISK_CACHE_FORMAT 2         // Bump this if code generation changes.
+#define DISK_CACHE_MAX (16 * 1024 * 1024L)
+
+typedef struct DiskCacheHeader
+{
+    git_uint32 magic;      // DISK_CACHE_MAGIC
+    git_uint32 format;     // DISK_CACHE_FORMAT
+    git_uint32 version;    // GIT_VERSION_NUM
+    git_uint32 layout;     // Number of labels and size of the block structures.
+    git_uint32 options;    // Compiler options that affect the generated code.
+    git_uint32 hotThreshold; // gHotThreshold, which decides which blocks get superinstructions.
+    git_uint32 ramStart;   // Start of RAM in the story file.
+    git_uint32 romHash;    // Hash of the story file's ROM.
+    git_uint32 codeSize;   // Size of the blocks that follow, in 4-byte words.
+    git_uint32 codeHash;   // Hash of the blocks that follow.
+    git_uint32 reserved[2];
+}
+DiskCacheHeader;
+
+static git_uint32 hashBytes (git_uint32 hash, const void * data, size_t size)
+{
+    // FNV-1a.
+    const git_uint8 * p = data;
+    while (size-- > 0)
+        hash = (hash ^ *p++) * 16777619U;
+    return hash;
+}
+
+static void fillDiskCacheHeader (DiskCacheHeader * header)
+{
+    memset (header, 0, sizeof(DiskCacheHeader));
+    header->magic = DISK_CACHE_MAGIC;
+    header->format = DISK_CACHE_FORMAT;
+    header->version = GIT_VERSION_NUM;
+    header->layout = MAX_LABEL | (sizeof(HashNode) << 16) | (sizeof(BlockHeader) << 24);
+    header->options = (gPeephole ? 1 : 0) | (gDebug ? 2 : 0);
+    header->hotThreshold = gHotThreshold;
+    header->ramStart = gRamStart;
+    header->romHash = hashBytes (2166136261U, gInitMem, gRamStart);
+}
+
+// Work out where the cache file for this story lives, creating
+// the directory if necessary. Returns NULL if there's nowhere to put it.
+static char * diskCachePath ()
+{
+    const char * base = getenv ("XDG_CACHE_HOME");
+    const char * suffix = "";
+    char * path;
+    char * p;
+    size_t size;
+
+    if (base == NULL || base[0] != '/')
+    {
+        base = getenv ("HOME");
+        suffix = "/.cache";
+        if (base == NULL || base[0] != '/')
+            return NULL;
+    }
+
+    size = strlen (base) + strlen (suffix) + 64;
+    path = malloc (size);
+    if (path == NULL)
+        return NULL;
+
+    snprintf (path, size, "%s%s/garglk/git/%08lx.cache", base, suffix,
+        (unsigned long) read32 (gInitMem + 32));
+
+    // Create each missing directory along the way.
+    for (p = strchr (path + 1, '/') ; p != NULL ; p = strchr (p + 1, '/'))
+    {
+        *p = '\0';
+        if (mkdir (path, 0755) != 0 && errno != EEXIST)
+        {
+            free (path);
+            return NULL;
+        }
+        *p = '/';
+    }
+
+    return path;
+}
+
+// Check that the mapped blocks are well-formed, so that a damaged or
+// stale file can't point the terp at garbage.
+static int checkDiskBlocks (Block start, Block top)
+{
+    git_uint32 minSize = sizeof(BlockHeader) / 4;
+    Block b = start;
+
+    while (b < top)
+    {
+        BlockHeader * h = (BlockHeader*) b;
+        HashNode * node;
+        git_uint32 i;
+
+        if ((git_uint32) (top - b) < minSize
+            || h->compiledSize > top - b
+            || h->numHashNodes == 0
+            || h->glulxSize == 0
+            || h->compiledSize < minSize + h->numHashNodes * sizeof(HashNode) / 4)
+            return 0;
+
+        node = END_OF_BLOCK(h);
+        for (i = 0 ; i < h->numHashNodes ; ++i)
+        {
+            --node;
+            if (node->headerOffset != b - (git_uint32*)node
+                || node->codeOffset - node->headerOffset < (git_sint32) minSize
+                || node->codeOffset - node->headerOffset >= h->compiledSize
+                || node->address >= gRamStart)
+                return 0;
+        }
+
+        b += h->compiledSize;
+    }
+
+    return 1;
+}
+
+static void loadDiskCache ()
+{
+    DiskCacheHeader expected;
+    DiskCacheHeader * header;
+    struct stat info;
+    void * map;
+    int file;
+
+    sDiskPath = diskCachePath ();
+    if (sDiskPath == NULL)
+        return;
+
+    file = open (sDiskPath, O_RDONLY);
+    if (file < 0)
+        return;
+
+    if (fstat (file, &info) != 0 || info.st_size < (off_t) sizeof(DiskCacheHeader))
+    {
+        close (file);
+        return;
+    }
+
+    // The mapping is private and writable: blocks' run counters and hash
+    // chains are updated in place, but those changes never reach the file.
+    map = mmap (NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close (file);
+    if (map == MAP_FAILED)
+        return;
+
+    header = map;
+    fillDiskCacheHeader (&expected);
+
+    if (memcmp (header, &expected, offsetof(DiskCacheHeader, codeSize)) != 0
+        || (off_t) (sizeof(DiskCacheHeader) + header->codeSize * 4) != info.st_size
+        || hashBytes (2166136261U, header + 1, header->codeSize * 4) != header->codeHash
+        || !checkDiskBlocks ((Block) (header + 1), (Block) (header + 1) + header->codeSize))
+    {
+        munmap (map, info.st_size);
+        return;
+    }
+
+    sDiskMap = map;
+    sDiskMapSize = info.st_size;
+    sDiskStart = (Block) (header + 1);
+    sDiskTop = sDiskStart + header->codeSize;
+
+    linkBlocks (sDiskStart, sDiskTop);
+}
+
+// Write the ROM blocks in [start, top) to the file, up to a limit on its size.
+static void writeDiskBlocks (FILE * f, Block start, Block top, DiskCacheHeader * header)
+{
+    BlockHeader * h;
+
+    for (h = (BlockHeader*) start ; h < (BlockHeader*) top ; h = END_OF_BLOCK(h))
+    {
+        HashNode * node = END_OF_BLOCK(h);
+        git_uint32 size = h->compiledSize;
+
+        if (h->glulxSize == 0 || h->numHashNodes == 0)
+            continue;
+        if (node[-1].address + h->glulxSize > gRamStart)
+            continue;
+        if ((header->codeSize + size) * 4 > DISK_CACHE_MAX)
+            return;
+
+        if (fwrite (h, 4, size, f) != size)
+        {
+            header->codeSize = 0;
+            return;
+        }
+        header->codeHash = hashBytes (header->codeHash, h, size * 4);
+        header->codeSize += size;
+    }
+}
+
+static void saveDiskCache ()
+{
+    static int saved = 0;
+    DiskCacheHeader header;
+    char * tempPath;
+    FILE * f;
+    int ok;
+
+    // Only save once, whether from shutdownCompiler() or atexit().
+    if (saved || sDiskPath == NULL || sBuffer == NULL)
+        return;
+    saved = 1;
+
+    tempPath = malloc (strlen (sDiskPath) + 5);
+    if (tempPath == NULL)
+        return;
+    sprintf (tempPath, "%s.tmp", sDiskPath);
+
+    f = fopen (tempPath, "wb");
+    if (f == NULL)
+    {
+        free (tempPath);
+        return;
+    }
+
+    fillDiskCacheHeader (&header);
+    header.codeHash = 2166136261U;
+
+    ok = fwrite (&header, sizeof(header), 1, f) == 1;
+    if (ok)
+    {
+        writeDiskBlocks (f, sDiskStart, sDiskTop, &header);
+        writeDiskBlocks (f, sCodeStart, sCodeTop, &header);
+        ok = header.codeSize > 0
+            && fseek (f, 0, SEEK_SET) == 0
+            && fwrite (&header, sizeof(header), 1, f) == 1;
+    }
+
+    if (fclose (f) != 0)
+        ok = 0;
+
+    if (ok)
+        ok = rename (tempPath, sDiskPath) == 0;
+    if (!ok)
+        remove (tempPath);
+
+    free (tempPath);
+}
+
+static void closeDiskCache ()
+{
+    if (sDiskMap != NULL)
+        munmap (sDiskMap, sDiskMapSize);
+
+    sDiskMap = NULL;
+    sDiskMapSize = 0;
+    sDiskStart = sDiskTop = NULL;
+
+    free (sDiskPath);
+    sDiskPath = NULL;
+}
+
+#endif // USE_DISK_CACHE
@@ -30,6 +30,9 @@ extern int gPeephole; // Peephole optimisation of generated code?
 extern int gDebug;    // Insert debug statements into generated code?
 extern int gCacheRAM; // Keep RAM-based code in the JIT cache?
 
+extern git_uint32 gHotThreshold; // Recompile blocks run this many times with superinstructions (0 = never).
+extern const char * gHotReport;  // File to write a report on hot blocks to at exit, or NULL.
+
 // -------------------------------------------------------------
 // Compiling code
 
@@ -57,6 +60,7 @@ extern void resetCodeCache ();
 extern void compressCodeCache ();
 
 extern Block compile (git_uint32 pc);
+extern Block compileHotBlock (git_uint32 pc);
 
 typedef struct HashNode HashNode;
 
@@ -77,7 +81,9 @@ typedef struct BlockHeader
     git_uint16 compiledSize; // Total size of this block, in 4-byte words.
     git_uint32 glulxSize;    // Size of the glulx code this block represents, in bytes.
     git_uint32 runCounter;   // Total number of times this block was retrieved from the cache
-}                            // (used to determine which blocks stay in the cache)
+                             // (used to determine which blocks stay in the cache)
+    git_uint32 isHot;        // Was this block recompiled with superinstructions?
+}
 BlockHeader;
 
 // This is the header for the block currently being executed --
@@ -98,7 +104,8 @@ GIT_INLINE Block getCode (git_uint32 pc)
         if (n->address == pc)
         {
             gBlockHeader = (BlockHeader*) ((git_uint32*)n + n->headerOffset);
-            gBlockHeader->runCounter++;
+            if (++gBlockHeader->runCounter == gHotThreshold && gHotThreshold != 0 && !gBlockHeader->isHot)
+                return compileHotBlock (pc);
             return (git_uint32*)n + n->codeOffset;
         }
         n = n->u.next;
@@ -25,6 +25,18 @@
 // Define this to memory-map the game file to speed up loading. (Unix-specific)
 // #define USE_MMAP
 
+// Define this to keep code compiled from ROM in a per-game file under
+// $XDG_CACHE_HOME, so later runs can skip recompiling it. (Unix-specific)
+// #define USE_DISK_CACHE
+
+// -------------------------------------------------------------------
+
+// Directly threaded code contains host addresses,
+// which can't be reused from one run to the next.
+#if defined(USE_DISK_CACHE) && defined(USE_DIRECT_THREADING)
+#undef USE_DISK_CACHE
+#endif
+
 // -------------------------------------------------------------------
 
 // Make sure we're compiling for a sane platform. For now, this means
@@ -101,8 +101,10 @@ extern void parseCatchStub (git_uint32 * pc, int * modes);
 
 // peephole.c
 
-extern void resetPeepholeOptimiser();
+extern void resetPeepholeOptimiser (int superinstructions);
 extern void emitCode (Label);
+extern Label fuseConstBranch (Label op, git_uint32 * operands, int * numOperands);
+extern void reportSuperinstructions (FILE * file);
 
 // terp.c
 
@@ -129,7 +131,7 @@ extern void startProgram (size_t cacheSize);
 extern int git_init_dispatch();
 extern glui32 git_perform_glk(glui32 funcnum, glui32 numargs, glui32 *arglist);
 extern strid_t git_find_stream_by_id(glui32 id);
-extern glui32 git_find_id_for_stream(strid_t str);
+extern glui32 git_find_id_for_stream(strid_t str);
 
 // git_search.c
 
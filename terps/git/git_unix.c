@@ -7,6 +7,7 @@
 #include "git.h"
 #include <glk.h>
 #include <glkstart.h> // This comes with the Glk library.
+#include <string.h>
 
 #ifdef USE_MMAP
 #include <fcntl.h>
@@ -15,20 +16,38 @@
 #include <errno.h>
 #endif
 
-// The only command-line argument is the filename.
 glkunix_argumentlist_t glkunix_arguments[] =
 {
+    { "-hot", glkunix_arg_NumberValue, "-hot NUM: Recompile code run this many times with superinstructions (default 1000, 0 = never)." },
+    { "-hotreport", glkunix_arg_ValueFollows, "-hotreport FILE: Write a report on hot code to FILE on exit." },
     { "", glkunix_arg_ValueFollows, "filename: The game file to load." },
     { NULL, glkunix_arg_End, NULL }
 };
 
+// Handle any options, returning the index of the filename argument.
+static int parseOptions (glkunix_startup_t *data)
+{
+    int i = 1;
+
+    while (i + 1 < data->argc)
+    {
+        if (strcmp (data->argv[i], "-hotreport") == 0)
+            gHotReport = data->argv[i + 1];
+        else if (strcmp (data->argv[i], "-hot") == 0)
+            gHotThreshold = strtoul (data->argv[i + 1], NULL, 10);
+        else
+            break;
+        i += 2;
+    }
+
+    return i;
+}
+
 #define CACHE_SIZE (256 * 1024L)
 #define UNDO_SIZE (2 * 1024 * 1024L)
 
 #ifdef GARGLK
 
-#include <string.h>
-
 int gHasInited = 0;
 char * gStartupError = 0;
 
@@ -64,6 +83,8 @@ const char * gFilename = 0;
 
 int glkunix_startup_code(glkunix_startup_t *data)
 {
+    int arg;
+
 #ifdef GARGLK
 	{
 		char buf[255];
@@ -75,7 +96,8 @@ int glkunix_startup_code(glkunix_startup_t *data)
 	}
 #endif /* GARGLK */
 
-    if (data->argc <= 1)
+    arg = parseOptions (data);
+    if (data->argc <= arg)
     {
 #ifdef GARGLK
         gStartupError = "No file given";
@@ -89,14 +111,14 @@ int glkunix_startup_code(glkunix_startup_t *data)
 #ifdef GARGLK
 	{
 		char *s;
-		s = strrchr(data->argv[1], '\\');
+		s = strrchr(data->argv[arg], '\\');
 		if (s) garglk_set_story_name(s+1);
-		s = strrchr(data->argv[1], '/');
+		s = strrchr(data->argv[arg], '/');
 		if (s) garglk_set_story_name(s+1);
 	}
 #endif /* GARGLK */
 
-    gFilename = data->argv[1];
+    gFilename = data->argv[arg];
     return 1;
 }
 
@@ -157,6 +179,8 @@ strid_t gStream = 0;
 
 int glkunix_startup_code(glkunix_startup_t *data)
 {
+    int arg;
+
 #ifdef GARGLK
 	{
 		char buf[255];
@@ -168,7 +192,8 @@ int glkunix_startup_code(glkunix_startup_t *data)
 	}
 #endif /* GARGLK */
 
-    if (data->argc <= 1)
+    arg = parseOptions (data);
+    if (data->argc <= arg)
     {
 #ifdef GARGLK
         gStartupError = "No file given";
@@ -182,14 +207,14 @@ int glkunix_startup_code(glkunix_startup_t *data)
 #ifdef GARGLK
 	{
 		char *s;
-		s = strrchr(data->argv[1], '\\');
+		s = strrchr(data->argv[arg], '\\');
 		if (s) garglk_set_story_name(s+1);
-		s = strrchr(data->argv[1], '/');
+		s = strrchr(data->argv[arg], '/');
 		if (s) garglk_set_story_name(s+1);
 	}
 #endif /* GARGLK */
 
-    gStream = glkunix_stream_open_pathname ((char*) data->argv[1], 0, 0);
+    gStream = glkunix_stream_open_pathname ((char*) data->argv[arg], 0, 0);
     return 1;
 }
 
@@ -4,10 +4,165 @@
 #include "git.h"
 
 static Label sLastOp;
+static Label sPrevOp; // The opcode before sLastOp, if it's still there.
 
-extern void resetPeepholeOptimiser ()
+// In hot blocks we also fold constant operands and form superinstructions.
+static int sSuperinstructions;
+
+// How often each superinstruction was formed, and
+// how often each opcode had its operands folded.
+static git_uint32 sFusedCount [MAX_LABEL];
+static git_uint32 sFoldedCount [MAX_LABEL];
+
+extern void resetPeepholeOptimiser (int superinstructions)
+{
+    sLastOp = sPrevOp = label_nop;
+    sSuperinstructions = superinstructions;
+}
+
+// -------------------------------------------------------------
+// Constant folding
+
+static int foldBinary (Label op, git_sint32 L1, git_sint32 L2, git_sint32 * S1)
+{
+    switch (op)
+    {
+        case label_add_discard:    *S1 = L1 + L2; return 1;
+        case label_sub_discard:    *S1 = L1 - L2; return 1;
+        case label_mul_discard:    *S1 = L1 * L2; return 1;
+        case label_bitand_discard: *S1 = L1 & L2; return 1;
+        case label_bitor_discard:  *S1 = L1 | L2; return 1;
+        case label_bitxor_discard: *S1 = L1 ^ L2; return 1;
+
+        case label_div_discard:
+        case label_mod_discard:
+            // Leave errors and overflow for the terp to deal with.
+            if (L2 == 0 || (L2 == -1 && L1 == (git_sint32) 0x80000000))
+                return 0;
+            *S1 = (op == label_div_discard) ? L1 / L2 : L1 % L2;
+            return 1;
+
+        case label_shiftl_discard:
+            *S1 = (L2 > 31 || L2 < 0) ? 0 : (git_sint32) ((git_uint32) L1 << L2);
+            return 1;
+        case label_sshiftr_discard:
+            *S1 = L1 >> ((L2 > 31 || L2 < 0) ? 31 : L2);
+            return 1;
+        case label_ushiftr_discard:
+            *S1 = (L2 > 31 || L2 < 0) ? 0 : (git_sint32) ((git_uint32) L1 >> L2);
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+static int foldUnary (Label op, git_sint32 L1, git_sint32 * S1)
+{
+    switch (op)
+    {
+        case label_neg_discard:    *S1 = -L1; return 1;
+        case label_bitnot_discard: *S1 = ~L1; return 1;
+        case label_copys_discard:  *S1 = L1 & 0xFFFF; return 1;
+        case label_copyb_discard:  *S1 = L1 & 0x00FF; return 1;
+        case label_sexs_discard:   *S1 = (git_sint32)((signed short)(L1 & 0xFFFF)); return 1;
+        case label_sexb_discard:   *S1 = (git_sint32)((signed char)(L1 & 0x00FF)); return 1;
+        default: return 0;
+    }
+}
+
+static int foldBranch (Label op, git_sint32 L1, git_sint32 L2)
 {
-    sLastOp = label_nop;
+    switch (op)
+    {
+        case label_jz_const:  return L1 == 0;
+        case label_jnz_const: return L1 != 0;
+        case label_jeq_const: return L1 == L2;
+        case label_jne_const: return L1 != L2;
+        case label_jlt_const: return L1 < L2;
+        case label_jge_const: return L1 >= L2;
+        case label_jgt_const: return L1 > L2;
+        case label_jle_const: return L1 <= L2;
+        default: return -1;
+    }
+}
+
+// -------------------------------------------------------------
+// Superinstructions
+
+extern Label fuseConstBranch (Label op, git_uint32 * operands, int * numOperands)
+{
+    Label lastOp = sLastOp;
+    int taken;
+
+    // Whatever happens, the branch ends this instruction.
+    sLastOp = sPrevOp = label_nop;
+    *numOperands = 0;
+
+    if (!gPeephole || !sSuperinstructions)
+        return op;
+
+    switch (lastOp)
+    {
+        case label_L1_const_L2_const:
+            taken = foldBranch (op, peekAtEmittedStuff (2) [0], peekAtEmittedStuff (1) [0]);
+            if (taken < 0 || op == label_jz_const || op == label_jnz_const)
+                break;
+            undoEmit (); undoEmit (); undoEmit ();
+            ++sFoldedCount [op];
+            return taken ? label_jump_const : label_nop;
+
+        case label_L1_const:
+            if (op != label_jz_const && op != label_jnz_const)
+                break;
+            taken = foldBranch (op, peekAtEmittedStuff (1) [0], 0);
+            undoEmit (); undoEmit ();
+            ++sFoldedCount [op];
+            return taken ? label_jump_const : label_nop;
+
+        case label_L1_local_L2_const:
+        case label_L1_local_L2_local:
+            if (op < label_jeq_const || op > label_jle_const)
+                break;
+            operands [1] = undoEmit ();
+            operands [0] = undoEmit ();
+            undoEmit ();
+            *numOperands = 2;
+            op = op - label_jeq_const + ((lastOp == label_L1_local_L2_const)
+                ? label_jeq_lc_const : label_jeq_ll_const);
+            ++sFusedCount [op];
+            return op;
+
+        case label_L1_local:
+            if (op != label_jz_const && op != label_jnz_const)
+                break;
+            operands [0] = undoEmit ();
+            undoEmit ();
+            *numOperands = 1;
+            op = op - label_jz_const + label_jz_l_const;
+            ++sFusedCount [op];
+            return op;
+
+        default:
+            break;
+    }
+
+    return op;
+}
+
+extern void reportSuperinstructions (FILE * file)
+{
+    int i;
+
+    fprintf (file, "\nSuperinstructions formed:\n\n");
+    for (i = 0 ; i < MAX_LABEL ; ++i)
+        if (sFusedCount [i] > 0)
+            fprintf (file, "  %-24s %10lu\n", gLabelNames [i], (unsigned long) sFusedCount [i]);
+
+    fprintf (file, "\nOpcodes with constant operands folded:\n\n");
+    for (i = 0 ; i < MAX_LABEL ; ++i)
+        if (sFoldedCount [i] > 0)
+            fprintf (file, "  %-24s %10lu\n", gLabelNames [i], (unsigned long) sFoldedCount [i]);
 }
 
 #define REPLACE_SINGLE(lastOp,thisOp,newOp) \
@@ -82,9 +237,64 @@ extern void resetPeepholeOptimiser ()
         }                                                                   \
         break
 
+#define CASE_FUSED_STORE(lastOp,storeOp)                    \
+    case label_ ## lastOp ## _discard:                      \
+        if (sPrevOp == label_L1_local_L2_const)             \
+        {                                                   \
+            op = label_ ## lastOp ## _lc_ ## storeOp;       \
+            goto replaceLoadsAndOp;                         \
+        }                                                   \
+        if (sPrevOp == label_L1_local_L2_local)             \
+        {                                                   \
+            op = label_ ## lastOp ## _ll_ ## storeOp;       \
+            goto replaceLoadsAndOp;                         \
+        }                                                   \
+        break
+
+#define FUSE_STORE(storeOp)                                 \
+    case label_ ## storeOp:                                 \
+        switch(sLastOp)                                     \
+        {                                                   \
+            CASE_FUSED_STORE (add,    storeOp);             \
+            CASE_FUSED_STORE (sub,    storeOp);             \
+            CASE_FUSED_STORE (bitand, storeOp);             \
+            CASE_FUSED_STORE (aload,  storeOp);             \
+            CASE_FUSED_STORE (aloads, storeOp);             \
+            CASE_FUSED_STORE (aloadb, storeOp);             \
+            default: break;                                 \
+        }                                                   \
+        break
+
 extern void emitCode (Label op)
 {
-    git_uint32 temp;
+    git_uint32 temp, temp2;
+    git_sint32 result;
+
+    if (gPeephole && sSuperinstructions)
+    {
+        // Fold operations on constants into a single constant load.
+
+        if (sLastOp == label_L1_const_L2_const
+            && foldBinary (op, peekAtEmittedStuff (2) [0], peekAtEmittedStuff (1) [0], &result))
+        {
+            undoEmit (); undoEmit (); undoEmit ();
+            goto replaceWithConstant;
+        }
+        if (sLastOp == label_L1_const
+            && foldUnary (op, peekAtEmittedStuff (1) [0], &result))
+        {
+            undoEmit (); undoEmit ();
+            goto replaceWithConstant;
+        }
+
+        switch (op)
+        {
+            FUSE_STORE (S1_stack);
+            FUSE_STORE (S1_local);
+
+            default: break;
+        }
+    }
 
     if (gPeephole)
     {
@@ -115,6 +325,31 @@ extern void emitCode (Label op)
     }
     goto noPeephole;
 
+replaceWithConstant:
+    // The operands and the operation have been removed, and
+    // we just need to load the result into L1 (which is also S1).
+    ++sFoldedCount [op];
+    op = label_L1_const;
+    emitFinalCode (op);
+    emitData (result);
+    sPrevOp = label_nop;
+    goto done;
+
+replaceLoadsAndOp:
+    // The last two opcodes were a double load with two
+    // operands and an operation with none, so we have to
+    // go back four steps to replace all of them.
+    undoEmit();           // Remove the operation.
+    temp2 = undoEmit();   // Save the operands.
+    temp = undoEmit();
+    undoEmit();           // Remove the double load.
+    emitFinalCode (op);   // Emit the superinstruction.
+    emitData (temp);      // Emit the operands again.
+    emitData (temp2);
+    ++sFusedCount [op];
+    sPrevOp = label_nop;
+    goto done;
+
 replaceOneOperand:
     // The previous opcode has one operand, so
     // we have to go back two steps to update it.
@@ -126,8 +361,11 @@ replaceOneOperand:
 
 replaceNoOperands:
     undoEmit();
-    // ... fall through
+    emitFinalCode (op);
+    goto done;
+
 noPeephole:
+    sPrevOp = sLastOp;
     emitFinalCode (op);
     // ... fall through
 done:
@@ -475,6 +475,24 @@ do_enter_function_L1: // Arg count is in L2.
     PEEPHOLE_STORE(fmul,    F1 = DECODE_FLOAT(L1) * DECODE_FLOAT(L2); S1 = ENCODE_FLOAT(F1));
     PEEPHOLE_STORE(fdiv,    F1 = DECODE_FLOAT(L1) / DECODE_FLOAT(L2); S1 = ENCODE_FLOAT(F1));
 
+    // Superinstructions for hot blocks: these load both operands
+    // themselves instead of relying on a separate load opcode.
+
+#define FUSED_STORE(tag, code)                                                                  \
+    do_ ## tag ## _lc_S1_stack: L1 = LOCAL (READ_PC); L2 = READ_PC;         code; goto do_S1_stack; \
+    do_ ## tag ## _lc_S1_local: L1 = LOCAL (READ_PC); L2 = READ_PC;         code; goto do_S1_local; \
+    do_ ## tag ## _ll_S1_stack: L1 = LOCAL (READ_PC); L2 = LOCAL (READ_PC); code; goto do_S1_stack; \
+    do_ ## tag ## _ll_S1_local: L1 = LOCAL (READ_PC); L2 = LOCAL (READ_PC); code; goto do_S1_local
+
+    FUSED_STORE(add,     S1 = L1 + L2);
+    FUSED_STORE(sub,     S1 = L1 - L2);
+    FUSED_STORE(bitand,  S1 = L1 & L2);
+    FUSED_STORE(aload,   S1 = memRead32 (L1 + (L2<<2)));
+    FUSED_STORE(aloads,  S1 = memRead16 (L1 + (L2<<1)));
+    FUSED_STORE(aloadb,  S1 = memRead8  (L1 + L2));
+
+#undef FUSED_STORE
+
 #define PEEPHOLE_LOAD(tag,reg) \
     do_ ## tag ## _ ## reg ## _const: reg = READ_PC; goto do_ ## tag; \
     do_ ## tag ## _ ## reg ## _stack: CHECK_USED(1); reg = POP; goto do_ ## tag; \
@@ -540,6 +558,31 @@ do_enter_function_L1: // Arg count is in L2.
 
 #undef DO_JUMP
 
+    // Fused branches are laid out as the opcode, the branch
+    // address or offset, and then the operands. A 'by' offset is
+    // relative to the end of the address, so we have to adjust it
+    // for the operands we've read since.
+
+#define FUSED_JUMP(tag, cond)                                                                                  \
+    do_ ## tag ## _lc_const: L7 = READ_PC; L1 = LOCAL (READ_PC); L2 = READ_PC;         if (cond) goto do_jump_abs_L7; NEXT; \
+    do_ ## tag ## _lc_by:    L7 = READ_PC; L1 = LOCAL (READ_PC); L2 = READ_PC;         if (cond) pc += L7 - 2; NEXT;       \
+    do_ ## tag ## _ll_const: L7 = READ_PC; L1 = LOCAL (READ_PC); L2 = LOCAL (READ_PC); if (cond) goto do_jump_abs_L7; NEXT; \
+    do_ ## tag ## _ll_by:    L7 = READ_PC; L1 = LOCAL (READ_PC); L2 = LOCAL (READ_PC); if (cond) pc += L7 - 2; NEXT
+
+    FUSED_JUMP(jeq, L1 == L2);
+    FUSED_JUMP(jne, L1 != L2);
+    FUSED_JUMP(jlt, L1 < L2);
+    FUSED_JUMP(jge, L1 >= L2);
+    FUSED_JUMP(jgt, L1 > L2);
+    FUSED_JUMP(jle, L1 <= L2);
+
+#undef FUSED_JUMP
+
+    do_jz_l_const:  L7 = READ_PC; L1 = LOCAL (READ_PC); if (L1 == 0) goto do_jump_abs_L7; NEXT;
+    do_jz_l_by:     L7 = READ_PC; L1 = LOCAL (READ_PC); if (L1 == 0) pc += L7 - 1; NEXT;
+    do_jnz_l_const: L7 = READ_PC; L1 = LOCAL (READ_PC); if (L1 != 0) goto do_jump_abs_L7; NEXT;
+    do_jnz_l_by:    L7 = READ_PC; L1 = LOCAL (READ_PC); if (L1 != 0) pc += L7 - 1; NEXT;
+
     do_jumpabs: L7 = L1; goto do_jump_abs_L7; NEXT;
 
     do_goto_L7_from_L7: L1 = L7; goto do_goto_L1_from_L7;
@@ -18,6 +18,18 @@
 
 #endif /* FLOAT_SUPPORT */
 
+#ifdef USE_DIRECT_THREADING
+/* With direct threading, every one-byte opcode's case in the main
+   switch is also a label, and execute_loop() jumps straight to it
+   through a table of label addresses rather than going through the
+   switch's range check and jump table. Anything not in the table
+   still goes through the switch. */
+#define OPCASE(op) case op: Exec_##op
+#define SETOP(op) (dispatch_table[op] = &&Exec_##op)
+#else /* USE_DIRECT_THREADING */
+#define OPCASE(op) case op
+#endif /* USE_DIRECT_THREADING */
+
 /* execute_loop():
    The main interpreter loop. This repeats until the program is done.
 */
@@ -41,12 +53,71 @@ void execute_loop()
 #endif /* DOUBLE_SUPPORT */
 #endif /* FLOAT_SUPPORT */
 
+#ifdef USE_DIRECT_THREADING
+  static void *dispatch_table[0x80];
+
+  for (ix=0; ix<0x80; ix++)
+    dispatch_table[ix] = &&SwitchDispatch;
+  SETOP(op_nop);
+  SETOP(op_add);
+  SETOP(op_sub);
+  SETOP(op_mul);
+  SETOP(op_div);
+  SETOP(op_mod);
+  SETOP(op_neg);
+  SETOP(op_bitand);
+  SETOP(op_bitor);
+  SETOP(op_bitxor);
+  SETOP(op_bitnot);
+  SETOP(op_shiftl);
+  SETOP(op_ushiftr);
+  SETOP(op_sshiftr);
+  SETOP(op_jump);
+  SETOP(op_jz);
+  SETOP(op_jnz);
+  SETOP(op_jeq);
+  SETOP(op_jne);
+  SETOP(op_jlt);
+  SETOP(op_jgt);
+  SETOP(op_jle);
+  SETOP(op_jge);
+  SETOP(op_jltu);
+  SETOP(op_jgtu);
+  SETOP(op_jleu);
+  SETOP(op_jgeu);
+  SETOP(op_call);
+  SETOP(op_return);
+  SETOP(op_tailcall);
+  SETOP(op_catch);
+  SETOP(op_throw);
+  SETOP(op_copy);
+  SETOP(op_copys);
+  SETOP(op_copyb);
+  SETOP(op_sexs);
+  SETOP(op_sexb);
+  SETOP(op_aload);
+  SETOP(op_aloads);
+  SETOP(op_aloadb);
+  SETOP(op_aloadbit);
+  SETOP(op_astore);
+  SETOP(op_astores);
+  SETOP(op_astoreb);
+  SETOP(op_astorebit);
+  SETOP(op_stkcount);
+  SETOP(op_stkpeek);
+  SETOP(op_stkswap);
+  SETOP(op_stkcopy);
+  SETOP(op_stkroll);
+  SETOP(op_streamchar);
+  SETOP(op_streamunichar);
+  SETOP(op_streamnum);
+  SETOP(op_streamstr);
+#endif /* USE_DIRECT_THREADING */
+
   while (!done_executing) {
 
     profile_tick();
     debugger_tick();
-    /* Do OS-specific processing, if appropriate. */
-    glk_tick();
     
     /* Stash the current opcode's address, in case the interpreter needs to serialize the VM state out-of-band. */
     prevpc = pc;
@@ -91,6 +162,12 @@ void execute_loop()
        into inst. This moves the PC up to the end of the instruction. */
     parse_operands(inst, oplist);
 
+#ifdef USE_DIRECT_THREADING
+    if (opcode < 0x80)
+      goto *dispatch_table[opcode];
+  SwitchDispatch:
+#endif /* USE_DIRECT_THREADING */
+
     /* Perform the opcode. This switch statement is split in two, based
        on some paranoid suspicions about the ability of compilers to
        optimize large-range switches. Ignore that. */
@@ -99,22 +176,22 @@ void execute_loop()
 
       switch (opcode) {
 
-      case op_nop:
+      OPCASE(op_nop):
         break;
 
-      case op_add:
+      OPCASE(op_add):
         value = inst[0].value + inst[1].value;
         store_operand(inst[2].desttype, inst[2].value, value);
         break;
-      case op_sub:
+      OPCASE(op_sub):
         value = inst[0].value - inst[1].value;
         store_operand(inst[2].desttype, inst[2].value, value);
         break;
-      case op_mul:
+      OPCASE(op_mul):
         value = inst[0].value * inst[1].value;
         store_operand(inst[2].desttype, inst[2].value, value);
         break;
-      case op_div:
+      OPCASE(op_div):
         vals0 = inst[0].value;
         vals1 = inst[1].value;
         if (vals1 == 0)
@@ -147,7 +224,7 @@ void execute_loop()
         }
         store_operand(inst[2].desttype, inst[2].value, value);
         break;
-      case op_mod:
+      OPCASE(op_mod):
         vals0 = inst[0].value;
         vals1 = inst[1].value;
         if (vals1 == 0)
@@ -168,30 +245,30 @@ void execute_loop()
         }
         store_operand(inst[2].desttype, inst[2].value, value);
         break;
-      case op_neg:
+      OPCASE(op_neg):
         vals0 = inst[0].value;
         value = (-(glui32)vals0);
         store_operand(inst[1].desttype, inst[1].value, value);
         break;
 
-      case op_bitand:
+      OPCASE(op_bitand):
         value = (inst[0].value & inst[1].value);
         store_operand(inst[2].desttype, inst[2].value, value);
         break;
-      case op_bitor:
+      OPCASE(op_bitor):
         value = (inst[0].value | inst[1].value);
         store_operand(inst[2].desttype, inst[2].value, value);
         break;
-      case op_bitxor:
+      OPCASE(op_bitxor):
         value = (inst[0].value ^ inst[1].value);
         store_operand(inst[2].desttype, inst[2].value, value);
         break;
-      case op_bitnot:
+      OPCASE(op_bitnot):
         value = ~(inst[0].value);
         store_operand(inst[1].desttype, inst[1].value, value);
         break;
 
-      case op_shiftl:
+      OPCASE(op_shiftl):
         vals0 = inst[1].value;
         if (vals0 < 0 || vals0 >= 32)
           value = 0;
@@ -199,7 +276,7 @@ void execute_loop()
           value = ((glui32)(inst[0].value) << (glui32)vals0);
         store_operand(inst[2].desttype, inst[2].value, value);
         break;
-      case op_ushiftr:
+      OPCASE(op_ushiftr):
         vals0 = inst[1].value;
         if (vals0 < 0 || vals0 >= 32)
           value = 0;
@@ -207,7 +284,7 @@ void execute_loop()
           value = ((glui32)(inst[0].value) >> (glui32)vals0);
         store_operand(inst[2].desttype, inst[2].value, value);
         break;
-      case op_sshiftr:
+      OPCASE(op_sshiftr):
         vals0 = inst[1].value;
         if (vals0 < 0 || vals0 >= 32) {
           if (inst[0].value & 0x80000000)
@@ -224,7 +301,7 @@ void execute_loop()
         store_operand(inst[2].desttype, inst[2].value, value);
         break;
 
-      case op_jump:
+      OPCASE(op_jump):
         value = inst[0].value;
         /* fall through to PerformJump label. */
 
@@ -241,36 +318,41 @@ void execute_loop()
           pop_callstub(value); /* zero or one */
         }
         else {
-          /* Branch to a new PC value. */
+          /* Branch to a new PC value. Any loop has to branch backward
+             (or call a function, or use jumpabs), so those are where
+             OS-specific processing gets a chance to run, rather than
+             at every opcode. */
+          if ((glsi32)value < 0)
+            glk_tick();
           pc = (pc + value - 2);
         }
         break;
 
-      case op_jz:
+      OPCASE(op_jz):
         if (inst[0].value == 0) {
           value = inst[1].value;
           goto PerformJump;
         }
         break;
-      case op_jnz:
+      OPCASE(op_jnz):
         if (inst[0].value != 0) {
           value = inst[1].value;
           goto PerformJump;
         }
         break;
-      case op_jeq:
+      OPCASE(op_jeq):
         if (inst[0].value == inst[1].value) {
           value = inst[2].value;
           goto PerformJump;
         }
         break;
-      case op_jne:
+      OPCASE(op_jne):
         if (inst[0].value != inst[1].value) {
           value = inst[2].value;
           goto PerformJump;
         }
         break;
-      case op_jlt:
+      OPCASE(op_jlt):
         vals0 = inst[0].value;
         vals1 = inst[1].value;
         if (vals0 < vals1) {
@@ -278,7 +360,7 @@ void execute_loop()
           goto PerformJump;
         }
         break;
-      case op_jgt:
+      OPCASE(op_jgt):
         vals0 = inst[0].value;
         vals1 = inst[1].value;
         if (vals0 > vals1) {
@@ -286,7 +368,7 @@ void execute_loop()
           goto PerformJump;
         }
         break;
-      case op_jle:
+      OPCASE(op_jle):
         vals0 = inst[0].value;
         vals1 = inst[1].value;
         if (vals0 <= vals1) {
@@ -294,7 +376,7 @@ void execute_loop()
           goto PerformJump;
         }
         break;
-      case op_jge:
+      OPCASE(op_jge):
         vals0 = inst[0].value;
         vals1 = inst[1].value;
         if (vals0 >= vals1) {
@@ -302,7 +384,7 @@ void execute_loop()
           goto PerformJump;
         }
         break;
-      case op_jltu:
+      OPCASE(op_jltu):
         val0 = inst[0].value;
         val1 = inst[1].value;
         if (val0 < val1) {
@@ -310,7 +392,7 @@ void execute_loop()
           goto PerformJump;
         }
         break;
-      case op_jgtu:
+      OPCASE(op_jgtu):
         val0 = inst[0].value;
         val1 = inst[1].value;
         if (val0 > val1) {
@@ -318,7 +400,7 @@ void execute_loop()
           goto PerformJump;
         }
         break;
-      case op_jleu:
+      OPCASE(op_jleu):
         val0 = inst[0].value;
         val1 = inst[1].value;
         if (val0 <= val1) {
@@ -326,7 +408,7 @@ void execute_loop()
           goto PerformJump;
         }
         break;
-      case op_jgeu:
+      OPCASE(op_jgeu):
         val0 = inst[0].value;
         val1 = inst[1].value;
         if (val0 >= val1) {
@@ -335,13 +417,13 @@ void execute_loop()
         }
         break;
 
-      case op_call:
+      OPCASE(op_call):
         value = inst[1].value;
         arglist = pop_arguments(value, 0);
         push_callstub(inst[2].desttype, inst[2].value);
         enter_function(inst[0].value, value, arglist);
         break;
-      case op_return:
+      OPCASE(op_return):
         leave_function();
         if (stackptr == 0) {
           done_executing = TRUE;
@@ -349,28 +431,28 @@ void execute_loop()
         }
         pop_callstub(inst[0].value);
         break;
-      case op_tailcall:
+      OPCASE(op_tailcall):
         value = inst[1].value;
         arglist = pop_arguments(value, 0);
         leave_function();
         enter_function(inst[0].value, value, arglist);
         break;
 
-      case op_catch:
+      OPCASE(op_catch):
         push_callstub(inst[0].desttype, inst[0].value);
         value = inst[1].value;
         val0 = stackptr;
         store_operand(inst[0].desttype, inst[0].value, val0);
         goto PerformJump;
         break;
-      case op_throw:
+      OPCASE(op_throw):
         profile_fail("throw");
         value = inst[0].value;
         stackptr = inst[1].value;
         pop_callstub(value);
         break;
 
-      case op_copy:
+      OPCASE(op_copy):
         value = inst[0].value;
 #ifdef TOLERATE_SUPERGLUS_BUG
         if (inst[1].desttype == 1 && inst[1].value == 0)
@@ -378,16 +460,16 @@ void execute_loop()
 #endif /* TOLERATE_SUPERGLUS_BUG */
         store_operand(inst[1].desttype, inst[1].value, value);
         break;
-      case op_copys:
+      OPCASE(op_copys):
         value = inst[0].value;
         store_operand_s(inst[1].desttype, inst[1].value, value);
         break;
-      case op_copyb:
+      OPCASE(op_copyb):
         value = inst[0].value;
         store_operand_b(inst[1].desttype, inst[1].value, value);
         break;
 
-      case op_sexs:
+      OPCASE(op_sexs):
         val0 = inst[0].value;
         if (val0 & 0x8000)
           val0 |= 0xFFFF0000;
@@ -395,7 +477,7 @@ void execute_loop()
           val0 &= 0x0000FFFF;
         store_operand(inst[1].desttype, inst[1].value, val0);
         break;
-      case op_sexb:
+      OPCASE(op_sexb):
         val0 = inst[0].value;
         if (val0 & 0x80)
           val0 |= 0xFFFFFF00;
@@ -404,25 +486,25 @@ void execute_loop()
         store_operand(inst[1].desttype, inst[1].value, val0);
         break;
 
-      case op_aload:
+      OPCASE(op_aload):
         value = inst[0].value;
         value += 4 * inst[1].value;
         val0 = Mem4(value);
         store_operand(inst[2].desttype, inst[2].value, val0);
         break;
-      case op_aloads:
+      OPCASE(op_aloads):
         value = inst[0].value;
         value += 2 * inst[1].value;
         val0 = Mem2(value);
         store_operand(inst[2].desttype, inst[2].value, val0);
         break;
-      case op_aloadb:
+      OPCASE(op_aloadb):
         value = inst[0].value;
         value += inst[1].value;
         val0 = Mem1(value);
         store_operand(inst[2].desttype, inst[2].value, val0);
         break;
-      case op_aloadbit:
+      OPCASE(op_aloadbit):
         value = inst[0].value;
         vals0 = inst[1].value;
         val1 = (vals0 & 7);
@@ -437,25 +519,25 @@ void execute_loop()
         store_operand(inst[2].desttype, inst[2].value, val0);
         break;
 
-      case op_astore:
+      OPCASE(op_astore):
         value = inst[0].value;
         value += 4 * inst[1].value;
         val0 = inst[2].value;
         MemW4(value, val0);
         break;
-      case op_astores:
+      OPCASE(op_astores):
         value = inst[0].value;
         value += 2 * inst[1].value;
         val0 = inst[2].value;
         MemW2(value, val0);
         break;
-      case op_astoreb:
+      OPCASE(op_astoreb):
         value = inst[0].value;
         value += inst[1].value;
         val0 = inst[2].value;
         MemW1(value, val0);
         break;
-      case op_astorebit:
+      OPCASE(op_astorebit):
         value = inst[0].value;
         vals0 = inst[1].value;
         val1 = (vals0 & 7);
@@ -471,18 +553,18 @@ void execute_loop()
         MemW1(value, val0);
         break;
 
-      case op_stkcount:
+      OPCASE(op_stkcount):
         value = (stackptr - valstackbase) / 4;
         store_operand(inst[0].desttype, inst[0].value, value);
         break;
-      case op_stkpeek:
+      OPCASE(op_stkpeek):
         vals0 = inst[0].value * 4;
         if (vals0 < 0 || vals0 >= (stackptr - valstackbase))
           fatal_error("Stkpeek outside current stack range.");
         value = Stk4(stackptr - (vals0+4));
         store_operand(inst[1].desttype, inst[1].value, value);
         break;
-      case op_stkswap:
+      OPCASE(op_stkswap):
         if (stackptr < valstackbase+8) {
           fatal_error("Stack underflow in stkswap.");
         }
@@ -491,7 +573,7 @@ void execute_loop()
         StkW4(stackptr-4, val1);
         StkW4(stackptr-8, val0);
         break;
-      case op_stkcopy:
+      OPCASE(op_stkcopy):
         vals0 = inst[0].value;
         if (vals0 < 0)
           fatal_error("Negative operand in stkcopy.");
@@ -508,7 +590,7 @@ void execute_loop()
         }
         stackptr += vals0*4;
         break;
-      case op_stkroll:
+      OPCASE(op_stkroll):
         vals0 = inst[0].value;
         vals1 = inst[1].value;
         if (vals0 < 0)
@@ -542,25 +624,25 @@ void execute_loop()
         }
         break;
 
-      case op_streamchar:
+      OPCASE(op_streamchar):
         profile_in(0xE0000001, stackptr, FALSE);
         value = inst[0].value & 0xFF;
         (*stream_char_handler)(value);
         profile_out(stackptr);
         break;
-      case op_streamunichar:
+      OPCASE(op_streamunichar):
         profile_in(0xE0000002, stackptr, FALSE);
         value = inst[0].value;
         (*stream_unichar_handler)(value);
         profile_out(stackptr);
         break;
-      case op_streamnum:
+      OPCASE(op_streamnum):
         profile_in(0xE0000003, stackptr, FALSE);
         vals0 = inst[0].value;
         stream_num(vals0, FALSE, 0);
         profile_out(stackptr);
         break;
-      case op_streamstr:
+      OPCASE(op_streamstr):
         profile_in(0xE0000004, stackptr, FALSE);
         stream_string(inst[0].value, 0, 0);
         profile_out(stackptr);
@@ -592,6 +674,7 @@ void execute_loop()
         fatal_error_i("user debugtrap encountered.", inst[0].value);
 
       case op_jumpabs:
+        glk_tick();
         pc = inst[0].value;
         break;
 
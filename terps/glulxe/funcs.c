@@ -22,6 +22,9 @@ void enter_function(glui32 funcaddr, glui32 argc, glui32 *argv)
   int loctype, locnum;
   glui32 addr = funcaddr;
 
+  /* Do OS-specific processing, if appropriate. See execute_loop(). */
+  glk_tick();
+
   accelfunc = accel_get_func(addr);
   if (accelfunc) {
     profile_in(addr, stackptr, TRUE);
@@ -164,6 +164,7 @@ static glui32 *grab_temp_i_array(glui32 addr, glui32 len, int passin);
 static void release_temp_i_array(glui32 *arr, glui32 addr, glui32 len, int passout);
 static void **grab_temp_ptr_array(glui32 addr, glui32 len, int objclass, int passin);
 static void release_temp_ptr_array(void **arr, glui32 addr, glui32 len, int objclass, int passout);
+static void mark_raw_array(void *array, glui32 len);
 
 static void prepare_glk_args(char *proto, dispatch_splot_t *splot);
 static void parse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
@@ -1357,6 +1358,7 @@ static gidispatch_rock_t glulxe_retained_register(void *array,
     elemsize = 4;
 
   if (!elemsize || array == NULL) {
+    mark_raw_array(array, len);
     rock.ptr = NULL;
     return rock;
   }
@@ -1391,6 +1393,7 @@ static void glulxe_retained_unregister(void *array, glui32 len,
     elemsize = 4;
 
   if (!elemsize || array == NULL) {
+    mark_raw_array(array, len);
     return;
   }
 
@@ -1428,6 +1431,25 @@ static void glulxe_retained_unregister(void *array, glui32 len,
   glulx_free(arref);
 }
 
+/* mark_raw_array():
+   An array with no element size is passed to the library as a pointer
+   straight into main memory, so the library writes it without going
+   through MemW. Mark its pages for undo when it is retained and when
+   it is released; the library may have written to it in between.
+*/
+static void mark_raw_array(void *array, glui32 len)
+{
+  unsigned char *buf = (unsigned char *)array;
+  glui32 addr;
+
+  if (buf == NULL || buf < memmap || buf >= memmap + endmem)
+    return;
+  addr = buf - memmap;
+  if (len > endmem - addr)
+    len = endmem - addr;
+  undo_mark_range(addr, addr + len);
+}
+
 static long glulxe_array_locate(void *array, glui32 len,
   char *typecode, gidispatch_rock_t objrock, int *elemsizeref)
 {
@@ -62,6 +62,11 @@ typedef int16_t glsi16;
    see the Makefile. */
 /* #define VM_DEBUGGER (1) */
 
+/* Define this to dispatch opcodes through a table of label addresses
+   (GCC's labels-as-values extension) rather than a switch statement.
+   The build turns this on for compilers which support it. */
+/* #define USE_DIRECT_THREADING (1) */
+
 /* Comment these definitions to turn off floating-point support. You
    might need to do this if you are building on a very limited platform
    with no math library.
@@ -78,6 +83,12 @@ typedef int16_t glsi16;
    every time. */
 #define SERIALIZE_CACHE_RAM (1)
 
+/* Comment this definition to turn off memoizing of compressed strings.
+   When it's on, a compressed string in ROM which is printed more than
+   once is decoded in full and kept, so that later prints go out as a
+   single buffer. This costs a little memory. */
+#define STRING_MEMO (1)
+
 /* Some macros to read and write integers to memory, always in big-endian
    format. */
 #define Read4(ptr)    \
@@ -102,10 +113,19 @@ typedef int16_t glsi16;
 #define Write1(ptr, vl)   \
   (((unsigned char *)(ptr))[0] = (vl))
 
+/* The range checks are made inline, since they happen on every access;
+   the verify functions are only called to report a failure. Like the
+   access macros, these evaluate adr more than once. */
 #if VERIFY_MEMORY_ACCESS
-#define Verify(adr, ln) verify_address(adr, ln)
-#define VerifyW(adr, ln) verify_address_write(adr, ln)
-#define VerifyStk(adr, ln) verify_address_stack(adr, ln)
+#define Verify(adr, ln)  \
+  (((adr) >= endmem || (adr)+((ln)-1) >= endmem)  \
+    ? verify_address(adr, ln) : (void)0)
+#define VerifyW(adr, ln)  \
+  (((adr) < ramstart || (adr) >= endmem || (adr)+((ln)-1) >= endmem)  \
+    ? verify_address_write(adr, ln) : (void)0)
+#define VerifyStk(adr, ln)  \
+  (((adr) >= stacksize || (adr)+(ln) > stacksize || ((adr) & ((ln)-1)))  \
+    ? verify_address_stack(adr, ln) : (void)0)
 #else
 #define Verify(adr, ln) (0)
 #define VerifyW(adr, ln) (0)
@@ -115,9 +135,20 @@ typedef int16_t glsi16;
 #define Mem1(adr)  (Verify(adr, 1), Read1(memmap+(adr)))
 #define Mem2(adr)  (Verify(adr, 2), Read2(memmap+(adr)))
 #define Mem4(adr)  (Verify(adr, 4), Read4(memmap+(adr)))
-#define MemW1(adr, vl)  (VerifyW(adr, 1), Write1(memmap+(adr), (vl)))
-#define MemW2(adr, vl)  (VerifyW(adr, 2), Write2(memmap+(adr), (vl)))
-#define MemW4(adr, vl)  (VerifyW(adr, 4), Write4(memmap+(adr), (vl)))
+#define MemW1(adr, vl)  (VerifyW(adr, 1), MarkW(adr, 1), Write1(memmap+(adr), (vl)))
+#define MemW2(adr, vl)  (VerifyW(adr, 2), MarkW(adr, 2), Write2(memmap+(adr), (vl)))
+#define MemW4(adr, vl)  (VerifyW(adr, 4), MarkW(adr, 4), Write4(memmap+(adr), (vl)))
+
+/* Every write to main memory marks the page (or two pages) it touches
+   in undo_dirty_pages. This lets perform_saveundo() store only the
+   pages which have changed since the previous undo state, rather than
+   walking all of RAM. Pages are 256 bytes, which is also the
+   granularity of ramstart and endmem, so no page straddles either. */
+#define UNDO_PAGE_SHIFT (8)
+#define UNDO_PAGE_SIZE (1 << UNDO_PAGE_SHIFT)
+#define MarkW(adr, ln)  \
+  ((undo_dirty_pages[(adr) >> UNDO_PAGE_SHIFT] = 1),  \
+   (undo_dirty_pages[((adr)+(ln)-1) >> UNDO_PAGE_SHIFT] = 1))
 
 /* Macros to access values on the stack. These *must* be used 
    with proper alignment! (That is, Stk4 and StkW4 must take 
@@ -160,6 +191,7 @@ typedef struct operandlist_struct {
   int num_ops; /* Number of operands for this opcode */
   int arg_size; /* Usually 4, but can be 1 or 2 */
   int *formlist; /* Array of values, either modeform_Load or modeform_Store */
+  void (*parser)(oparg_t *args); /* Unrolled parser for this list, if any */
 } operandlist_t;
 #define modeform_Load (1)
 #define modeform_Store (2)
@@ -265,6 +297,8 @@ extern void heap_sanity_check(void);
 
 /* serial.c */
 extern int max_undo_level;
+extern unsigned char *undo_dirty_pages;
+extern void undo_mark_range(glui32 start, glui32 end);
 extern int init_serial(void);
 extern void final_serial(void);
 extern glui32 perform_save(strid_t str);
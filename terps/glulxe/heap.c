@@ -12,8 +12,27 @@ typedef struct heapblock_struct {
   int isfree;
   struct heapblock_struct *next;
   struct heapblock_struct *prev;
+  /* For a free block, its position in its size class's queue. */
+  glui32 queuepos;
+  /* For an allocated block, the next block in its bucket of the
+     allocation table. */
+  struct heapblock_struct *hashnext;
 } heapblock_t;
 
+/* A size class holds the free blocks whose length has the given
+   highest bit set: class N holds lengths 2^N through 2^(N+1)-1. */
+#define NUM_SIZE_CLASSES (32)
+
+/* The free blocks of a size class are kept in a binary heap (a
+   priority queue, not to be confused with the Glulx heap) ordered by
+   address, so the lowest-addressed free block of the class is always
+   blocks[0]. */
+typedef struct sizeclass_struct {
+  heapblock_t **blocks;
+  glui32 count;
+  glui32 allocsize;
+} sizeclass_t;
+
 static glui32 heap_start = 0; /* zero for inactive heap */
 static int alloc_count = 0;
 
@@ -26,21 +45,47 @@ static int alloc_count = 0;
    (Heap_start is never the same as end_mem; if there is no heap space,
    then the heap is inactive and heap_start is zero.)
 
-   Adjacent free blocks may be merged at heap_alloc() time.
-
-   ### To make alloc more efficient, we could keep a separate
-   free-list. To make free more efficient, we could keep a hash
-   table of allocations.
+   Adjacent free blocks are merged when a block is freed, so no two
+   free blocks are ever adjacent.
+
+   Allocation is first-fit: the new block goes at the start of the
+   lowest-addressed free block which is long enough. (Games don't care
+   where their blocks go, but the addresses should not depend on the
+   interpreter version, so that recorded command scripts replay the
+   same way.) The free blocks are sorted into size classes, and
+   sizeclass_map has bit N set when class N is nonempty. Every block
+   in a class above that of the requested length fits, so the only
+   candidates from those classes are the tops of their queues; only
+   the request's own class has to be searched.
+
+   Allocated blocks are also entered in a hash table by address, so
+   that heap_free() can find them without walking the list.
  */
 static heapblock_t *heap_head = NULL;
 static heapblock_t *heap_tail = NULL;
 
+static sizeclass_t sizeclasses[NUM_SIZE_CLASSES];
+static glui32 sizeclass_map = 0;
+
+static heapblock_t **alloc_table = NULL;
+static glui32 alloc_table_size = 0; /* always a power of two */
+static glui32 alloc_table_count = 0;
+
+static int size_class(glui32 len);
+static void class_insert(heapblock_t *blo);
+static void class_remove(heapblock_t *blo);
+static heapblock_t *class_find(glui32 len);
+static void alloc_table_insert(heapblock_t *blo);
+static heapblock_t *alloc_table_remove(glui32 addr);
+
 /* heap_clear():
    Set the heap state to inactive, and free the block lists. This is
    called when the game starts or restarts.
 */
 void heap_clear()
 {
+  int ix;
+
   while (heap_head) {
     heapblock_t *blo = heap_head;
     heap_head = blo->next;
@@ -50,6 +95,18 @@ void heap_clear()
   }
   heap_tail = NULL;
 
+  /* The queue arrays are kept for reuse, but emptied. */
+  for (ix=0; ix<NUM_SIZE_CLASSES; ix++)
+    sizeclasses[ix].count = 0;
+  sizeclass_map = 0;
+
+  if (alloc_table) {
+    glulx_free(alloc_table);
+    alloc_table = NULL;
+  }
+  alloc_table_size = 0;
+  alloc_table_count = 0;
+
   if (heap_start) {
     glui32 res = change_memsize(heap_start, TRUE);
     if (res)
@@ -93,43 +150,13 @@ glui32 heap_alloc(glui32 len)
   if (len <= 0)
     fatal_error("Heap allocation length must be positive.");
 
-  blo = heap_head;
-  while (blo) {
-    if (blo->isfree && blo->len >= len)
-      break;
-
-    if (!blo->isfree) {
-      blo = blo->next;
-      continue;
-    }
+  blo = class_find(len);
 
-    if (!blo->next || !blo->next->isfree) {
-      blo = blo->next;
-      continue;
-    }
-
-    /* This is a free block, but the next block in the list is also
-       free, so we "advance" by merging rather than by going to
-       blo->next. */
-    newblo = blo->next;
-    blo->len += newblo->len;
-    if (newblo->next) {
-      blo->next = newblo->next;
-      newblo->next->prev = blo;
-    }
-    else {
-      blo->next = NULL;
-      heap_tail = blo;
-    }
-    newblo->next = NULL;
-    newblo->prev = NULL;
-    glulx_free(newblo);
-    newblo = NULL;
-    continue;
+  if (blo) {
+    class_remove(blo);
   }
-
-  if (!blo) {
-    /* No free area is visible on the list. Try extending memory. How
+  else {
+    /* No free area is big enough. Try extending memory. How
        much? Double the heap size, or by 256 bytes, or by the memory
        length requested -- whichever is greatest. */
     glui32 res;
@@ -157,6 +184,7 @@ glui32 heap_alloc(glui32 len)
     if (heap_tail && heap_tail->isfree) {
       /* Append the new space to the last block. */
       blo = heap_tail;
+      class_remove(blo);
       blo->len += extension;
     }
     else {
@@ -192,7 +220,8 @@ glui32 heap_alloc(glui32 len)
   if (!blo || !blo->isfree || blo->len < len)
     return 0;
 
-  /* We now have a free block of size len or longer. */
+  /* We now have a free block of size len or longer, which is not in
+     any size class. */
 
   if (blo->len == len) {
     blo->isfree = FALSE;
@@ -213,8 +242,10 @@ glui32 heap_alloc(glui32 len)
     blo->next = newblo;
     if (heap_tail == blo)
       heap_tail = newblo;
+    class_insert(newblo);
   }
 
+  alloc_table_insert(blo);
   alloc_count++;
   /* heap_sanity_check(); */
   return blo->addr;
@@ -227,24 +258,267 @@ glui32 heap_alloc(glui32 len)
 */
 void heap_free(glui32 addr)
 {
-  heapblock_t *blo;
+  heapblock_t *blo, *neighbor;
 
-  for (blo = heap_head; blo; blo = blo->next) { 
-    if (blo->addr == addr)
-      break;
-  };
-  if (!blo || blo->isfree)
+  blo = alloc_table_remove(addr);
+  if (!blo)
     fatal_error_i("Attempt to free unallocated address from heap.", addr);
 
   blo->isfree = TRUE;
   alloc_count--;
   if (alloc_count <= 0) {
     heap_clear();
+    return;
   }
 
+  /* Merge with the free blocks on either side, if any. */
+  neighbor = blo->prev;
+  if (neighbor && neighbor->isfree) {
+    class_remove(neighbor);
+    neighbor->len += blo->len;
+    neighbor->next = blo->next;
+    if (blo->next)
+      blo->next->prev = neighbor;
+    else
+      heap_tail = neighbor;
+    glulx_free(blo);
+    blo = neighbor;
+  }
+  neighbor = blo->next;
+  if (neighbor && neighbor->isfree) {
+    class_remove(neighbor);
+    blo->len += neighbor->len;
+    blo->next = neighbor->next;
+    if (neighbor->next)
+      neighbor->next->prev = blo;
+    else
+      heap_tail = blo;
+    glulx_free(neighbor);
+  }
+
+  class_insert(blo);
+
   /* heap_sanity_check(); */
 }
 
+/* size_class():
+   Return the size class of a (nonzero) block length.
+*/
+static int size_class(glui32 len)
+{
+  int cl = 0;
+  if (len >= 0x10000) { len >>= 16; cl += 16; }
+  if (len >= 0x100) { len >>= 8; cl += 8; }
+  if (len >= 0x10) { len >>= 4; cl += 4; }
+  if (len >= 0x4) { len >>= 2; cl += 2; }
+  if (len >= 0x2) { cl += 1; }
+  return cl;
+}
+
+/* Move the queue entry at pos toward the top until it is in order. */
+static void queue_sift_up(sizeclass_t *sc, glui32 pos)
+{
+  heapblock_t *blo = sc->blocks[pos];
+
+  while (pos > 0) {
+    glui32 parent = (pos-1) / 2;
+    if (sc->blocks[parent]->addr < blo->addr)
+      break;
+    sc->blocks[pos] = sc->blocks[parent];
+    sc->blocks[pos]->queuepos = pos;
+    pos = parent;
+  }
+  sc->blocks[pos] = blo;
+  blo->queuepos = pos;
+}
+
+/* Move the queue entry at pos toward the bottom until it is in order. */
+static void queue_sift_down(sizeclass_t *sc, glui32 pos)
+{
+  heapblock_t *blo = sc->blocks[pos];
+
+  while (1) {
+    glui32 child = 2*pos + 1;
+    if (child >= sc->count)
+      break;
+    if (child+1 < sc->count
+      && sc->blocks[child+1]->addr < sc->blocks[child]->addr)
+      child++;
+    if (blo->addr < sc->blocks[child]->addr)
+      break;
+    sc->blocks[pos] = sc->blocks[child];
+    sc->blocks[pos]->queuepos = pos;
+    pos = child;
+  }
+  sc->blocks[pos] = blo;
+  blo->queuepos = pos;
+}
+
+/* class_insert():
+   Add a free block to its size class.
+*/
+static void class_insert(heapblock_t *blo)
+{
+  int cl = size_class(blo->len);
+  sizeclass_t *sc = &sizeclasses[cl];
+
+  if (sc->count >= sc->allocsize) {
+    glui32 newsize = (sc->allocsize ? 2*sc->allocsize : 16);
+    heapblock_t **newblocks = glulx_realloc(sc->blocks,
+      newsize * sizeof(heapblock_t *));
+    if (!newblocks)
+      fatal_error("Unable to allocate heap size class.");
+    sc->blocks = newblocks;
+    sc->allocsize = newsize;
+  }
+
+  sc->blocks[sc->count] = blo;
+  sc->count++;
+  queue_sift_up(sc, sc->count-1);
+  sizeclass_map |= ((glui32)1 << cl);
+}
+
+/* class_remove():
+   Remove a free block from its size class. (Its length must not have
+   changed since it was added.)
+*/
+static void class_remove(heapblock_t *blo)
+{
+  int cl = size_class(blo->len);
+  sizeclass_t *sc = &sizeclasses[cl];
+  glui32 pos = blo->queuepos;
+
+  sc->count--;
+  if (pos < sc->count) {
+    sc->blocks[pos] = sc->blocks[sc->count];
+    sc->blocks[pos]->queuepos = pos;
+    if (pos > 0 && sc->blocks[pos]->addr < sc->blocks[(pos-1) / 2]->addr)
+      queue_sift_up(sc, pos);
+    else
+      queue_sift_down(sc, pos);
+  }
+  if (sc->count == 0)
+    sizeclass_map &= ~((glui32)1 << cl);
+}
+
+/* Search the queue entries from pos down for the lowest-addressed block
+   of at least len bytes, if it comes before best. Entries below pos
+   have higher addresses than pos itself, so the search stops at the
+   first fit on each branch. */
+static heapblock_t *queue_search(sizeclass_t *sc, glui32 pos, glui32 len,
+  heapblock_t *best)
+{
+  heapblock_t *blo;
+
+  if (pos >= sc->count)
+    return best;
+  blo = sc->blocks[pos];
+  if (best && blo->addr >= best->addr)
+    return best;
+  if (blo->len >= len)
+    return blo;
+  best = queue_search(sc, 2*pos+1, len, best);
+  best = queue_search(sc, 2*pos+2, len, best);
+  return best;
+}
+
+/* class_find():
+   Find the lowest-addressed free block of at least len bytes, or NULL
+   if there is none.
+*/
+static heapblock_t *class_find(glui32 len)
+{
+  int cl, lencl;
+  heapblock_t *best = NULL;
+
+  lencl = size_class(len);
+
+  for (cl=lencl+1; cl<NUM_SIZE_CLASSES; cl++) {
+    if (sizeclass_map & ((glui32)1 << cl)) {
+      heapblock_t *blo = sizeclasses[cl].blocks[0];
+      if (!best || blo->addr < best->addr)
+        best = blo;
+    }
+  }
+
+  if (sizeclass_map & ((glui32)1 << lencl))
+    best = queue_search(&sizeclasses[lencl], 0, len, best);
+
+  return best;
+}
+
+static glui32 alloc_table_hash(glui32 addr)
+{
+  glui32 hash = addr * (glui32)0x9E3779B1;
+  return (hash ^ (hash >> 16)) & (alloc_table_size-1);
+}
+
+/* alloc_table_insert():
+   Enter an allocated block in the allocation table, growing the table
+   if it's getting crowded.
+*/
+static void alloc_table_insert(heapblock_t *blo)
+{
+  glui32 hx;
+
+  if (alloc_table_count >= alloc_table_size) {
+    glui32 oldsize = alloc_table_size;
+    heapblock_t **oldtable = alloc_table;
+    glui32 ix;
+
+    alloc_table_size = (oldsize ? 2*oldsize : 64);
+    alloc_table = glulx_malloc(alloc_table_size * sizeof(heapblock_t *));
+    if (!alloc_table)
+      fatal_error("Unable to allocate heap allocation table.");
+    for (hx=0; hx<alloc_table_size; hx++)
+      alloc_table[hx] = NULL;
+
+    for (ix=0; ix<oldsize; ix++) {
+      heapblock_t *entry = oldtable[ix];
+      while (entry) {
+        heapblock_t *entrynext = entry->hashnext;
+        hx = alloc_table_hash(entry->addr);
+        entry->hashnext = alloc_table[hx];
+        alloc_table[hx] = entry;
+        entry = entrynext;
+      }
+    }
+    if (oldtable)
+      glulx_free(oldtable);
+  }
+
+  hx = alloc_table_hash(blo->addr);
+  blo->hashnext = alloc_table[hx];
+  alloc_table[hx] = blo;
+  alloc_table_count++;
+}
+
+/* alloc_table_remove():
+   Remove the allocated block at addr from the allocation table, and
+   return it. Returns NULL if there is no such block.
+*/
+static heapblock_t *alloc_table_remove(glui32 addr)
+{
+  heapblock_t **entryref;
+
+  if (!alloc_table)
+    return NULL;
+
+  for (entryref = &alloc_table[alloc_table_hash(addr)];
+       *entryref;
+       entryref = &(*entryref)->hashnext) {
+    heapblock_t *blo = *entryref;
+    if (blo->addr == addr) {
+      *entryref = blo->hashnext;
+      blo->hashnext = NULL;
+      alloc_table_count--;
+      return blo;
+    }
+  }
+
+  return NULL;
+}
+
 /* heap_get_summary():
    Create an array of words, in the VM serialization format:
 
@@ -373,6 +647,11 @@ int heap_apply_summary(glui32 valcount, glui32 *summary)
       heap_tail = blo;
     }
 
+    if (blo->isfree)
+      class_insert(blo);
+    else
+      alloc_table_insert(blo);
+
     lastend = blo->addr + blo->len;
   }
 
@@ -420,6 +699,8 @@ void heap_sanity_check()
 {
   heapblock_t *blo, *last;
   int livecount;
+  glui32 freecount, queuecount;
+  int cl;
 
   heap_dump();
 
@@ -441,6 +722,7 @@ void heap_sanity_check()
 
   last = NULL;
   livecount = 0;
+  freecount = 0;
 
   for (blo = heap_head; blo; last = blo, blo = blo->next) {
     glui32 lastend;
@@ -454,9 +736,40 @@ void heap_sanity_check()
     if (lastend != blo->addr)
       fatal_error("Heap sanity: addr+len mismatch.");
 
-    if (!blo->isfree)
+    if (blo->isfree) {
+      sizeclass_t *sc = &sizeclasses[size_class(blo->len)];
+      if (last && last->isfree)
+        fatal_error("Heap sanity: adjacent free blocks.");
+      if (blo->queuepos >= sc->count || sc->blocks[blo->queuepos] != blo)
+        fatal_error("Heap sanity: free block is not in its size class.");
+      freecount++;
+    }
+    else {
+      heapblock_t *entry = alloc_table[alloc_table_hash(blo->addr)];
+      while (entry && entry != blo)
+        entry = entry->hashnext;
+      if (!entry)
+        fatal_error("Heap sanity: live block is not in allocation table.");
       livecount++;
+    }
+  }
+
+  queuecount = 0;
+  for (cl=0; cl<NUM_SIZE_CLASSES; cl++) {
+    sizeclass_t *sc = &sizeclasses[cl];
+    glui32 pos;
+    if (((sizeclass_map >> cl) & 1) != (sc->count != 0))
+      fatal_error("Heap sanity: size class map is wrong.");
+    for (pos=1; pos<sc->count; pos++) {
+      if (sc->blocks[(pos-1) / 2]->addr >= sc->blocks[pos]->addr)
+        fatal_error("Heap sanity: size class queue out of order.");
+    }
+    queuecount += sc->count;
   }
+  if (queuecount != freecount)
+    fatal_error("Heap sanity: wrong number of blocks in size classes.");
+  if (alloc_table_count != livecount)
+    fatal_error("Heap sanity: wrong number of blocks in allocation table.");
 
   if (!last) {
     if (heap_start != endmem)
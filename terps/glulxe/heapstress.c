@@ -0,0 +1,320 @@
+/* heapstress.c: Stress test and benchmark for the Glulxe heap allocator.
+    Part of Gargoyle; not in the upstream Glulxe distribution.
+*/
+
+/* This is a standalone program which links against heap.c alone. It
+   runs a long random sequence of heap_alloc(), heap_free(), and
+   save/restore (heap_get_summary() and heap_apply_summary()) calls.
+
+   Every call is checked against a simple model of the heap: a sorted
+   array of the outstanding blocks. The model allocates first-fit,
+   exactly as the original linked-list allocator did -- the new block
+   goes at the start of the lowest-addressed free gap which is long
+   enough, or else memory is extended as heap_alloc() describes. Any
+   difference in the returned address, the memory size, or the
+   summary is reported as a failure. Since block addresses are visible
+   to the game, this is the guarantee that a faster allocator must
+   keep.
+
+   Usage: heapstress [-b] [seed [count]]
+
+   With -b, the model is skipped, and the program just reports how
+   long the heap calls took.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "glk.h"
+#include "glulxe.h"
+
+/* The game's memory starts at this size, and may not grow past
+   MAX_MEMSIZE. */
+#define INIT_MEMSIZE (0x10000)
+#define MAX_MEMSIZE (0x4000000)
+
+/* At most this many blocks are outstanding at once. */
+#define MAX_BLOCKS (20000)
+
+typedef struct modelblock_struct {
+  glui32 addr;
+  glui32 len;
+} modelblock_t;
+
+glui32 endmem = INIT_MEMSIZE;
+
+static modelblock_t model[MAX_BLOCKS];
+static int model_count = 0;
+static glui32 model_start = 0;
+static glui32 model_endmem = INIT_MEMSIZE;
+
+static glui32 live[MAX_BLOCKS];
+static int live_count = 0;
+
+static glui32 randstate;
+static int failures = 0;
+
+static glui32 stress_random(void);
+static glui32 random_length(int mode);
+static glui32 model_alloc(glui32 len);
+static void model_free(glui32 addr);
+static void check(int ok, char *msg, long step);
+
+/* The functions which heap.c needs from the rest of the interpreter. */
+
+void fatal_error_handler(char *str, char *arg, int useval, glsi32 val)
+{
+  printf("heapstress: fatal error: %s", str);
+  if (arg)
+    printf(" (%s)", arg);
+  if (useval)
+    printf(" (%ld)", (long)val);
+  printf("\n");
+  exit(1);
+}
+
+void *glulx_malloc(glui32 len)
+{
+  return malloc(len);
+}
+
+void *glulx_realloc(void *ptr, glui32 len)
+{
+  return realloc(ptr, len);
+}
+
+void glulx_free(void *ptr)
+{
+  free(ptr);
+}
+
+glui32 change_memsize(glui32 newlen, int internal)
+{
+  (void)internal;
+  if (newlen > MAX_MEMSIZE)
+    return 1;
+  endmem = newlen;
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  int bench = FALSE;
+  glui32 seed = 1;
+  long count = 1000000;
+  long step;
+  int argpos = 1;
+  int maxlive, mode;
+  clock_t starttime, heaptime = 0;
+
+  if (argpos < argc && !strcmp(argv[argpos], "-b")) {
+    bench = TRUE;
+    argpos++;
+  }
+  if (argpos < argc)
+    seed = strtoul(argv[argpos++], NULL, 10);
+  if (argpos < argc)
+    count = strtol(argv[argpos++], NULL, 10);
+
+  /* The seed also picks the size distribution and how crowded the
+     heap gets, so that a handful of seeds covers a range of
+     allocation patterns. */
+  randstate = seed;
+  maxlive = 1 + seed % MAX_BLOCKS;
+  mode = seed % 4;
+
+  for (step = 0; step < count; step++) {
+    glui32 roll = stress_random() % 100;
+
+    if (roll < 55 && live_count < maxlive) {
+      glui32 len = random_length(mode);
+      glui32 addr;
+
+      starttime = clock();
+      addr = heap_alloc(len);
+      heaptime += clock() - starttime;
+
+      if (!bench) {
+        glui32 expect = model_alloc(len);
+        check(addr == expect, "heap_alloc() returned the wrong address",
+          step);
+        check(endmem == model_endmem, "heap_alloc() left the wrong memsize",
+          step);
+      }
+      if (addr)
+        live[live_count++] = addr;
+    }
+    else if (roll < 99 && live_count) {
+      int ix = stress_random() % live_count;
+      glui32 addr = live[ix];
+      live[ix] = live[--live_count];
+
+      starttime = clock();
+      heap_free(addr);
+      heaptime += clock() - starttime;
+
+      if (!bench) {
+        model_free(addr);
+        check(endmem == model_endmem, "heap_free() left the wrong memsize",
+          step);
+      }
+    }
+    else {
+      /* Save the heap, and half the time restore it again, as the
+         interpreter does for save, undo, and restore. */
+      glui32 valcount, *summary;
+
+      starttime = clock();
+      if (heap_get_summary(&valcount, &summary))
+        fatal_error("heap_get_summary() failed.");
+      heaptime += clock() - starttime;
+
+      if (!bench) {
+        int ix;
+        int ok = (model_count == 0) ? (valcount == 0)
+          : (valcount == 2 + 2*(glui32)model_count
+            && summary[0] == model_start
+            && summary[1] == (glui32)model_count);
+        for (ix=0; ok && ix<model_count; ix++) {
+          ok = (summary[2+2*ix] == model[ix].addr
+            && summary[3+2*ix] == model[ix].len);
+        }
+        check(ok, "heap_get_summary() does not match the model", step);
+      }
+
+      if (summary && stress_random() % 2) {
+        glui32 oldendmem = endmem;
+        starttime = clock();
+        heap_clear();
+        endmem = oldendmem;
+        if (heap_apply_summary(valcount, summary))
+          fatal_error("heap_apply_summary() failed.");
+        heaptime += clock() - starttime;
+      }
+      if (summary)
+        glulx_free(summary);
+    }
+
+    if (failures >= 10)
+      break;
+  }
+
+  heap_clear();
+
+  printf("seed %lu: %ld operations, %s, %.3f seconds in heap calls\n",
+    (unsigned long)seed, step,
+    (bench ? "not checked" : (failures ? "FAILED" : "ok")),
+    (double)heaptime / CLOCKS_PER_SEC);
+
+  return (failures ? 1 : 0);
+}
+
+/* stress_random():
+   A small LCG, so that runs repeat on every platform.
+*/
+static glui32 stress_random()
+{
+  randstate = randstate * 1103515245 + 12345;
+  return (randstate >> 8) & 0xFFFFFF;
+}
+
+/* random_length():
+   Pick a block length. Mode 0 is small blocks, mode 1 is powers of
+   two, mode 2 is medium blocks, and mode 3 is mostly small blocks
+   with an occasional large one.
+*/
+static glui32 random_length(int mode)
+{
+  switch (mode) {
+  case 0:
+    return 1 + stress_random() % 64;
+  case 1:
+    return (glui32)1 << (stress_random() % 12);
+  case 2:
+    return 1 + stress_random() % 5000;
+  default:
+    if (stress_random() % 10 == 0)
+      return 1 + stress_random() % 100000;
+    return 1 + stress_random() % 300;
+  }
+}
+
+/* model_alloc():
+   Allocate a block in the model, the way the original first-fit
+   allocator did. Returns the address, or 0 if memory could not be
+   extended.
+*/
+static glui32 model_alloc(glui32 len)
+{
+  glui32 pos, extension;
+  int ix;
+
+  pos = model_start;
+  for (ix=0; ix<model_count; ix++) {
+    if (model[ix].addr - pos >= len)
+      break;
+    pos = model[ix].addr + model[ix].len;
+  }
+
+  if (ix == model_count && (model_start == 0 || model_endmem - pos < len)) {
+    /* Extend memory by the heap size, the requested length, or 256,
+       whichever is greatest, rounded up to a multiple of 256. The new
+       block starts at the beginning of the free space at the end of
+       the heap, if there is any. */
+    extension = 0;
+    if (model_start)
+      extension = model_endmem - model_start;
+    if (extension < len)
+      extension = len;
+    if (extension < 256)
+      extension = 256;
+    extension = (extension + 0xFF) & (~(glui32)0xFF);
+
+    if (model_endmem + extension > MAX_MEMSIZE)
+      return 0;
+    if (model_start == 0) {
+      model_start = model_endmem;
+      pos = model_endmem;
+    }
+    model_endmem += extension;
+  }
+
+  memmove(&model[ix+1], &model[ix], (model_count-ix) * sizeof(modelblock_t));
+  model[ix].addr = pos;
+  model[ix].len = len;
+  model_count++;
+  return pos;
+}
+
+/* model_free():
+   Free a block in the model. When the last block goes, the heap
+   is deactivated and memory shrinks back to where the heap started.
+*/
+static void model_free(glui32 addr)
+{
+  int ix;
+
+  for (ix=0; ix<model_count; ix++) {
+    if (model[ix].addr == addr)
+      break;
+  }
+  if (ix == model_count)
+    fatal_error_i("Model freed an unallocated address.", addr);
+
+  model_count--;
+  memmove(&model[ix], &model[ix+1], (model_count-ix) * sizeof(modelblock_t));
+
+  if (model_count == 0) {
+    model_endmem = model_start;
+    model_start = 0;
+  }
+}
+
+static void check(int ok, char *msg, long step)
+{
+  if (ok)
+    return;
+  printf("heapstress: step %ld: %s\n", step, msg);
+  failures++;
+}
@@ -7,8 +7,28 @@
 #include "glulxe.h"
 #include "opcodes.h"
 
-/* ### We could save a few cycles per operand by generating a function for
-   each operandlist type. */
+/* The two operand decoders below are forced inline where the compiler
+   allows it, so that each parser gets its own copy of the mode switch. */
+#if defined(__GNUC__)
+#define GLULXE_INLINE static inline __attribute__((always_inline))
+#else
+#define GLULXE_INLINE static inline
+#endif
+
+GLULXE_INLINE glui32 load_operand(int mode, int argsize);
+GLULXE_INLINE void store_operand_dest(oparg_t *arg, int mode);
+
+/* Unrolled parsers for the commonest operand lists, all of which have
+   four-byte operands. Each does exactly what parse_operands() would, in
+   the same order, but without looping over the formlist or testing the
+   arg_size. */
+static void parse_L(oparg_t *args);
+static void parse_LL(oparg_t *args);
+static void parse_LLL(oparg_t *args);
+static void parse_S(oparg_t *args);
+static void parse_LS(oparg_t *args);
+static void parse_LLS(oparg_t *args);
+static void parse_LLLS(oparg_t *args);
 
 /* fast_operandlist[]:
    This is a handy array in which to look up operandlists quickly.
@@ -22,13 +42,13 @@ const operandlist_t *fast_operandlist[0x80];
 static operandlist_t list_none = { 0, 4, NULL };
 
 static int array_S[1] = { modeform_Store };
-static operandlist_t list_S = { 1, 4, array_S };
+static operandlist_t list_S = { 1, 4, array_S, parse_S };
 static int array_LS[2] = { modeform_Load, modeform_Store };
-static operandlist_t list_LS = { 2, 4, array_LS };
+static operandlist_t list_LS = { 2, 4, array_LS, parse_LS };
 static int array_LLS[3] = { modeform_Load, modeform_Load, modeform_Store };
-static operandlist_t list_LLS = { 3, 4, array_LLS };
+static operandlist_t list_LLS = { 3, 4, array_LLS, parse_LLS };
 static int array_LLLS[4] = { modeform_Load, modeform_Load, modeform_Load, modeform_Store };
-static operandlist_t list_LLLS = { 4, 4, array_LLLS };
+static operandlist_t list_LLLS = { 4, 4, array_LLLS, parse_LLLS };
 static int array_LLLLS[5] = { modeform_Load, modeform_Load, modeform_Load, modeform_Load, modeform_Store };
 static operandlist_t list_LLLLS = { 5, 4, array_LLLLS };
 /* static int array_LLLLLS[6] = { modeform_Load, modeform_Load, modeform_Load, modeform_Load, modeform_Load, modeform_Store };
@@ -39,11 +59,11 @@ static int array_LLLLLLLS[8] = { modeform_Load, modeform_Load, modeform_Load, mo
 static operandlist_t list_LLLLLLLS = { 8, 4, array_LLLLLLLS };
 
 static int array_L[1] = { modeform_Load };
-static operandlist_t list_L = { 1, 4, array_L };
+static operandlist_t list_L = { 1, 4, array_L, parse_L };
 static int array_LL[2] = { modeform_Load, modeform_Load };
-static operandlist_t list_LL = { 2, 4, array_LL };
+static operandlist_t list_LL = { 2, 4, array_LL, parse_LL };
 static int array_LLL[3] = { modeform_Load, modeform_Load, modeform_Load };
-static operandlist_t list_LLL = { 3, 4, array_LLL };
+static operandlist_t list_LLL = { 3, 4, array_LLL, parse_LLL };
 static operandlist_t list_2LS = { 2, 2, array_LS };
 static operandlist_t list_1LS = { 2, 1, array_LS };
 static int array_LLLL[4] = { modeform_Load, modeform_Load, modeform_Load, modeform_Load };
@@ -341,6 +361,329 @@ const operandlist_t *lookup_operandlist(glui32 opcode)
   }
 }
 
+/* load_operand():
+   Read the value of one load operand with the given addressing mode,
+   moving the PC past any address or constant bytes. The argsize is
+   the width of a memory or locals access (4, 2, or 1).
+*/
+GLULXE_INLINE glui32 load_operand(int mode, int argsize)
+{
+  glui32 value;
+  glui32 addr;
+
+  switch (mode) {
+
+  case 8: /* pop off stack */
+    if (stackptr < valstackbase+4) {
+      fatal_error("Stack underflow in operand.");
+    }
+    stackptr -= 4;
+    value = Stk4(stackptr);
+    break;
+
+  case 0: /* constant zero */
+    value = 0;
+    break;
+
+  case 1: /* one-byte constant */
+    /* Sign-extend from 8 bits to 32 */
+    value = (glsi32)(signed char)(Mem1(pc));
+    pc++;
+    break;
+
+  case 2: /* two-byte constant */
+    /* Sign-extend the first byte from 8 bits to 32; the subsequent
+       byte must not be sign-extended. */
+    value = (glsi32)(signed char)(Mem1(pc));
+    pc++;
+    value = (value << 8) | (glui32)(Mem1(pc));
+    pc++;
+    break;
+
+  case 3: /* four-byte constant */
+    /* Bytes must not be sign-extended. */
+    value = Mem4(pc);
+    pc += 4;
+    break;
+
+  case 15: /* main memory RAM, four-byte address */
+    addr = Mem4(pc);
+    addr += ramstart;
+    pc += 4;
+    goto MainMemAddr; 
+
+  case 14: /* main memory RAM, two-byte address */
+    addr = (glui32)Mem2(pc);
+    addr += ramstart;
+    pc += 2;
+    goto MainMemAddr; 
+
+  case 13: /* main memory RAM, one-byte address */
+    addr = (glui32)(Mem1(pc));
+    addr += ramstart;
+    pc++;
+    goto MainMemAddr; 
+    
+  case 7: /* main memory, four-byte address */
+    addr = Mem4(pc);
+    pc += 4;
+    goto MainMemAddr;
+
+  case 6: /* main memory, two-byte address */
+    addr = (glui32)Mem2(pc);
+    pc += 2;
+    goto MainMemAddr;
+
+  case 5: /* main memory, one-byte address */
+    addr = (glui32)(Mem1(pc));
+    pc++;
+    /* fall through */
+
+  MainMemAddr:
+    /* cases 5, 6, 7, 13, 14, 15 all wind up here. */
+    if (argsize == 4) {
+      value = Mem4(addr);
+    }
+    else if (argsize == 2) {
+      value = Mem2(addr);
+    }
+    else {
+      value = Mem1(addr);
+    }
+    break;
+
+  case 11: /* locals, four-byte address */
+    addr = Mem4(pc);
+    pc += 4;
+    goto LocalsAddr;
+
+  case 10: /* locals, two-byte address */
+    addr = (glui32)Mem2(pc);
+    pc += 2;
+    goto LocalsAddr; 
+
+  case 9: /* locals, one-byte address */
+    addr = (glui32)(Mem1(pc));
+    pc++;
+    /* fall through */
+
+  LocalsAddr:
+    /* cases 9, 10, 11 all wind up here. It's illegal for addr to not
+       be four-byte aligned, but we don't check this explicitly. 
+       A "strict mode" interpreter probably should. It's also illegal
+       for addr to be less than zero or greater than the size of
+       the locals segment. */
+    addr += localsbase;
+    if (argsize == 4) {
+      value = Stk4(addr);
+    }
+    else if (argsize == 2) {
+      value = Stk2(addr);
+    }
+    else {
+      value = Stk1(addr);
+    }
+    break;
+
+  default:
+    value = 0;
+    fatal_error("Unknown addressing mode in load operand.");
+  }
+
+  return value;
+}
+
+/* store_operand_dest():
+   Read the destination of one store operand with the given addressing
+   mode into arg, moving the PC past any address bytes.
+*/
+GLULXE_INLINE void store_operand_dest(oparg_t *arg, int mode)
+{
+  glui32 addr;
+
+  switch (mode) {
+
+  case 0: /* discard value */
+    arg->desttype = 0;
+    arg->value = 0;
+    break;
+
+  case 8: /* push on stack */
+    arg->desttype = 3;
+    arg->value = 0;
+    break;
+
+  case 15: /* main memory RAM, four-byte address */
+    addr = Mem4(pc);
+    addr += ramstart;
+    pc += 4;
+    goto WrMainMemAddr; 
+
+  case 14: /* main memory RAM, two-byte address */
+    addr = (glui32)Mem2(pc);
+    addr += ramstart;
+    pc += 2;
+    goto WrMainMemAddr; 
+
+  case 13: /* main memory RAM, one-byte address */
+    addr = (glui32)(Mem1(pc));
+    addr += ramstart;
+    pc++;
+    goto WrMainMemAddr; 
+
+  case 7: /* main memory, four-byte address */
+    addr = Mem4(pc);
+    pc += 4;
+    goto WrMainMemAddr;
+
+  case 6: /* main memory, two-byte address */
+    addr = (glui32)Mem2(pc);
+    pc += 2;
+    goto WrMainMemAddr;
+
+  case 5: /* main memory, one-byte address */
+    addr = (glui32)(Mem1(pc));
+    pc++;
+    /* fall through */
+
+  WrMainMemAddr:
+    /* cases 5, 6, 7 all wind up here. */
+    arg->desttype = 1;
+    arg->value = addr;
+    break;
+
+  case 11: /* locals, four-byte address */
+    addr = Mem4(pc);
+    pc += 4;
+    goto WrLocalsAddr;
+
+  case 10: /* locals, two-byte address */
+    addr = (glui32)Mem2(pc);
+    pc += 2;
+    goto WrLocalsAddr; 
+
+  case 9: /* locals, one-byte address */
+    addr = (glui32)(Mem1(pc));
+    pc++;
+    /* fall through */
+
+  WrLocalsAddr:
+    /* cases 9, 10, 11 all wind up here. It's illegal for addr to not
+       be four-byte aligned, but we don't check this explicitly. 
+       A "strict mode" interpreter probably should. It's also illegal
+       for addr to be less than zero or greater than the size of
+       the locals segment. */
+    arg->desttype = 2;
+    /* We don't add localsbase here; the store address for desttype 2
+       is relative to the current locals segment, not an absolute
+       stack position. */
+    arg->value = addr;
+    break;
+
+  case 1:
+  case 2:
+  case 3:
+    fatal_error("Constant addressing mode in store operand.");
+
+  default:
+    fatal_error("Unknown addressing mode in store operand.");
+  }
+}
+
+static void parse_L(oparg_t *args)
+{
+  glui32 modeaddr = pc;
+  int modeval;
+
+  pc += 1;
+  modeval = Mem1(modeaddr);
+  args[0].desttype = 0;
+  args[0].value = load_operand(modeval & 0x0F, 4);
+}
+
+static void parse_LL(oparg_t *args)
+{
+  glui32 modeaddr = pc;
+  int modeval;
+
+  pc += 1;
+  modeval = Mem1(modeaddr);
+  args[0].desttype = 0;
+  args[0].value = load_operand(modeval & 0x0F, 4);
+  args[1].desttype = 0;
+  args[1].value = load_operand((modeval >> 4) & 0x0F, 4);
+}
+
+static void parse_LLL(oparg_t *args)
+{
+  glui32 modeaddr = pc;
+  int modeval;
+
+  pc += 2;
+  modeval = Mem1(modeaddr);
+  args[0].desttype = 0;
+  args[0].value = load_operand(modeval & 0x0F, 4);
+  args[1].desttype = 0;
+  args[1].value = load_operand((modeval >> 4) & 0x0F, 4);
+  modeval = Mem1(modeaddr+1);
+  args[2].desttype = 0;
+  args[2].value = load_operand(modeval & 0x0F, 4);
+}
+
+static void parse_S(oparg_t *args)
+{
+  glui32 modeaddr = pc;
+  int modeval;
+
+  pc += 1;
+  modeval = Mem1(modeaddr);
+  store_operand_dest(&args[0], modeval & 0x0F);
+}
+
+static void parse_LS(oparg_t *args)
+{
+  glui32 modeaddr = pc;
+  int modeval;
+
+  pc += 1;
+  modeval = Mem1(modeaddr);
+  args[0].desttype = 0;
+  args[0].value = load_operand(modeval & 0x0F, 4);
+  store_operand_dest(&args[1], (modeval >> 4) & 0x0F);
+}
+
+static void parse_LLS(oparg_t *args)
+{
+  glui32 modeaddr = pc;
+  int modeval;
+
+  pc += 2;
+  modeval = Mem1(modeaddr);
+  args[0].desttype = 0;
+  args[0].value = load_operand(modeval & 0x0F, 4);
+  args[1].desttype = 0;
+  args[1].value = load_operand((modeval >> 4) & 0x0F, 4);
+  modeval = Mem1(modeaddr+1);
+  store_operand_dest(&args[2], modeval & 0x0F);
+}
+
+static void parse_LLLS(oparg_t *args)
+{
+  glui32 modeaddr = pc;
+  int modeval;
+
+  pc += 2;
+  modeval = Mem1(modeaddr);
+  args[0].desttype = 0;
+  args[0].value = load_operand(modeval & 0x0F, 4);
+  args[1].desttype = 0;
+  args[1].value = load_operand((modeval >> 4) & 0x0F, 4);
+  modeval = Mem1(modeaddr+1);
+  args[2].desttype = 0;
+  args[2].value = load_operand(modeval & 0x0F, 4);
+  store_operand_dest(&args[3], (modeval >> 4) & 0x0F);
+}
+
 /* parse_operands():
    Read the list of operands of an instruction, and put the values
    in args. This assumes that the PC is at the beginning of the
@@ -359,12 +702,15 @@ void parse_operands(oparg_t *args, const operandlist_t *oplist)
   glui32 modeaddr = pc;
   int modeval = 0;
 
+  if (oplist->parser) {
+    oplist->parser(args);
+    return;
+  }
+
   pc += (numops+1) / 2;
 
   for (ix=0, curarg=args; ix<numops; ix++, curarg++) {
     int mode;
-    glui32 value;
-    glui32 addr;
 
     curarg->desttype = 0;
 
@@ -377,219 +723,10 @@ void parse_operands(oparg_t *args, const operandlist_t *oplist)
       modeaddr++;
     }
 
-    if (oplist->formlist[ix] == modeform_Load) {
-
-      switch (mode) {
-
-      case 8: /* pop off stack */
-        if (stackptr < valstackbase+4) {
-          fatal_error("Stack underflow in operand.");
-        }
-        stackptr -= 4;
-        value = Stk4(stackptr);
-        break;
-
-      case 0: /* constant zero */
-        value = 0;
-        break;
-
-      case 1: /* one-byte constant */
-        /* Sign-extend from 8 bits to 32 */
-        value = (glsi32)(signed char)(Mem1(pc));
-        pc++;
-        break;
-
-      case 2: /* two-byte constant */
-        /* Sign-extend the first byte from 8 bits to 32; the subsequent
-           byte must not be sign-extended. */
-        value = (glsi32)(signed char)(Mem1(pc));
-        pc++;
-        value = (value << 8) | (glui32)(Mem1(pc));
-        pc++;
-        break;
-
-      case 3: /* four-byte constant */
-        /* Bytes must not be sign-extended. */
-        value = Mem4(pc);
-        pc += 4;
-        break;
-
-      case 15: /* main memory RAM, four-byte address */
-        addr = Mem4(pc);
-        addr += ramstart;
-        pc += 4;
-        goto MainMemAddr; 
-
-      case 14: /* main memory RAM, two-byte address */
-        addr = (glui32)Mem2(pc);
-        addr += ramstart;
-        pc += 2;
-        goto MainMemAddr; 
-
-      case 13: /* main memory RAM, one-byte address */
-        addr = (glui32)(Mem1(pc));
-        addr += ramstart;
-        pc++;
-        goto MainMemAddr; 
-        
-      case 7: /* main memory, four-byte address */
-        addr = Mem4(pc);
-        pc += 4;
-        goto MainMemAddr;
-
-      case 6: /* main memory, two-byte address */
-        addr = (glui32)Mem2(pc);
-        pc += 2;
-        goto MainMemAddr;
-
-      case 5: /* main memory, one-byte address */
-        addr = (glui32)(Mem1(pc));
-        pc++;
-        /* fall through */
-
-      MainMemAddr:
-        /* cases 5, 6, 7, 13, 14, 15 all wind up here. */
-        if (argsize == 4) {
-          value = Mem4(addr);
-        }
-        else if (argsize == 2) {
-          value = Mem2(addr);
-        }
-        else {
-          value = Mem1(addr);
-        }
-        break;
-
-      case 11: /* locals, four-byte address */
-        addr = Mem4(pc);
-        pc += 4;
-        goto LocalsAddr;
-
-      case 10: /* locals, two-byte address */
-        addr = (glui32)Mem2(pc);
-        pc += 2;
-        goto LocalsAddr; 
-
-      case 9: /* locals, one-byte address */
-        addr = (glui32)(Mem1(pc));
-        pc++;
-        /* fall through */
-
-      LocalsAddr:
-        /* cases 9, 10, 11 all wind up here. It's illegal for addr to not
-           be four-byte aligned, but we don't check this explicitly. 
-           A "strict mode" interpreter probably should. It's also illegal
-           for addr to be less than zero or greater than the size of
-           the locals segment. */
-        addr += localsbase;
-        if (argsize == 4) {
-          value = Stk4(addr);
-        }
-        else if (argsize == 2) {
-          value = Stk2(addr);
-        }
-        else {
-          value = Stk1(addr);
-        }
-        break;
-
-      default:
-        value = 0;
-        fatal_error("Unknown addressing mode in load operand.");
-      }
-
-      curarg->value = value;
-
-    }
-    else {  /* modeform_Store */
-      switch (mode) {
-
-      case 0: /* discard value */
-        curarg->desttype = 0;
-        curarg->value = 0;
-        break;
-
-      case 8: /* push on stack */
-        curarg->desttype = 3;
-        curarg->value = 0;
-        break;
-
-      case 15: /* main memory RAM, four-byte address */
-        addr = Mem4(pc);
-        addr += ramstart;
-        pc += 4;
-        goto WrMainMemAddr; 
-
-      case 14: /* main memory RAM, two-byte address */
-        addr = (glui32)Mem2(pc);
-        addr += ramstart;
-        pc += 2;
-        goto WrMainMemAddr; 
-
-      case 13: /* main memory RAM, one-byte address */
-        addr = (glui32)(Mem1(pc));
-        addr += ramstart;
-        pc++;
-        goto WrMainMemAddr; 
-
-      case 7: /* main memory, four-byte address */
-        addr = Mem4(pc);
-        pc += 4;
-        goto WrMainMemAddr;
-
-      case 6: /* main memory, two-byte address */
-        addr = (glui32)Mem2(pc);
-        pc += 2;
-        goto WrMainMemAddr;
-
-      case 5: /* main memory, one-byte address */
-        addr = (glui32)(Mem1(pc));
-        pc++;
-        /* fall through */
-
-      WrMainMemAddr:
-        /* cases 5, 6, 7 all wind up here. */
-        curarg->desttype = 1;
-        curarg->value = addr;
-        break;
-
-      case 11: /* locals, four-byte address */
-        addr = Mem4(pc);
-        pc += 4;
-        goto WrLocalsAddr;
-
-      case 10: /* locals, two-byte address */
-        addr = (glui32)Mem2(pc);
-        pc += 2;
-        goto WrLocalsAddr; 
-
-      case 9: /* locals, one-byte address */
-        addr = (glui32)(Mem1(pc));
-        pc++;
-        /* fall through */
-
-      WrLocalsAddr:
-        /* cases 9, 10, 11 all wind up here. It's illegal for addr to not
-           be four-byte aligned, but we don't check this explicitly. 
-           A "strict mode" interpreter probably should. It's also illegal
-           for addr to be less than zero or greater than the size of
-           the locals segment. */
-        curarg->desttype = 2;
-        /* We don't add localsbase here; the store address for desttype 2
-           is relative to the current locals segment, not an absolute
-           stack position. */
-        curarg->value = addr;
-        break;
-
-      case 1:
-      case 2:
-      case 3:
-        fatal_error("Constant addressing mode in store operand.");
-
-      default:
-        fatal_error("Unknown addressing mode in store operand.");
-      }
-    }
+    if (oplist->formlist[ix] == modeform_Load)
+      curarg->value = load_operand(mode, argsize);
+    else
+      store_operand_dest(curarg, mode);
   }
 }
 
@@ -31,9 +31,32 @@ typedef struct dest_struct {
    code -- that is, preference code. */
 int max_undo_level = 8;
 
+/* An undo state. Main memory is not stored in full. Instead we keep
+   undo_shadow, a copy of RAM (ramstart to undo_shadowlen) as it was
+   in the most recent undo state, and undo_dirty_pages, which marks
+   every page written since then. Each undo state holds the pages that
+   differ between it and the state below it, as they were in the state
+   below, so that undo_shadow can be stepped back when the state is
+   popped. The heap and stack chunks are stored in full, as before. */
+typedef struct undostate_struct {
+  glui32 prevendmem; /* endmem in the state below this one. */
+  glui32 numpages;
+  glui32 *pagenums;
+  unsigned char *pages;
+  unsigned char *chunks;
+} undostate_t;
+
 static int undo_chain_size = 0;
 static int undo_chain_num = 0;
-static unsigned char **undo_chain = NULL;
+static undostate_t *undo_chain = NULL;
+
+/* See undostate_t. undo_dirty_pages is indexed by absolute page
+   number, and covers undo_pagecount pages. */
+unsigned char *undo_dirty_pages = NULL;
+static glui32 undo_pagecount = 0;
+static unsigned char *undo_shadow = NULL;
+static glui32 undo_shadowlen = 0;
+static glui32 undo_shadowsize = 0;
 
 #ifdef SERIALIZE_CACHE_RAM
 /* This will contain a copy of RAM (ramstate to endmem) as it exists
@@ -56,6 +79,10 @@ static int read_long(dest_t *dest, glui32 *val);
 static int write_byte(dest_t *dest, unsigned char val);
 static int read_byte(dest_t *dest, unsigned char *val);
 static int reposition_write(dest_t *dest, glui32 pos);
+static glui32 write_undo_pages(undostate_t *state);
+static void read_undo_pages(void);
+static void pop_undo_pages(undostate_t *state);
+static void free_undo_state(undostate_t *state);
 
 /* init_serial():
    Set up the undo chain and anything else that needs to be set up.
@@ -67,11 +94,20 @@ int init_serial()
   undo_chain = NULL;
   if (max_undo_level > 0) {
     undo_chain_size = max_undo_level;
-    undo_chain = (unsigned char **)glulx_malloc(sizeof(unsigned char *) * undo_chain_size);
+    undo_chain = (undostate_t *)glulx_malloc(sizeof(undostate_t) * undo_chain_size);
     if (!undo_chain)
       return FALSE;
   }
 
+  undo_pagecount = endmem >> UNDO_PAGE_SHIFT;
+  undo_dirty_pages = (unsigned char *)glulx_malloc(undo_pagecount);
+  if (!undo_dirty_pages)
+    return FALSE;
+  memset(undo_dirty_pages, 0, undo_pagecount);
+  undo_shadow = NULL;
+  undo_shadowlen = 0;
+  undo_shadowsize = 0;
+
 #ifdef SERIALIZE_CACHE_RAM
   {
     glui32 len = (endmem - ramstart);
@@ -97,7 +133,7 @@ void final_serial()
   if (undo_chain) {
     int ix;
     for (ix=0; ix<undo_chain_num; ix++) {
-      glulx_free(undo_chain[ix]);
+      free_undo_state(&undo_chain[ix]);
     }
     glulx_free(undo_chain);
   }
@@ -105,6 +141,18 @@ void final_serial()
   undo_chain_size = 0;
   undo_chain_num = 0;
 
+  if (undo_dirty_pages) {
+    glulx_free(undo_dirty_pages);
+    undo_dirty_pages = NULL;
+  }
+  undo_pagecount = 0;
+  if (undo_shadow) {
+    glulx_free(undo_shadow);
+    undo_shadow = NULL;
+  }
+  undo_shadowlen = 0;
+  undo_shadowsize = 0;
+
 #ifdef SERIALIZE_CACHE_RAM
   if (ramcache) {
     glulx_free(ramcache);
@@ -113,6 +161,29 @@ void final_serial()
 #endif /* SERIALIZE_CACHE_RAM */
 }
 
+/* undo_mark_range():
+   Mark the pages from start to end as written. This is called when
+   main memory is changed other than through the MemW macros, and
+   grows undo_dirty_pages if memory has grown past it.
+*/
+void undo_mark_range(glui32 start, glui32 end)
+{
+  glui32 firstpage = start >> UNDO_PAGE_SHIFT;
+  glui32 endpage = (end + UNDO_PAGE_SIZE - 1) >> UNDO_PAGE_SHIFT;
+
+  if (endpage > undo_pagecount) {
+    unsigned char *newpages = (unsigned char *)glulx_realloc(undo_dirty_pages, endpage);
+    if (!newpages)
+      fatal_error("Unable to allocate undo page map.");
+    memset(newpages+undo_pagecount, 0, endpage-undo_pagecount);
+    undo_dirty_pages = newpages;
+    undo_pagecount = endpage;
+  }
+
+  if (endpage > firstpage)
+    memset(undo_dirty_pages+firstpage, 1, endpage-firstpage);
+}
+
 /* perform_saveundo():
    Add a state pointer to the undo chain. This returns 0 on success,
    1 on failure.
@@ -121,17 +192,24 @@ glui32 perform_saveundo()
 {
   dest_t dest;
   glui32 res;
-  glui32 memstart=0, memlen=0, heapstart=0, heaplen=0, stackstart=0, stacklen=0;
+  glui32 heapstart=0, heaplen=0, stackstart=0, stacklen=0;
+  undostate_t state;
 
-  /* The format for undo-saves is simpler than for saves on disk. We
-     just have a memory chunk, a heap chunk, and a stack chunk, in
-     that order. We skip the IFF chunk headers (although the size
-     fields are still there.) We also don't bother with IFF's 16-bit
-     alignment. */
+  /* The format for undo-saves is simpler than for saves on disk. Main
+     memory is handled by write_undo_pages(). Otherwise we just have a
+     heap chunk and a stack chunk, in that order. We skip the IFF chunk
+     headers (although the size fields are still there.) We also don't
+     bother with IFF's 16-bit alignment. */
 
   if (undo_chain_size == 0)
     return 1;
 
+  state.prevendmem = 0;
+  state.numpages = 0;
+  state.pagenums = NULL;
+  state.pages = NULL;
+  state.chunks = NULL;
+
   dest.ismem = TRUE;
   dest.size = 0;
   dest.pos = 0;
@@ -142,14 +220,6 @@ glui32 perform_saveundo()
   if (res == 0) {
     res = write_long(&dest, 0); /* space for chunk length */
   }
-  if (res == 0) {
-    memstart = dest.pos;
-    res = write_memstate(&dest);
-    memlen = dest.pos - memstart;
-  }
-  if (res == 0) {
-    res = write_long(&dest, 0); /* space for chunk length */
-  }
   if (res == 0) {
     heapstart = dest.pos;
     res = write_heapstate(&dest, FALSE);
@@ -170,12 +240,6 @@ glui32 perform_saveundo()
     if (!dest.ptr)
       res = 1;
   }
-  if (res == 0) {
-    res = reposition_write(&dest, memstart-4);
-  }
-  if (res == 0) {
-    res = write_long(&dest, memlen);
-  }
   if (res == 0) {
     res = reposition_write(&dest, heapstart-4);
   }
@@ -189,16 +253,22 @@ glui32 perform_saveundo()
     res = write_long(&dest, stacklen);
   }
 
+  /* This must come last, because it updates undo_shadow, and so can't
+     be allowed to fail after it's done so. */
+  if (res == 0) {
+    res = write_undo_pages(&state);
+  }
+
   if (res == 0) {
     /* It worked. */
+    state.chunks = dest.ptr;
     if (undo_chain_num >= undo_chain_size) {
-      glulx_free(undo_chain[undo_chain_num-1]);
-      undo_chain[undo_chain_num-1] = NULL;
+      free_undo_state(&undo_chain[undo_chain_num-1]);
     }
     if (undo_chain_size > 1)
       memmove(undo_chain+1, undo_chain, 
-        (undo_chain_size-1) * sizeof(unsigned char *));
-    undo_chain[0] = dest.ptr;
+        (undo_chain_size-1) * sizeof(undostate_t));
+    undo_chain[0] = state;
     if (undo_chain_num < undo_chain_size)
       undo_chain_num += 1;
     dest.ptr = NULL;
@@ -239,16 +309,15 @@ glui32 perform_restoreundo()
   dest.ismem = TRUE;
   dest.size = 0;
   dest.pos = 0;
-  dest.ptr = undo_chain[0];
+  dest.ptr = undo_chain[0].chunks;
   dest.str = NULL;
 
+  heap_clear();
+
   val = 0;
-  res = 0;
-  if (res == 0) {
-    res = read_long(&dest, &val);
-  }
+  res = change_memsize(undo_shadowlen, FALSE);
   if (res == 0) {
-    res = read_memstate(&dest, val);
+    read_undo_pages();
   }
   if (res == 0) {
     res = read_long(&dest, &val);
@@ -272,11 +341,12 @@ glui32 perform_restoreundo()
 
   if (res == 0) {
     /* It worked. */
+    pop_undo_pages(&undo_chain[0]);
+    free_undo_state(&undo_chain[0]);
     if (undo_chain_size > 1)
       memmove(undo_chain, undo_chain+1,
-        (undo_chain_size-1) * sizeof(unsigned char *));
+        (undo_chain_size-1) * sizeof(undostate_t));
     undo_chain_num -= 1;
-    glulx_free(dest.ptr);
     dest.ptr = NULL;
   }
   else {
@@ -308,13 +378,156 @@ void discard_undo()
   if (undo_chain_size == 0 || undo_chain_num == 0)
     return;
 
-  unsigned char *destptr = undo_chain[0];
+  undostate_t state = undo_chain[0];
 
   if (undo_chain_size > 1)
     memmove(undo_chain, undo_chain+1,
-      (undo_chain_size-1) * sizeof(unsigned char *));
+      (undo_chain_size-1) * sizeof(undostate_t));
   undo_chain_num -= 1;
-  glulx_free(destptr);
+  pop_undo_pages(&state);
+  free_undo_state(&state);
+}
+
+/* write_undo_pages():
+   Record the pages of main memory which have changed since the most
+   recent undo state, as they were in that state, and bring undo_shadow
+   up to date. If the chain is empty, there is no earlier state to
+   record, and undo_shadow is simply refilled. Returns 0 on success;
+   on failure, nothing has been changed.
+*/
+static glui32 write_undo_pages(undostate_t *state)
+{
+  glui32 firstpage = ramstart >> UNDO_PAGE_SHIFT;
+  glui32 endpage = endmem >> UNDO_PAGE_SHIFT;
+  glui32 shadowend = undo_shadowlen >> UNDO_PAGE_SHIFT;
+  glui32 page, count, ix;
+  unsigned char *shadow;
+
+  if (undo_chain_num == 0)
+    shadowend = firstpage;
+
+  count = 0;
+  for (page=firstpage; page<shadowend; page++) {
+    if (undo_dirty_pages[page])
+      count++;
+  }
+
+  if (count) {
+    state->pagenums = (glui32 *)glulx_malloc(count * sizeof(glui32));
+    state->pages = (unsigned char *)glulx_malloc(count * UNDO_PAGE_SIZE);
+    if (!state->pagenums || !state->pages) {
+      free_undo_state(state);
+      return 1;
+    }
+  }
+
+  if (endmem - ramstart > undo_shadowsize) {
+    shadow = (unsigned char *)glulx_realloc(undo_shadow, endmem - ramstart);
+    if (!shadow) {
+      free_undo_state(state);
+      return 1;
+    }
+    undo_shadow = shadow;
+    undo_shadowsize = endmem - ramstart;
+  }
+
+  ix = 0;
+  for (page=firstpage; page<shadowend; page++) {
+    if (undo_dirty_pages[page]) {
+      state->pagenums[ix] = page;
+      memcpy(state->pages + ix*UNDO_PAGE_SIZE,
+        undo_shadow + ((page << UNDO_PAGE_SHIFT) - ramstart), UNDO_PAGE_SIZE);
+      ix++;
+    }
+  }
+  state->numpages = count;
+  state->prevendmem = (undo_chain_num == 0) ? endmem : undo_shadowlen;
+
+  if (undo_chain_num == 0) {
+    memcpy(undo_shadow, memmap+ramstart, endmem - ramstart);
+  }
+  else {
+    for (page=firstpage; page<endpage; page++) {
+      if (undo_dirty_pages[page]) {
+        memcpy(undo_shadow + ((page << UNDO_PAGE_SHIFT) - ramstart),
+          memmap + (page << UNDO_PAGE_SHIFT), UNDO_PAGE_SIZE);
+      }
+    }
+  }
+  undo_shadowlen = endmem;
+  memset(undo_dirty_pages+firstpage, 0, undo_pagecount-firstpage);
+
+  return 0;
+}
+
+/* read_undo_pages():
+   Copy every page written since the most recent undo state back from
+   undo_shadow. Memory must already have been resized to match. As with
+   a normal restore, the protected range is left alone; pages which
+   overlap it stay marked, since they may still differ from the shadow.
+*/
+static void read_undo_pages()
+{
+  glui32 firstpage = ramstart >> UNDO_PAGE_SHIFT;
+  glui32 endpage = endmem >> UNDO_PAGE_SHIFT;
+  glui32 page, pos, end;
+
+  for (page=firstpage; page<endpage; page++) {
+    if (!undo_dirty_pages[page])
+      continue;
+    pos = page << UNDO_PAGE_SHIFT;
+    end = pos + UNDO_PAGE_SIZE;
+    if (protectstart < end && protectend > pos) {
+      /* Copy around the protected range. */
+      for (; pos<end; pos++) {
+        if (pos >= protectstart && pos < protectend)
+          continue;
+        memmap[pos] = undo_shadow[pos - ramstart];
+      }
+      continue;
+    }
+    memcpy(memmap+pos, undo_shadow + (pos - ramstart), UNDO_PAGE_SIZE);
+    undo_dirty_pages[page] = 0;
+  }
+  memset(undo_dirty_pages+endpage, 0, undo_pagecount-endpage);
+}
+
+/* pop_undo_pages():
+   Step undo_shadow back from the given (most recent) state to the one
+   below it. The pages that change are marked, since memory may no
+   longer match the shadow there.
+*/
+static void pop_undo_pages(undostate_t *state)
+{
+  glui32 ix, page;
+
+  for (ix=0; ix<state->numpages; ix++) {
+    page = state->pagenums[ix];
+    memcpy(undo_shadow + ((page << UNDO_PAGE_SHIFT) - ramstart),
+      state->pages + ix*UNDO_PAGE_SIZE, UNDO_PAGE_SIZE);
+    undo_dirty_pages[page] = 1;
+  }
+
+  if (state->prevendmem < undo_shadowlen)
+    undo_mark_range(state->prevendmem, undo_shadowlen);
+  undo_shadowlen = state->prevendmem;
+}
+
+static void free_undo_state(undostate_t *state)
+{
+  if (state->pagenums) {
+    glulx_free(state->pagenums);
+    state->pagenums = NULL;
+  }
+  if (state->pages) {
+    glulx_free(state->pages);
+    state->pages = NULL;
+  }
+  if (state->chunks) {
+    glulx_free(state->chunks);
+    state->chunks = NULL;
+  }
+  state->numpages = 0;
 }
 
 /* perform_save():
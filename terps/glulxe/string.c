@@ -3,6 +3,7 @@
     http://eblong.com/zarf/glulx/index.html
 */
 
+#include <string.h>
 #include "glk.h"
 #include "glulxe.h"
 
@@ -13,25 +14,61 @@ static glui32 iosys_rock;
 #define iosys_Filter (1)
 #define iosys_Glk (2)
 
-#define CACHEBITS (4)
-#define CACHESIZE (1<<CACHEBITS) 
-#define CACHEMASK (15)
-
-typedef struct cacheblock_struct {
-  int depth; /* 1 to 4 */
-  int type;
+/* The current string-decoding table, flattened into lookup arrays.
+   The top level is indexed by the next ROOTBITS bits of the string;
+   codes longer than that continue into lower levels indexed by
+   SUBBITS bits each. An entry covers as many whole character codes
+   as fit in its bits (up to STRCHARS of them), optionally followed
+   by one other node, so common text decodes several characters per
+   lookup. */
+#define ROOTBITS (12)
+#define SUBBITS (4)
+#define STRCHARS (4)
+
+/* Entry type for "just the characters, then back to the root". The
+   other types are the node types from the Glulx spec. */
+#define strnode_None (0xFF)
+
+typedef struct stringentry_struct stringentry_t;
+struct stringentry_struct {
+  unsigned char numbits;   /* bits used by the whole entry */
+  unsigned char firstbits; /* bits used by the first character alone */
+  unsigned char numchars;
+  unsigned char type;
+  unsigned char chars[STRCHARS];
   union {
-    struct cacheblock_struct *branches;
-    unsigned char ch;
+    stringentry_t *branches;
     glui32 uch;
     glui32 addr;
   } u;
-} cacheblock_t;
+};
 
-/* The current string-decoding tables, broken out into a fast and
-   easy-to-use form. */
 static int tablecache_valid = FALSE;
-static cacheblock_t tablecache;
+static stringentry_t *tablecache = NULL;
+static glui32 tablecache_root;
+
+#ifdef STRING_MEMO
+/* A small direct-mapped memo of fully decoded strings. A ROM string
+   which is printed STRMEMO_THRESHOLD times in a row from its slot,
+   and decodes to plain characters only, is kept as text and printed
+   in one go after that. This catches room and object names, which
+   are printed over and over. */
+#define STRMEMO_SLOTS (256)
+#define STRMEMO_MAXLEN (256)
+#define STRMEMO_THRESHOLD (2)
+
+typedef struct stringmemo_struct {
+  glui32 addr;
+  glui32 count;
+  int len; /* -1 if the string can't be memoized */
+  char *text;
+} stringmemo_t;
+
+static stringmemo_t *stringmemo = NULL;
+
+static int stream_memo_string(glui32 addr);
+static void dropmemo(void);
+#endif /* STRING_MEMO */
 
 static void stream_setup_unichar(void);
 
@@ -42,10 +79,9 @@ static void filio_unichar_han(glui32 ch);
 static void glkio_unichar_nouni_han(glui32 val);
 static void (*glkio_unichar_han_ptr)(glui32 val) = NULL;
 
-static void dropcache(cacheblock_t *cablist);
-static void buildcache(cacheblock_t *cablist, glui32 nodeaddr, int depth,
-  int mask, int recdepth);
-static void dumpcache(cacheblock_t *cablist, int count, int indent);
+static void dropcache(stringentry_t *list, int tablebits);
+static stringentry_t *buildcache(glui32 nodeaddr, int tablebits,
+  int recdepth);
 
 void stream_get_iosys(glui32 *mode, glui32 *rock)
 {
@@ -194,6 +230,28 @@ void stream_num(glsi32 val, int inmiddle, int charnum)
   }
 }
 
+/* read_string_bits():
+   Read the next 24 bits of a compressed string, starting with the low
+   bit of the byte at addr. Bytes past the end of memory read as zero;
+   decoding never gets that far in a well-formed string, and the first
+   byte is always checked.
+*/
+static glui32 read_string_bits(glui32 addr)
+{
+  glui32 bits;
+
+  if (addr+2 < endmem && addr+2 > addr) {
+    return Read1(memmap+addr)
+      | ((glui32)Read1(memmap+addr+1) << 8)
+      | ((glui32)Read1(memmap+addr+2) << 16);
+  }
+
+  bits = Mem1(addr);
+  if (addr+1 < endmem)
+    bits |= ((glui32)Read1(memmap+addr+1) << 8);
+  return bits;
+}
+
 /* stream_string():
    Write a Glulx string object to the current output stream.
    inmiddle is zero if we are beginning a new string, or
@@ -211,6 +269,12 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
   if (!addr)
     fatal_error("Called stream_string with null address.");
   
+#ifdef STRING_MEMO
+  if (!inmiddle && iosys_mode == iosys_Glk && addr < ramstart
+    && stream_memo_string(addr))
+    return;
+#endif /* STRING_MEMO */
+
   while (!alldone) {
 
     if (inmiddle == 0) {
@@ -227,70 +291,31 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
 
     if (type == 0xE1) {
       if (tablecache_valid) {
-        int bits, numbits;
-        int readahead;
+        stringentry_t *table = tablecache;
+        glui32 mask = (1 << ROOTBITS) - 1;
         glui32 tmpaddr;
-        cacheblock_t *cablist;
         int done = 0;
 
-        /* bitnum is already set right */
-        bits = Mem1(addr); 
-        if (bitnum)
-          bits >>= bitnum;
-        numbits = (8 - bitnum);
-        readahead = FALSE;
-
-        if (tablecache.type != 0) {
-          /* This is a bit of a cheat. If the top-level block is not
+        if (Mem1(tablecache_root) != 0x00) {
+          /* This is a bit of a cheat. If the top-level node is not
              a branch, then it must be a string-terminator -- otherwise
-             the string would be an infinite repetition of that block.
+             the string would be an infinite repetition of that node.
              We check for this case and bail immediately. */
           done = 1;
         }
 
-        cablist = tablecache.u.branches;
         while (!done) {
-          cacheblock_t *cab;
-
-          if (numbits < CACHEBITS) {
-            /* readahead is certainly false */
-            int newbyte = Mem1(addr+1);
-            bits |= (newbyte << numbits);
-            numbits += 8;
-            readahead = TRUE;
-          }
-
-          cab = &(cablist[bits & CACHEMASK]);
-          numbits -= cab->depth;
-          bits >>= cab->depth;
-          bitnum += cab->depth;
-          if (bitnum >= 8) {
-            addr += 1;
-            bitnum -= 8;
-            if (readahead) {
-              readahead = FALSE;
-            }
-            else {
-              int newbyte = Mem1(addr);
-              bits |= (newbyte << numbits);
-              numbits += 8;
-            }
-          }
-
-          switch (cab->type) {
-          case 0x00: /* non-leaf node */
-            cablist = cab->u.branches;
-            break;
-          case 0x01: /* string terminator */
-            done = 1;
-            break;
-          case 0x02: /* single character */
-            switch (iosys_mode) {
-            case iosys_Glk:
-              glk_put_char(cab->u.ch);
-              break;
-            case iosys_Filter: 
-              ival = cab->u.ch & 0xFF;
+          /* bitnum is already set right */
+          stringentry_t *ent = &(table[(read_string_bits(addr) >> bitnum) & mask]);
+
+          if (ent->numchars) {
+            if (iosys_mode == iosys_Filter) {
+              /* Only the first character can be printed before we
+                 call the filter function. */
+              bitnum += ent->firstbits;
+              addr += (bitnum >> 3);
+              bitnum &= 7;
+              ival = ent->chars[0];
               if (!substring) {
                 push_callstub(0x11, 0);
                 substring = TRUE;
@@ -300,15 +325,37 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               enter_function(iosys_rock, 1, &ival);
               return;
             }
-            cablist = tablecache.u.branches;
+            if (iosys_mode == iosys_Glk) {
+              if (ent->numchars == 1)
+                glk_put_char(ent->chars[0]);
+              else
+                glk_put_buffer((char *)ent->chars, ent->numchars);
+            }
+          }
+
+          bitnum += ent->numbits;
+          addr += (bitnum >> 3);
+          bitnum &= 7;
+          table = tablecache;
+          mask = (1 << ROOTBITS) - 1;
+
+          switch (ent->type) {
+          case strnode_None: /* characters only */
+            break;
+          case 0x00: /* the code continues in a lower level */
+            table = ent->u.branches;
+            mask = (1 << SUBBITS) - 1;
+            break;
+          case 0x01: /* string terminator */
+            done = 1;
             break;
           case 0x04: /* single Unicode character */
             switch (iosys_mode) {
             case iosys_Glk:
-              glkio_unichar_han_ptr(cab->u.uch);
+              glkio_unichar_han_ptr(ent->u.uch);
               break;
             case iosys_Filter: 
-              ival = cab->u.uch;
+              ival = ent->u.uch;
               if (!substring) {
                 push_callstub(0x11, 0);
                 substring = TRUE;
@@ -318,14 +365,12 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               enter_function(iosys_rock, 1, &ival);
               return;
             }
-            cablist = tablecache.u.branches;
             break;
           case 0x03: /* C string */
             switch (iosys_mode) {
             case iosys_Glk:
-              for (tmpaddr=cab->u.addr; (ch=Mem1(tmpaddr)) != '\0'; tmpaddr++) 
+              for (tmpaddr=ent->u.addr; (ch=Mem1(tmpaddr)) != '\0'; tmpaddr++) 
                 glk_put_char(ch);
-              cablist = tablecache.u.branches; 
               break;
             case iosys_Filter:
               if (!substring) {
@@ -335,20 +380,16 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               pc = addr;
               push_callstub(0x10, bitnum);
               inmiddle = 0xE0;
-              addr = cab->u.addr;
+              addr = ent->u.addr;
               done = 2;
               break;
-            default:
-              cablist = tablecache.u.branches; 
-              break;
             }
             break;
           case 0x05: /* C Unicode string */
             switch (iosys_mode) {
             case iosys_Glk:
-              for (tmpaddr=cab->u.addr; (ival=Mem4(tmpaddr)) != 0; tmpaddr+=4) 
+              for (tmpaddr=ent->u.addr; (ival=Mem4(tmpaddr)) != 0; tmpaddr+=4) 
                 glkio_unichar_han_ptr(ival);
-              cablist = tablecache.u.branches; 
               break;
             case iosys_Filter:
               if (!substring) {
@@ -358,12 +399,9 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               pc = addr;
               push_callstub(0x10, bitnum);
               inmiddle = 0xE2;
-              addr = cab->u.addr;
+              addr = ent->u.addr;
               done = 2;
               break;
-            default:
-              cablist = tablecache.u.branches; 
-              break;
             }
             break;
           case 0x08:
@@ -373,10 +411,10 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
             {
               glui32 oaddr;
               int otype;
-              oaddr = cab->u.addr;
-              if (cab->type >= 0x09)
+              oaddr = ent->u.addr;
+              if (ent->type >= 0x09)
                 oaddr = Mem4(oaddr);
-              if (cab->type == 0x0B)
+              if (ent->type == 0x0B)
                 oaddr = Mem4(oaddr);
               otype = Mem1(oaddr);
               if (!substring) {
@@ -393,9 +431,9 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               else if (otype >= 0xC0 && otype <= 0xDF) {
                 glui32 argc;
                 glui32 *argv;
-                if (cab->type == 0x0A || cab->type == 0x0B) {
-                  argc = Mem4(cab->u.addr+4);
-                  argv = pop_arguments(argc, cab->u.addr+8);
+                if (ent->type == 0x0A || ent->type == 0x0B) {
+                  argc = Mem4(ent->u.addr+4);
+                  argv = pop_arguments(argc, ent->u.addr+8);
                 }
                 else {
                   argc = 0;
@@ -688,11 +726,13 @@ void stream_set_table(glui32 addr)
 
   /* Drop cache. */
   if (tablecache_valid) {
-    if (tablecache.type == 0)
-      dropcache(tablecache.u.branches);
-    tablecache.u.branches = NULL;
+    dropcache(tablecache, ROOTBITS);
+    tablecache = NULL;
     tablecache_valid = FALSE;
   }
+#ifdef STRING_MEMO
+  dropmemo();
+#endif /* STRING_MEMO */
 
   stringtable = addr;
 
@@ -704,118 +744,251 @@ void stream_set_table(glui32 addr)
     /* cache_stringtable = TRUE; ...for testing only */
     /* cache_stringtable = FALSE; ...for testing only */
     if (cache_stringtable) {
-      buildcache(&tablecache, rootaddr, CACHEBITS, 0, 0);
-      /* dumpcache(&tablecache, 1, 0); */
+      tablecache_root = rootaddr;
+      if (Mem1(rootaddr) == 0x00)
+        tablecache = buildcache(rootaddr, ROOTBITS, 0);
       tablecache_valid = TRUE;
     }
   }
 }
 
-static void buildcache(cacheblock_t *cablist, glui32 nodeaddr, int depth,
-  int mask, int recdepth)
+/* fillentry():
+   Work out what the given bits decode to, starting at nodeaddr.
+*/
+static void fillentry(stringentry_t *ent, glui32 nodeaddr, glui32 bits,
+  int numbits, int recdepth)
 {
-  int ix, type;
+  glui32 node = nodeaddr;
+  int used = 0;
+  int charbits = 0;
+  int type;
 
-  /* This gets up to 24 in large games, so I think 48 is a generous
-     maximum. If it's not, we might need a command-line parameter. */
-  if (recdepth >= 48)
-    fatal_error("Apparent infinite recursion in buildcache");
-  
-  type = Mem1(nodeaddr);
-
-  if (type == 0 && depth == CACHEBITS) {
-    cacheblock_t *list, *cab;
-    list = (cacheblock_t *)glulx_malloc(sizeof(cacheblock_t) * CACHESIZE);
-    buildcache(list, nodeaddr, 0, 0, recdepth+1);
-    cab = &(cablist[mask]);
-    cab->type = 0;
-    cab->depth = CACHEBITS;
-    cab->u.branches = list;
-    return;
-  }
+  ent->numchars = 0;
+  ent->numbits = 0;
+  ent->firstbits = 0;
+  ent->type = strnode_None;
+  ent->u.addr = 0;
 
-  if (type == 0) {
-    glui32 leftaddr  = Mem4(nodeaddr+1);
-    glui32 rightaddr = Mem4(nodeaddr+5);
-    buildcache(cablist, leftaddr, depth+1, mask, recdepth+1);
-    buildcache(cablist, rightaddr, depth+1, (mask | (1 << depth)), recdepth+1);
-    return;
-  }
+  while (TRUE) {
+    type = Mem1(node);
+
+    if (type == 0x00) {
+      if (used == numbits)
+        break;
+      if ((bits >> used) & 1)
+        node = Mem4(node+5);
+      else
+        node = Mem4(node+1);
+      used++;
+      continue;
+    }
+
+    if (type == 0x02 && ent->numchars < STRCHARS) {
+      ent->chars[ent->numchars++] = Mem1(node+1);
+      if (ent->numchars == 1)
+        ent->firstbits = used;
+      charbits = used;
+      node = tablecache_root;
+      continue;
+    }
+
+    if (type == 0x02) {
+      /* No room for another character; it'll start the next entry. */
+      ent->numbits = charbits;
+      return;
+    }
 
-  /* Leaf node. */
-  nodeaddr++;
-  for (ix = mask; ix < CACHESIZE; ix += (1 << depth)) {
-    cacheblock_t *cab = &(cablist[ix]);
-    cab->type = type;
-    cab->depth = depth;
+    /* Any other leaf node ends the entry. */
+    ent->numbits = used;
+    ent->type = type;
+    node++;
     switch (type) {
-    case 0x02:
-      cab->u.ch = Mem1(nodeaddr);
-      break;
     case 0x04:
-      cab->u.uch = Mem4(nodeaddr);
+      ent->u.uch = Mem4(node);
       break;
     case 0x03:
     case 0x05:
     case 0x0A:
     case 0x0B:
-      cab->u.addr = nodeaddr;
+      ent->u.addr = node;
       break;
     case 0x08:
     case 0x09:
-      cab->u.addr = Mem4(nodeaddr);
+      ent->u.addr = Mem4(node);
       break;
     }
+    return;
   }
+
+  /* We ran out of bits partway through a code. If we've decoded some
+     characters, stop after them and let the next lookup start the
+     code again from the root. Otherwise, carry on in a lower level. */
+  if (ent->numchars) {
+    ent->numbits = charbits;
+    return;
+  }
+  ent->numbits = numbits;
+  ent->type = 0x00;
+  ent->u.branches = buildcache(node, SUBBITS, recdepth+1);
+}
+
+static stringentry_t *buildcache(glui32 nodeaddr, int tablebits,
+  int recdepth)
+{
+  glui32 ix, count;
+  stringentry_t *list;
+
+  /* This gets up to 24 in large games, so I think 48 is a generous
+     maximum. If it's not, we might need a command-line parameter. */
+  if (recdepth >= 48)
+    fatal_error("Apparent infinite recursion in buildcache");
+
+  count = 1 << tablebits;
+  list = (stringentry_t *)glulx_malloc(sizeof(stringentry_t) * count);
+  if (!list)
+    fatal_error("Unable to allocate string decoding table.");
+
+  for (ix=0; ix<count; ix++)
+    fillentry(&(list[ix]), nodeaddr, ix, tablebits, recdepth);
+
+  return list;
 }
 
-#if 0
-#include <stdio.h>
-static void dumpcache(cacheblock_t *cablist, int count, int indent)
+static void dropcache(stringentry_t *list, int tablebits)
 {
-  int ix, jx;
+  glui32 ix, count;
+
+  if (!list)
+    return;
 
+  count = 1 << tablebits;
   for (ix=0; ix<count; ix++) {
-    cacheblock_t *cab = &(cablist[ix]); 
-    for (jx=0; jx<indent; jx++)
-      printf("  ");
-    printf("%X: ", ix);
-    switch (cab->type) {
-    case 0:
-      printf("...\n");
-      dumpcache(cab->u.branches, CACHESIZE, indent+1);
-      break;
-    case 1:
-      printf("<EOS>\n");
-      break;
-    case 2:
-      printf("0x%02X", cab->u.ch);
-      if (cab->u.ch < 32)
-        printf(" ''\n");
-      else
-        printf(" '%c'\n", cab->u.ch);
-      break;
-    default:
-      printf("type %02X, address %06lX\n", cab->type, cab->u.addr);
+    if (list[ix].type == 0x00) {
+      dropcache(list[ix].u.branches, SUBBITS);
+      list[ix].u.branches = NULL;
+    }
+  }
+  glulx_free(list);
+}
+
+#ifdef STRING_MEMO
+
+/* stream_memo_string():
+   Print a compressed string from the memo, if it's there, and
+   return TRUE. Otherwise count it, and memoize it if it's printed
+   often enough. Only called in Glk mode, for strings in ROM.
+*/
+static int stream_memo_string(glui32 addr)
+{
+  stringmemo_t *memo;
+  glui32 straddr, bits;
+  int bitnum, len;
+  char buf[STRMEMO_MAXLEN];
+
+  if (!tablecache_valid || !tablecache || Mem1(addr) != 0xE1)
+    return FALSE;
+
+  if (!stringmemo) {
+    stringmemo = (stringmemo_t *)glulx_malloc(sizeof(stringmemo_t) * STRMEMO_SLOTS);
+    if (!stringmemo)
+      return FALSE;
+    for (len=0; len<STRMEMO_SLOTS; len++) {
+      stringmemo[len].addr = 0;
+      stringmemo[len].count = 0;
+      stringmemo[len].len = 0;
+      stringmemo[len].text = NULL;
+    }
+  }
+
+  memo = &(stringmemo[(addr ^ (addr >> 8)) & (STRMEMO_SLOTS-1)]);
+  if (memo->addr == addr && memo->text) {
+    glk_put_buffer(memo->text, memo->len);
+    return TRUE;
+  }
+
+  if (memo->addr != addr) {
+    if (memo->text) {
+      glulx_free(memo->text);
+      memo->text = NULL;
+    }
+    memo->addr = addr;
+    memo->count = 0;
+    memo->len = 0;
+  }
+  if (memo->len < 0 || ++memo->count < STRMEMO_THRESHOLD)
+    return FALSE;
+
+  /* Decode the string, giving up if it contains anything but plain
+     characters or runs out of ROM. */
+  straddr = addr+1;
+  bitnum = 0;
+  len = 0;
+  while (TRUE) {
+    stringentry_t *table = tablecache;
+    glui32 mask = (1 << ROOTBITS) - 1;
+    stringentry_t *ent;
+
+    while (TRUE) {
+      if (straddr >= ramstart) {
+        memo->len = -1;
+        return FALSE;
+      }
+      bits = read_string_bits(straddr) >> bitnum;
+      ent = &(table[bits & mask]);
+      if (len + ent->numchars > STRMEMO_MAXLEN) {
+        memo->len = -1;
+        return FALSE;
+      }
+      memcpy(buf+len, ent->chars, ent->numchars);
+      len += ent->numchars;
+      bitnum += ent->numbits;
+      straddr += (bitnum >> 3);
+      bitnum &= 7;
+      if (straddr > ramstart || (straddr == ramstart && bitnum)) {
+        memo->len = -1;
+        return FALSE;
+      }
+      if (ent->type != 0x00)
+        break;
+      table = ent->u.branches;
+      mask = (1 << SUBBITS) - 1;
+    }
+
+    if (ent->type == 0x01)
       break;
+    if (ent->type != strnode_None) {
+      memo->len = -1;
+      return FALSE;
     }
   }
+
+  memo->text = (char *)glulx_malloc(len ? len : 1);
+  if (!memo->text)
+    return FALSE;
+  memcpy(memo->text, buf, len);
+  memo->len = len;
+
+  glk_put_buffer(memo->text, memo->len);
+  return TRUE;
 }
-#endif /* 0 */
 
-static void dropcache(cacheblock_t *cablist)
+static void dropmemo()
 {
   int ix;
-  for (ix=0; ix<CACHESIZE; ix++) {
-    cacheblock_t *cab = &(cablist[ix]);
-    if (cab->type == 0) {
-      dropcache(cab->u.branches);
-      cab->u.branches = NULL;
-    }
+
+  if (!stringmemo)
+    return;
+
+  for (ix=0; ix<STRMEMO_SLOTS; ix++) {
+    if (stringmemo[ix].text)
+      glulx_free(stringmemo[ix].text);
   }
-  glulx_free(cablist);
+  glulx_free(stringmemo);
+  stringmemo = NULL;
 }
 
+#endif /* STRING_MEMO */
+
 /* This misbehaves if a Glk function has more than one S argument. */
 
 #define STATIC_TEMP_BUFSIZE (127)
@@ -187,6 +187,7 @@ void vm_restart()
   for (lx=endgamefile; lx<origendmem; lx++) {
     memmap[lx] = 0;
   }
+  undo_mark_range(ramstart, origendmem);
 
   /* Reset all the registers */
   stackptr = 0;
@@ -245,6 +246,10 @@ glui32 change_memsize(glui32 newlen, int internal)
     for (lx=endmem; lx<newlen; lx++) {
       memmap[lx] = 0;
     }
+    undo_mark_range(endmem, newlen);
+  }
+  else {
+    undo_mark_range(newlen, endmem);
   }
 
   endmem = newlen;
@@ -281,6 +281,9 @@ typedef struct Win32Dir *osdirhdl_t;
 typedef DIR* osdirhdl_t;
 #endif
 
+/* Memory-mapped file handle for os_map_file() and os_unmap_file(). */
+typedef struct os_file_map *osfmaphdl_t;
+
 /* file type/mode bits */
 #define OSFMODE_FILE    S_IFREG
 #define OSFMODE_DIR     S_IFDIR
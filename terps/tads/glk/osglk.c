@@ -618,6 +618,41 @@ int os_askfile(const char *prompt, char *fname_buf, int fname_buf_len,
 #endif
 }
 
+/*
+ *   Idle-time work.  The VM can register a routine to be run while the
+ *   player is typing; see os_set_idle_func() in osglk.h.
+ */
+static int (*idle_func)(void *) = NULL;
+static void *idle_ctx = NULL;
+
+void os_set_idle_func(int (*func)(void *ctx), void *ctx)
+{
+    idle_func = func;
+    idle_ctx = ctx;
+}
+
+/*
+ *   Wait for an event, running the idle routine while nothing else is
+ *   going on.  We poll between calls so the window stays responsive.
+ *   glk_select_poll() never returns input events, so once the idle routine
+ *   runs out of work we block in glk_select() to collect whatever the
+ *   player typed in the meantime.
+ */
+static void glk_select_idle(event_t *event)
+{
+    while (idle_func != NULL)
+    {
+        glk_select_poll(event);
+        if (event->type != evtype_None)
+            return;
+
+        if (!idle_func(idle_ctx))
+            idle_func = NULL;
+    }
+
+    glk_select(event);
+}
+
 /* 
  *   Read a string of input.  Fills in the buffer with a null-terminated
  *   string containing a line of text read from the standard input.  The
@@ -633,7 +668,7 @@ unsigned char *os_gets(unsigned char *buf, size_t buflen)
 
     do
     {
-        glk_select(&event);
+        glk_select_idle(&event);
         if (event.type == evtype_Arrange)
             redraw_windows();
     }
@@ -750,7 +785,7 @@ int os_gets_timeout(unsigned char *buf, size_t bufl,
 
     do
     {
-        glk_select(&event);
+        glk_select_idle(&event);
         if (event.type == evtype_Arrange)
             redraw_windows();
         else if (event.type == evtype_Timer && (timeout = 1))
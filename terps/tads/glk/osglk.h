@@ -116,6 +116,9 @@ typedef struct Win32Dir *osdirhdl_t;
 typedef DIR* osdirhdl_t;
 #endif
 
+/* Memory-mapped file handle for os_map_file() and os_unmap_file(). */
+typedef struct os_file_map *osfmaphdl_t;
+
 /* file type/mode bits */
 #define OSFMODE_FILE    S_IFREG
 #define OSFMODE_DIR     S_IFDIR
@@ -330,6 +333,13 @@ void os_put_buffer (unsigned char *buf, size_t len);
 void os_get_buffer (unsigned char *buf, size_t len, size_t init);
 unsigned char *os_fill_buffer (unsigned char *buf, size_t len);
 
+/*
+ *   Register a routine to run while we're waiting for a line of input.  The
+ *   routine is called repeatedly, doing a small amount of work per call,
+ *   for as long as it returns true.  Pass a null function to unregister.
+ */
+void os_set_idle_func(int (*func)(void *ctx), void *ctx);
+
 #define OS_MAXWIDTH 255
 
 #define OS_ATTR_HILITE  OS_ATTR_BOLD
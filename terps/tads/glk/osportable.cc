@@ -50,11 +50,13 @@
 #include <time.h>
 #ifndef _WIN32
 #include <dirent.h>
+#include <sys/mman.h>
 #endif
 #include <limits.h>
 
 #if defined(_WIN32)
 #include <windows.h>
+#include <io.h>
 #ifndef PATH_MAX
 #define PATH_MAX MAX_PATH
 #endif
@@ -420,6 +422,99 @@ osfdup(osfildef *orig, const char *mode)
 }
 
 
+/* Memory-mapped file.
+ */
+struct os_file_map {
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+    void *base;
+    size_t size;
+};
+
+/* Map a file into memory for reading.
+ */
+const char*
+os_map_file( osfildef* fp, long ofs, unsigned long* len, osfmaphdl_t* handle )
+{
+#ifdef EMGLKEN
+    /* Glk streams don't give us a file descriptor to map. */
+    return 0;
+#else /* EMGLKEN */
+    if (ofs < 0)
+        return 0;
+
+#ifdef _WIN32
+    HANDLE fh = (HANDLE)_get_osfhandle(_fileno(fp));
+    LARGE_INTEGER fsize;
+    if (fh == INVALID_HANDLE_VALUE || !GetFileSizeEx(fh, &fsize)
+        || fsize.QuadPart <= ofs
+        || (unsigned long long)fsize.QuadPart > SIZE_MAX
+        || (unsigned long long)fsize.QuadPart > ULONG_MAX)
+        return 0;
+    size_t size = (size_t)fsize.QuadPart;
+
+    HANDLE mapping = CreateFileMappingA(fh, 0, PAGE_READONLY, 0, 0, 0);
+    if (mapping == 0)
+        return 0;
+    void *base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (base == 0) {
+        CloseHandle(mapping);
+        return 0;
+    }
+#else /* _WIN32 */
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode)
+        || st.st_size <= ofs
+        || (unsigned long long)st.st_size > SIZE_MAX
+        || (unsigned long long)st.st_size > ULONG_MAX)
+        return 0;
+    size_t size = (size_t)st.st_size;
+
+    void *base = mmap(0, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (base == MAP_FAILED)
+        return 0;
+#endif /* _WIN32 */
+
+    os_file_map *map = (os_file_map *)malloc(sizeof(os_file_map));
+    if (map == 0) {
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+        CloseHandle(mapping);
+#else
+        munmap(base, size);
+#endif
+        return 0;
+    }
+#ifdef _WIN32
+    map->mapping = mapping;
+#endif
+    map->base = base;
+    map->size = size;
+
+    *len = (unsigned long)(size - ofs);
+    *handle = map;
+    return (const char *)base + ofs;
+#endif /* EMGLKEN */
+}
+
+/* Release a file mapping.
+ */
+void
+os_unmap_file( osfmaphdl_t handle )
+{
+#ifndef EMGLKEN
+#ifdef _WIN32
+    UnmapViewOfFile(handle->base);
+    CloseHandle(handle->mapping);
+#else
+    munmap(handle->base, handle->size);
+#endif
+    free(handle);
+#endif /* EMGLKEN */
+}
+
+
 /* Convert string to all-lowercase.
  */
 char*
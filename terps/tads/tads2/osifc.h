@@ -1119,6 +1119,32 @@ long os_get_sys_clock_ms(void);
  */
 osfildef *osfdup(osfildef *orig, const char *mode);
 
+/*
+ *   Map an open file into memory for reading.  The mapping covers the
+ *   contents of the file from byte offset 'ofs' (relative to the start of
+ *   the file, regardless of the handle's current seek position) through
+ *   the end of the file.  On success, returns a pointer to the mapped data,
+ *   sets '*len' to the number of bytes mapped, and sets '*handle' to a
+ *   port-defined handle value that the caller passes to os_unmap_file()
+ *   when done with the mapping.  The mapped memory is read-only.
+ *
+ *   The mapping is independent of the file handle: the caller can close or
+ *   keep using 'fp' without affecting the mapping, and the mapped data stay
+ *   valid until os_unmap_file() is called.
+ *
+ *   Memory mapping is an optimization, so this is optional.  Returns null
+ *   if the file can't be mapped, or if the platform doesn't support memory
+ *   mapped files; callers must be prepared to read the file through the
+ *   ordinary osfrb() interface instead.  Ports that don't support mapping
+ *   can simply return null.
+ */
+/* typedef <local system type> osfmaphdl_t; */
+const char *os_map_file(osfildef *fp, long ofs, /*OUT*/unsigned long *len,
+                        /*OUT*/osfmaphdl_t *handle);
+
+/* release a mapping created with os_map_file() */
+void os_unmap_file(osfmaphdl_t handle);
+
 /* 
  *   Set a file's type information.  This is primarily for implementations on
  *   Mac OS 9 and earlier, where the file system keeps file-type metadata
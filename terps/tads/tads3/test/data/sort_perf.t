@@ -0,0 +1,45 @@
+/*
+ *   performance timing test for List.sort() and Vector.sort() on sorted,
+ *   reversed, and random input
+ */
+#include <tads.h>
+
+main(args)
+{
+    local n = 3000;
+    local seed = 1;
+    local rnd = List.generate(new function(i) {
+        seed = (seed * 75 + 74) % 65537;
+        return seed % n;
+    }, n);
+
+    local inputs = [
+        ['sorted', List.generate({i: i}, n)],
+        ['reversed', List.generate({i: n - i}, n)],
+        ['random', rnd],
+        ['random string', rnd.mapAll({x: toString(x)})],
+        ['many ties', rnd.mapAll({x: x % 10})]
+    ];
+
+    foreach (local inp in inputs)
+    {
+        local lst = inp[2];
+
+        time('<<inp[1]>> list', {: lst.sort()});
+        time('<<inp[1]>> list, descending', {: lst.sort(true)});
+        time('<<inp[1]>> list, callback',
+             {: lst.sort(nil, {a, b: a < b ? -1 : a > b ? 1 : 0})});
+        time('<<inp[1]>> vector', {: new Vector(lst).sort()});
+    }
+}
+
+/* run a sort several times, and show how long it took */
+time(desc, func)
+{
+    local startTime = getTime(GetTimeTicks);
+
+    for (local i = 0 ; i < 5 ; ++i)
+        func();
+
+    "<<desc>>: <<getTime(GetTimeTicks) - startTime>> milliseconds\n";
+}
@@ -0,0 +1,135 @@
+/*
+ *   List.sort() and Vector.sort() stability test.  Elements that compare
+ *   equal must keep their original relative order, in both ascending and
+ *   descending sorts, with and without a comparison callback.
+ */
+
+#include <tads.h>
+#include <bignum.h>
+
+main(args)
+{
+    /*
+     *   Small lists, which are sorted entirely by insertion.  Each element
+     *   is a [key, seq] pair, where seq is the original position, so ties
+     *   on the key have to come out in ascending seq order.
+     */
+    local small = [[3, 1], [1, 2], [3, 3], [2, 4], [1, 5], [3, 6], [2, 7]];
+    local cmp = {a, b: a[1] - b[1]};
+
+    "*** small lists ***\n";
+    showPairs('asc', small.sort(nil, cmp));
+    showPairs('desc', small.sort(true, cmp));
+    showPairs('vector asc', new Vector(small).sort(nil, cmp).toList());
+    showPairs('vector desc', new Vector(small).sort(true, cmp).toList());
+
+    /*
+     *   Ties under the default ordering: an integer and a BigNumber with
+     *   the same value compare equal.  We mark the BigNumbers with an 'n'
+     *   suffix in the listing so that we can tell them apart.
+     */
+    local mixed = [2, 1.0, 1, 2.0, 0, 1.5, 1, 2];
+    "\b*** default ordering ***\n";
+    showList('asc', mixed.sort());
+    showList('desc', mixed.sort(true));
+    showList('vector asc', new Vector(mixed).sort().toList());
+    showList('vector desc', new Vector(mixed).sort(true).toList());
+
+    /*
+     *   Large lists, which go through the merge passes.  Use our own
+     *   generator so that the input doesn't depend on the VM's random
+     *   number generator.
+     */
+    "\b*** large lists ***\n";
+    foreach (local n in [9, 16, 17, 100, 1000, 5000])
+    {
+        foreach (local nkeys in [1, 3, 50])
+        {
+            local lst = genPairs(n, nkeys);
+            local desc = '<<n>> elements, <<nkeys>> keys';
+            checkSort(desc + ', asc', lst, nil);
+            checkSort(desc + ', desc', lst, true);
+        }
+    }
+
+    /* presorted and reversed runs with ties */
+    "\b*** ordered runs ***\n";
+    local up = List.generate({i: [i / 4, i]}, 2000);
+    local down = List.generate({i: [(2000 - i) / 4, i]}, 2000);
+    checkSort('sorted, asc', up, nil);
+    checkSort('sorted, desc', up, true);
+    checkSort('reversed, asc', down, nil);
+    checkSort('reversed, desc', down, true);
+}
+
+/*
+ *   make a list of n [key, seq] pairs with keys in 0..nkeys-1
+ */
+genPairs(n, nkeys)
+{
+    local seed = n * 31 + nkeys;
+    return List.generate(new function(i) {
+        seed = (seed * 75 + 74) % 65537;
+        return [seed % nkeys, i];
+    }, n);
+}
+
+/*
+ *   Sort a list of pairs by key, as a List and as a Vector, and make sure
+ *   the result is ordered by key with ties in their original order.
+ */
+checkSort(desc, lst, descending)
+{
+    local cmp = {a, b: a[1] - b[1]};
+    local res = [lst.sort(descending, cmp),
+                 new Vector(lst).sort(descending, cmp).toList()];
+
+    "<<desc>>:";
+    foreach (local r in res)
+        " <<isStable(lst, r, descending) ? 'ok' : 'FAILED'>>";
+    "\n";
+}
+
+/* check that a sorted list is a stable ordering of the original */
+isStable(orig, lst, descending)
+{
+    if (lst.length() != orig.length())
+        return nil;
+
+    local seen = new Vector(orig.length()).fillValue(nil, 1, orig.length());
+    for (local i = 1 ; i <= lst.length() ; ++i)
+    {
+        /* each original element must appear exactly once */
+        local cur = lst[i];
+        if (seen[cur[2]] != nil || orig[cur[2]] != cur)
+            return nil;
+        seen[cur[2]] = true;
+
+        if (i > 1)
+        {
+            local prv = lst[i-1];
+            local d = (descending ? prv[1] - cur[1] : cur[1] - prv[1]);
+
+            /* keys must be in order, and ties in original order */
+            if (d < 0 || (d == 0 && cur[2] < prv[2]))
+                return nil;
+        }
+    }
+    return true;
+}
+
+showPairs(desc, lst)
+{
+    "<<desc>>:";
+    foreach (local p in lst)
+        " <<p[1]>>/<<p[2]>>";
+    "\n";
+}
+
+showList(desc, lst)
+{
+    "<<desc>>:";
+    foreach (local x in lst)
+        " <<x>><<dataType(x) == TypeInt ? '' : 'n'>>";
+    "\n";
+}
@@ -0,0 +1,130 @@
+/*
+ *   Dictionary.correctSpelling() test.  The result list order is
+ *   unspecified, so we sort each list before displaying it.
+ */
+
+#include <tads.h>
+#include <strcomp.h>
+#include <dict.h>
+
+dictionary cmdDict;
+
+main(args)
+{
+    local words = [
+        'a', 'an', 'and', 'ant', 'at', 'to', 'too', 'toy', 'top', 'tap',
+        'open', 'opens', 'opened', 'oven', 'often', 'pen', 'pan',
+        'examine', 'example', 'exam', 'take', 'taken', 'lake', 'talk',
+        'book', 'box', 'boxes', 'bok', 'boot', 'bottle', 'battle',
+        'north', 'northeast', 'northwest', 'south', 'southeast',
+        'lantern', 'latern', 'lanterns', 'flashlight', 'flashlights',
+        'inventory', 'invent', 'brass', 'grass', 'glass', 'class',
+        'receive', 'recieve', 'weird', 'wierd', 'their', 'there',
+        'ab', 'ba', 'aba', 'bab', 'abab', 'baba', 'abba', 'baab'
+    ];
+
+    local typos = [
+        'opne', 'xaemine', 'exmaine', 'examnie', 'bok', 'boks', 'booc',
+        'lantren', 'latnern', 'lnatern', 'flashlite', 'flahslight',
+        'inventroy', 'nivnetory', 'brsas', 'gras', 'clas', 'tkae', 'tka',
+        'recieve', 'weird', 'thier', 'nroth', 'soth', 'suoth', 'zzz',
+        'q', '', 'aab', 'bba', 'abb', 'baa', 'ababab', 'bbaa'
+    ];
+
+    /* plain dictionary - exact character comparisons */
+    local dict = new Dictionary(nil);
+    foreach (local w in words)
+        dict.addWord(testObj, w, &noun);
+
+    "*** no comparator ***\n";
+    runTests(dict, typos, [0, 1, 2, 3]);
+
+    /* remove some words, leaving empty nodes behind in the trie */
+    dict.removeWord(testObj, 'boxes', &noun);
+    dict.removeWord(testObj, 'lantern', &noun);
+    dict.removeWord(testObj, 'ab', &noun);
+
+    "\b*** after removing words ***\n";
+    runTests(dict, ['boxs', 'lantren', 'lantrn', 'aab', 'b'], [1, 2]);
+
+    /*
+     *   dictionary with a StringComparator: truncation, case folding, and
+     *   multi-character mappings
+     */
+    local comp = new StringComparator(6, nil,
+        [
+         ['\u00DF', 'ss', 0x0100, 0x0200],
+         ['\u00E6', 'ae', 0x1000, 0x2000],
+         ['\u00E9', 'e', 0x4000, 0x8000]
+        ]);
+    local cdict = new Dictionary(comp);
+    foreach (local w in words)
+        cdict.addWord(testObj, w, &noun);
+    foreach (local w in ['stra\u00DFe', 'gro\u00DF', 'encyclop\u00E6dia',
+                         'caf\u00E9', 'caf\u00E9s', 'r\u00E9sum\u00E9',
+                         'Paris', 'London'])
+        cdict.addWord(testObj, w, &noun);
+
+    "\b*** StringComparator ***\n";
+    runTests(cdict, typos, [1, 2]);
+    runTests(cdict,
+             ['strasse', 'strase', 'srtasse', 'gross', 'gros', 'grsos',
+              'encyclopaedia', 'encylopaedia', 'encyclopedia', 'encyclo',
+              'enyclop', 'cafe', 'cfae', 'cafes', 'resume', 'reusme',
+              'paris', 'PARSI', 'lodnon', 'OPNE', 'Flashl', 'flahsl',
+              'flashlightz', 'flashlitgh', 'inventorx', 'invnetoryxx'],
+             [0, 1, 2]);
+
+    /* negative distances find nothing */
+    "\b*** negative distance ***\n";
+    runTests(dict, ['opne', 'open'], [-1]);
+
+    /* 
+     *   a very long input word - the search is bounded by the depth of
+     *   the dictionary, not the length of the input 
+     */
+    "\b*** long input ***\n";
+    local s = 'opne';
+    while (s.length() < 16384)
+        s += s;
+    foreach (local d in [1, 2])
+    {
+        local lst = dict.correctSpelling(s, d);
+        "<<d>> (<<s.length()>> chars): <<lst.length()>>\n";
+        lst = cdict.correctSpelling(s, d);
+        "<<d>> (<<s.length()>> chars, StringComparator): <<lst.length()>>\n";
+    }
+}
+
+runTests(dict, typos, dists)
+{
+    foreach (local d in dists)
+    {
+        foreach (local t in typos)
+        {
+            local lst = dict.correctSpelling(t, d);
+            lst = lst.sort(nil, function(a, b) {
+                return a[1] > b[1] ? 1 : a[1] < b[1] ? -1 : 0; });
+
+            "<<d>> '<<fmtWord(t)>>' (<<lst.length()>>):";
+            foreach (local r in lst)
+                " <<fmtWord(r[1])>>/<<r[2]>>/<<r[3]>>";
+            "\n";
+        }
+    }
+}
+
+/* show a word, escaping non-ASCII characters */
+fmtWord(w)
+{
+    local s = '';
+    for (local i = 1 ; i <= w.length() ; ++i)
+    {
+        local u = w.toUnicode(i);
+        s += (u < 128 ? w.substr(i, 1) : '\\u' + toString(u, 16));
+    }
+    return s;
+}
+
+testObj: object
+;
@@ -62,6 +62,82 @@ public:
     const char **arr_;
 };
 
+/*
+ *   integer sorter that counts comparisons and exchanges 
+ */
+class CVmQSortIntCount: public CVmQSortInt
+{
+public:
+    CVmQSortIntCount(int *arr) : CVmQSortInt(arr) { ncmp_ = nexch_ = 0; }
+    int compare(VMG_ size_t a, size_t b)
+    {
+        ++ncmp_;
+        return CVmQSortInt::compare(vmg_ a, b);
+    }
+    void exchange(VMG_ size_t a, size_t b)
+    {
+        ++nexch_;
+        CVmQSortInt::exchange(vmg_ a, b);
+    }
+
+    unsigned long ncmp_;
+    unsigned long nexch_;
+};
+
+/*
+ *   Sort a large array with the given initial arrangement, and show how
+ *   much work it took.  Quicksort with a fixed pivot goes quadratic on
+ *   sorted and reversed input, so these make good worst-case checks.  
+ */
+static void sort_large(const char *desc, int kind)
+{
+    static int arr[10000];
+    vm_globals *vmg__ = 0;
+    CVmQSortIntCount sorter(arr);
+    unsigned long seed = 1;
+    int n = countof(arr);
+    int i;
+
+    /* set up the array */
+    for (i = 0 ; i < n ; ++i)
+    {
+        seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+        switch (kind)
+        {
+        case 0:
+            arr[i] = i;
+            break;
+
+        case 1:
+            arr[i] = n - i;
+            break;
+
+        case 2:
+            arr[i] = (int)(seed % n);
+            break;
+
+        case 3:
+            arr[i] = 17;
+            break;
+
+        case 4:
+            arr[i] = (i < n/2 ? i : n - i);
+            break;
+        }
+    }
+
+    /* sort it */
+    sorter.sort(vmg_ 0, n - 1);
+
+    /* make sure it's in order */
+    for (i = 1 ; i < n && arr[i-1] <= arr[i] ; ++i) ;
+
+    /* show the results */
+    printf("%s: %s, %lu compares, %lu exchanges\n",
+           desc, i == n ? "sorted" : "NOT SORTED",
+           sorter.ncmp_, sorter.nexch_);
+}
+
 int main()
 {
     static int ints1[] = { 1, 5, 2, 10, 2, 7, 4, 3, 9 };
@@ -129,6 +205,12 @@ int main()
     for (i = 0 ; i < countof(strs) ; ++i)
         printf("   %s\n", strs[i]);
 
+    sort_large("sorted", 0);
+    sort_large("reversed", 1);
+    sort_large("random", 2);
+    sort_large("equal", 3);
+    sort_large("organ pipe", 4);
+
     return 0;
 }
 
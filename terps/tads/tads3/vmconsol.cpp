@@ -2759,6 +2759,26 @@ void CVmConsole::log_event(VMG_ const char *tag,
     }
 }
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   Idle callback for the OS layer while we're reading a line of input.
+ *   The context is the VM globals pointer.  
+ */
+#if defined(GLK)
+static int gc_idle_cb(void *ctx)
+{
+    /* 
+     *   establish the global context (this is empty in the static globals
+     *   configurations, so make sure ctx still counts as used there) 
+     */
+    VMGLOB_PTR((vm_globals *)ctx);
+    (void)ctx;
+
+    /* do the next slice of garbage collection */
+    return G_obj_table->gc_idle_step(vmg0_);
+}
+#endif
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Static variables for input state.  We keep these statically, because we
@@ -2946,6 +2966,12 @@ int CVmConsole::read_line_timeout(VMG_ char *buf, size_t buflen,
             return OS_EVT_EOF;
         }
 
+        /* let the garbage collector work while the player is typing */
+#if defined(GLK)
+        if (G_obj_table->gc_idle_begin(vmg0_))
+            os_set_idle_func(&gc_idle_cb, VMGLOB_ADDR);
+#endif
+
         /* read a line from the keyboard */
         evt = os_gets_timeout((uchar *)S_read_buf, sizeof(S_read_buf),
                               timeout, use_timeout);
@@ -2971,6 +2997,15 @@ int CVmConsole::read_line_timeout(VMG_ char *buf, size_t buflen,
             }
         }
 
+        /* 
+         *   we're done waiting, so the garbage collector has to finish up
+         *   before we go back to running byte code 
+         */
+#if defined(GLK)
+        os_set_idle_func(0, 0);
+#endif
+        G_obj_table->gc_idle_end(vmg0_);
+
         /* 
          *   If we actually read a line, notify the display stream that we
          *   read text from the console - it might need to make some
@@ -22,6 +22,7 @@ Modified
 
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 #include "t3std.h"
 #include "vmdict.h"
@@ -1387,9 +1388,7 @@ int CVmObjDict::getp_for_each_word(VMG_ vm_obj_id_t self, vm_val_t *retval,
 /*
  *   Correction list entry.  Each time we match a word in the spelling
  *   correction generator, we'll add one of these entries to our list of
- *   matched words.  This lets us check for words that we've already found
- *   (since it's often possible to find a match via more than one editing
- *   route). 
+ *   matched words. 
  */
 struct corr_word
 {
@@ -1422,107 +1421,453 @@ struct corr_word
     wchar_t str[1];
 };
 
-/* correction types */
-enum corr_type { NoChange, Insertion, Deletion, Replacement, Transposition };
+/*
+ *   Correction search cell.  This records the best edit path we've found
+ *   so far that reaches a given input position at the current Trie node.
+ *   Paths are ranked first by edit distance, then by number of character
+ *   replacements, which is the same preference the result list uses.  
+ */
+struct corr_cell
+{
+    /* edit distance, or CORR_UNREACHED if no path reaches this cell */
+    int dist;
+
+    /* number of replacement transitions */
+    int repl;
+};
+
+/* edit distance marker for a cell that no path reaches */
+static const int CORR_UNREACHED = INT_MAX;
+
+/*
+ *   Correction types.  The last transition into a state determines which
+ *   edits can follow it, so we keep a separate cell per type for each
+ *   input position.  A transposition behaves exactly like an unchanged
+ *   character for this purpose, so the two share a cell.  
+ */
+enum corr_type { NoChange, Insertion, Deletion, Replacement };
+static const int CORR_NTYPES = 4;
 
 /*
- *   Correction stack element.  This represents a state in the correction
- *   process. 
+ *   Correction row descriptor.  The reachable positions of a row usually
+ *   form a narrow band around the diagonal, so rather than storing a cell
+ *   for every input position, we only store the band: the row's cells
+ *   cover input positions base..end-1, and every position outside that
+ *   range is unreached.  This keeps both the time and the space for a row
+ *   proportional to the edit distance rather than to the length of the
+ *   input word.
+ *
+ *   The rows for the current path through the Trie are packed one after
+ *   another in a single cell arena, since we only ever build a row at the
+ *   end of the path.
  */
-struct corr_state
+struct corr_row
 {
-    /* 
-     *   Allocate space.  During the state processing, we need to add one
-     *   character to the last state to form certain subsequent states, so
-     *   always overallocate our string by one character.  This allows us to
-     *   build the next-state strings in place in our buffer.  
-     */
-    void *operator new(size_t siz, size_t strl)
+    /* arena index of the first cell of the row, for input position 'base' */
+    size_t ofs;
+
+    /* input position of the first stored cell */
+    size_t base;
+
+    /* input position just past the last stored cell */
+    size_t end;
+
+    /* lowest and highest reachable input positions */
+    size_t lo;
+    size_t hi;
+};
+
+/*
+ *   Spelling correction search.  We walk the Trie depth-first, keeping one
+ *   row of the edit table for each level of the tree: the row for depth d
+ *   holds, for each input position and each transition type, the best
+ *   (dist, repl) of any edit path that spells the d-character prefix
+ *   leading to the current node.  Each child's row is derived from its
+ *   parent's row, so moving down the tree costs one row computation, with
+ *   no per-state allocation or prefix copying.
+ *   
+ *   Since each node of the Trie has at most one child per character, we
+ *   reach each distinct dictionary string exactly once, at a single node.
+ *   That makes the search inherently duplicate-free: a word matched via
+ *   several editing routes shows up as several reachable cells in one
+ *   row, and we just take the best of them, so there's no need to look up
+ *   earlier matches at all.  A subtree is pruned as soon as a row has no
+ *   reachable cells left, since any path into the subtree would have to
+ *   exceed the edit distance budget.  
+ */
+class CVmDictCorrector
+{
+public:
+    CVmDictCorrector(const wchar_t *wstr, size_t wcnt, int max_dist,
+                     CVmObjStrComp *cmp, size_t trunc_len)
     {
-        return t3mallocnew(siz + strl*sizeof(wchar_t));
+        this->wstr = wstr;
+        this->wcnt = wcnt;
+        this->max_dist = max_dist;
+        this->cmp = cmp;
+        this->trunc_len = trunc_len;
+
+        /* we have no results yet */
+        results = 0;
+
+        /* 
+         *   Allocate the initial buffers.  The search can't go deeper than
+         *   the Trie, and a row only holds its reachable band, so none of
+         *   this depends on the length of the input; start small and
+         *   expand as the search needs more.
+         */
+        cells = 0;
+        cells_alo = 0;
+        rows = 0;
+        prefix = 0;
+        depth_alo = 0;
+        alloc_cells(256);
+        alloc_depth(32);
     }
-    void operator delete(void *ptr) { t3free(ptr); }
 
-    corr_state(vmdict_TrieNode *root)
+    ~CVmDictCorrector()
     {
-        init(0, 0, 0, 0, 0,
-             root, NoChange, 0);
+        t3free(cells);
+        t3free(rows);
+        t3free(prefix);
     }
-    corr_state(const wchar_t *str, size_t strl, int dist, int repl,
-               size_t ipos, vmdict_TrieNode *node, corr_type typ,
-               corr_state *nxt)
+
+    /* run the search from the root of the Trie */
+    void search(vmdict_TrieNode *root);
+
+    /* 
+     *   Result list.  The caller takes ownership of this when the search
+     *   is done. 
+     */
+    corr_word *results;
+
+protected:
+    /* make sure we have row and prefix space for the given depth */
+    void alloc_depth(size_t depth);
+
+    /* make sure the cell arena has room for the given number of cells */
+    void alloc_cells(size_t cnt);
+
+    /*
+     *   get the cells for input position 'ipos' of a row; the position
+     *   must be within the row's stored range
+     */
+    corr_cell *get_cells(const corr_row *row, size_t ipos)
+        { return cells + row->ofs + (ipos - row->base)*CORR_NTYPES; }
+
+    /* start building the row for 'depth'; no path can begin before 'lo' */
+    void begin_row(size_t depth, size_t lo)
     {
-        init(str, strl, dist, repl, ipos, node, typ, nxt);
+        build = &rows[depth];
+
+        /* the new row goes just after its parent's in the arena */
+        if (depth == 0)
+            build->ofs = 0;
+        else
+            build->ofs = rows[depth-1].ofs
+                         + (rows[depth-1].end - rows[depth-1].base)
+                           * CORR_NTYPES;
+
+        /* it has no cells and no reachable positions yet */
+        build->base = build->end = lo;
+        build->lo = wcnt + 1;
+        build->hi = 0;
     }
 
-    void init(const wchar_t *str, size_t strl, int dist, int repl,
-              size_t ipos, vmdict_TrieNode *node, corr_type typ,
-              corr_state *nxt)
+    /*
+     *   Record a path reaching 'ipos' in the row we're building.  This can
+     *   expand the cell arena, which invalidates any cell pointers the
+     *   caller is holding.
+     */
+    void reach(size_t ipos, int typ, int dist, int repl)
     {
-        memcpy(this->str, str, strl*sizeof(wchar_t));
-        this->strl = strl;
-        this->dist = dist;
-        this->repl = repl;
-        this->ipos = ipos;
-        this->node = node;
-        this->typ = typ;
-        this->nxt = nxt;
+        /* mark the cells for any newly covered positions as unreached */
+        if (build->end <= ipos)
+        {
+            alloc_cells(build->ofs + (ipos + 1 - build->base)*CORR_NTYPES);
+            for ( ; build->end <= ipos ; ++build->end)
+            {
+                corr_cell *c = get_cells(build, build->end);
+                for (int t = 0 ; t < CORR_NTYPES ; ++t)
+                    c[t].dist = CORR_UNREACHED;
+            }
+        }
+
+        /* keep the better of the new path and the existing one */
+        corr_cell *c = get_cells(build, ipos) + typ;
+        if (dist < c->dist || (dist == c->dist && repl < c->repl))
+        {
+            c->dist = dist;
+            c->repl = repl;
+        }
+
+        /* widen the row's reachable span to include this position */
+        if (ipos < build->lo)
+            build->lo = ipos;
+        if (ipos > build->hi)
+            build->hi = ipos;
     }
 
-    /* next state in the stack */
-    corr_state *nxt;
+    /* 
+     *   finish building the current row; returns true if any cell of the
+     *   row is reachable
+     */
+    int end_row();
 
-    /* edit distance so far */
-    int dist;
+    /* 
+     *   compute the row for the child of the node at 'depth' reached via
+     *   'ch'; returns true if any cell of the new row is reachable 
+     */
+    int derive_row(size_t depth, wchar_t ch);
 
-    /* number of replacement transitions */
-    int repl;
+    /* visit a node and its subtree */
+    void visit(vmdict_TrieNode *node, size_t depth);
 
-    /* current character index in the input string */
-    size_t ipos;
+    /* the input string */
+    const wchar_t *wstr;
+    size_t wcnt;
 
-    /* current Trie node in the dictionary */
-    vmdict_TrieNode *node;
+    /* maximum edit distance */
+    int max_dist;
 
-    /* type of last transition */
-    corr_type typ;
+    /* StringComparator, if any, and its truncation length */
+    CVmObjStrComp *cmp;
+    size_t trunc_len;
 
-    /* the string (we overallocate the structure to make room) */
-    size_t strl;
-    wchar_t str[1];
+    /* the cell arena holding the rows for the current path */
+    corr_cell *cells;
+    size_t cells_alo;
+
+    /* the row descriptors, one per depth */
+    corr_row *rows;
+
+    /* the Trie characters spelling the current prefix */
+    wchar_t *prefix;
+
+    /* number of depths we have room for */
+    size_t depth_alo;
+
+    /* the row we're building */
+    corr_row *build;
 };
 
-/* correction state stack */
-struct corr_stack
+/* make sure we have space for the given depth */
+void CVmDictCorrector::alloc_depth(size_t depth)
 {
-    corr_stack(vmdict_TrieNode *root)
+    /* if we already have room, there's nothing to do */
+    if (depth < depth_alo)
+        return;
+
+    /* grow geometrically, so deep searches stay linear */
+    size_t alo = depth_alo*2 > depth + 1 ? depth_alo*2 : depth + 1;
+
+    corr_row *new_rows = (corr_row *)t3realloc(rows, alo * sizeof(corr_row));
+    if (new_rows == 0)
+        err_throw(VMERR_OUT_OF_MEMORY);
+    rows = new_rows;
+
+    wchar_t *new_prefix = (wchar_t *)t3realloc(prefix, alo*sizeof(wchar_t));
+    if (new_prefix == 0)
+        err_throw(VMERR_OUT_OF_MEMORY);
+    prefix = new_prefix;
+
+    depth_alo = alo;
+}
+
+/* make sure the cell arena is big enough */
+void CVmDictCorrector::alloc_cells(size_t cnt)
+{
+    /* if we already have room, there's nothing to do */
+    if (cnt <= cells_alo)
+        return;
+
+    /* grow geometrically */
+    size_t alo = cells_alo*2 > cnt ? cells_alo*2 : cnt;
+
+    corr_cell *new_cells = (corr_cell *)t3realloc(
+        cells, alo * sizeof(corr_cell));
+    if (new_cells == 0)
+        err_throw(VMERR_OUT_OF_MEMORY);
+    cells = new_cells;
+
+    cells_alo = alo;
+}
+
+/* run the search */
+void CVmDictCorrector::search(vmdict_TrieNode *root)
+{
+    /* the root row starts with the empty path at the start of the input */
+    begin_row(0, 0);
+    reach(0, NoChange, 0, 0);
+    end_row();
+
+    /* search from the root */
+    visit(root, 0);
+}
+
+/*
+ *   Finish a row.  This applies the insertions (i.e., the input word has an
+ *   extra letter relative to the dictionary word), which advance the input
+ *   position without moving in the Trie.  We don't allow insertions
+ *   directly after deletions, though, since they'd just cancel out.  We
+ *   work left to right, so that chains of insertions see the earlier ones.
+ */
+int CVmDictCorrector::end_row()
+{
+    /* apply insertions to each reachable position */
+    for (size_t i = build->lo ; i <= build->hi && i < wcnt ; ++i)
     {
-        /* start the stack with an empty initial state */
-        top = new (0) corr_state(root);
+        for (int t = 0 ; t < CORR_NTYPES ; ++t)
+        {
+            /*
+             *   fetch the cell afresh each time, since reach() can move
+             *   the arena
+             */
+            corr_cell c = get_cells(build, i)[t];
+            if (t != Deletion && c.dist < max_dist)
+                reach(i + 1, Insertion, c.dist + 1, c.repl);
+        }
     }
 
-    int empty() const { return top == 0; }
+    /* tell the caller whether anything is reachable */
+    return build->lo <= build->hi;
+}
+
+/*
+ *   Derive the row for a child node from its parent's row 
+ */
+int CVmDictCorrector::derive_row(size_t depth, wchar_t ch)
+{
+    const corr_row *src = &rows[depth];
+
+    /* no transition moves backwards in the input */
+    begin_row(depth + 1, src->lo);
 
-    void push(const wchar_t *str, size_t strl, int dist, int repl,
-              size_t ipos, vmdict_TrieNode *node, corr_type typ)
+    /* extend each reachable path in the parent row with 'ch' */
+    for (size_t ipos = src->lo ; ipos <= src->hi ; ++ipos)
     {
-        top = new (strl) corr_state(
-            str, strl, dist, repl, ipos, node, typ, top);
+        int have_match = FALSE;
+        size_t matchlen = 0;
+
+        /*
+         *   copy the parent's cells for this position, since adding to the
+         *   new row can move the arena
+         */
+        corr_cell c[CORR_NTYPES];
+        memcpy(c, get_cells(src, ipos), sizeof(c));
+        
+        for (int t = 0 ; t < CORR_NTYPES ; ++t)
+        {
+            int dist = c[t].dist, repl = c[t].repl;
+
+            /* skip unreached cells */
+            if (dist == CORR_UNREACHED)
+                continue;
+
+            /* 
+             *   Check for a match to the current character.  If we have a
+             *   StringComparator, ask the comparator to check the match.
+             *   Otherwise just check for an exact character match.  The
+             *   result only depends on the position, so we only need to
+             *   check once per position. 
+             */
+            if (!have_match && ipos < wcnt)
+            {
+                if (cmp != 0)
+                    matchlen = cmp->match_chars(
+                        wstr + ipos, wcnt - ipos, ch);
+                else if (wstr[ipos] == ch)
+                    matchlen = 1;
+
+                have_match = TRUE;
+            }
+
+            if (matchlen != 0)
+            {
+                /* we have a match - advance over the matched input */
+                reach(ipos + matchlen, NoChange, dist, repl);
+            }
+            else if (ipos == wcnt && trunc_len != 0
+                     && depth >= trunc_len && ipos >= trunc_len)
+            {
+                /* 
+                 *   we've reached the end of the input; but the prefix is
+                 *   at least the truncation length in the string
+                 *   comparator, so consider this a character match as well 
+                 */
+                reach(ipos, NoChange, dist, repl);
+            }
+
+            /* if we have any edit distance remaining, try corrections */
+            if (dist < max_dist)
+            {
+                /* try a replaced letter */
+                if (ipos < wcnt && matchlen == 0)
+                    reach(ipos + 1, Replacement, dist + 1, repl + 1);
+
+                /* try a deletion (i.e., the input is missing a character) */
+                if (t != Insertion)
+                    reach(ipos, Deletion, dist + 1, repl);
+            }
+
+            /* 
+             *   if we just did a replacement edit, check to see if it's
+             *   actually a transposition 
+             */
+            if (t == Replacement
+                && ipos > 0 && ipos < wcnt && depth > 0
+                && wstr[ipos - 1] == ch
+                && wstr[ipos] == prefix[depth - 1])
+                reach(ipos + 1, NoChange, dist, repl - 1);
+        }
     }
 
-    corr_state *pop()
+    /* add the insertions, and tell the caller if anything's reachable */
+    return end_row();
+}
+
+/*
+ *   Visit a Trie node.  The row for 'depth' must already be computed for
+ *   this node. 
+ */
+void CVmDictCorrector::visit(vmdict_TrieNode *node, size_t depth)
+{
+    /* 
+     *   Check for an 'accept' state.  This is a node with at least one word
+     *   defined, reached by some path that has exhausted the input word.
+     *   The best of those paths gives the word's edit distance.  
+     */
+    if (node->word_cnt != 0 && rows[depth].hi == wcnt)
     {
-        /* retrieve and unlink the top state */
-        corr_state *ret = top;
-        top = top->nxt;
+        corr_cell *c = get_cells(&rows[depth], wcnt);
+        corr_cell best = c[0];
+        for (int t = 1 ; t < CORR_NTYPES ; ++t)
+        {
+            if (c[t].dist < best.dist
+                || (c[t].dist == best.dist && c[t].repl < best.repl))
+                best = c[t];
+        }
 
-        /* return the state we unlinked */
-        return ret;
+        /* add the word */
+        results = new (depth) corr_word(
+            prefix, depth, best.dist, best.repl, results);
     }
 
-    /* top of the stack */
-    corr_state *top;
-};
+    /* make room for the children's rows */
+    if (node->chi != 0)
+        alloc_depth(depth + 1);
+
+    /* try each possible dictionary transition from here */
+    for (vmdict_TrieNode *chi = node->chi ; chi != 0 ; chi = chi->nxt)
+    {
+        /* extend the prefix with this child's character */
+        prefix[depth] = chi->ch;
+
+        /* compute the child's row; if anything is reachable, visit it */
+        if (derive_row(depth, chi->ch))
+            visit(chi, depth + 1);
+    }
+}
 
 
 /*
@@ -1570,145 +1915,10 @@ int CVmObjDict::getp_correct(VMG_ vm_obj_id_t self,
     if (get_ext()->trie_ == 0)
         build_trie(vmg0_);
 
-    /* create a stack with the initial empty state */
-    corr_stack stk(get_ext()->trie_);
-
-    /* start with an empty result list */
-    corr_word *results = 0;
-
-    /* process states until the stack is empty */
-    while (!stk.empty())
-    {
-        /* pop the next state */
-        corr_state *s = stk.pop();
-
-        /* 
-         *   Check for an 'accept' state.  This is a state where we've
-         *   exhausted the input word, and we're at a Trie node that has at
-         *   least one word defined.
-         */
-        if (s->node->word_cnt != 0 && s->ipos == wcnt)
-        {
-            /*
-             *   We've found a matching word (i.e., a candidate dictionary
-             *   match for the misspelled input word).  Scan the list of
-             *   candidates we've already found to see if we've already
-             *   matched this word.
-             */
-            corr_word *w;
-            for (w = results ; w != 0 ; w = w->nxt)
-            {
-                if (w->strl == s->strl
-                    && memcmp(w->str, s->str, s->strl*sizeof(wchar_t)) == 0)
-                    break;
-            }
-
-            /* if we didn't find an entry, add a new one */
-            if (w == 0)
-                results = w = new (s->strl) corr_word(
-                    s->str, s->strl, s->dist, s->repl, results);
-
-            /* keep the lowest edit distance we've found so far */
-            if (s->dist < w->dist
-                || (s->dist == w->dist && s->repl < w->repl))
-            {
-                w->dist = s->dist;
-                w->repl = s->repl;
-            }
-        }
-
-        /*
-         *   If we have any edit distance left, try an insertion (i.e., the
-         *   input word has an extra letter relative to the dictionary word).
-         *   Don't do insertions directly after deletions, though, since
-         *   they'd just cancel out.  
-         */
-        if (s->dist < max_dist && s->ipos < wcnt && s->typ != Deletion)
-            stk.push(s->str, s->strl, s->dist + 1, s->repl, s->ipos + 1,
-                     s->node, Insertion);
-
-        /* try each possible dictionary transition from here */
-        for (vmdict_TrieNode *chi = s->node->chi ; chi != 0 ;
-             chi = chi->nxt)
-        {
-            /* 
-             *   Build the next-state string.  Note that we can just add the
-             *   character directly to the current state's string buffer,
-             *   since we always allocate state structures with one extra
-             *   character of padding for just this purpose. 
-             */
-            s->str[s->strl] = chi->ch;
-
-            /* 
-             *   Check for a match to the current character.  If we have a
-             *   StringComparator, ask the comparator to check the match.
-             *   Otherwise just check for an exact character match. 
-             */
-            size_t matchlen = 0;
-            if (s->ipos < wcnt)
-            {
-                if (cmp != 0)
-                {
-                    /* we have a comparator - check it for the match */
-                    matchlen = cmp->match_chars(
-                        wstr + s->ipos, wcnt - s->ipos, chi->ch);
-                }
-                else
-                {
-                    /* no comparator - do a simple character comparison */
-                    if (wstr[s->ipos] == chi->ch)
-                        matchlen = 1;
-                }
-                
-                /* if we have a match, push a state for it */
-                if (matchlen != 0)
-                    stk.push(s->str, s->strl + 1, s->dist, s->repl,
-                             s->ipos + matchlen, chi, NoChange);
-            }
-            else
-            {
-                /* 
-                 *   we've reached the end of the input; but if the current
-                 *   edit string is at least the truncation length in the
-                 *   string comparator, consider this a character match as
-                 *   well 
-                 */
-                if (trunc_len != 0
-                    && s->strl >= trunc_len
-                    && s->ipos >= trunc_len)
-                    stk.push(s->str, s->strl + 1, s->dist, s->repl,
-                             s->ipos, chi, NoChange);
-            }
-
-            /* if we have any edit distance remaining, try corrections */
-            if (s->dist < max_dist)
-            {
-                /* try a replaced letter */
-                if (s->ipos < wcnt && matchlen == 0)
-                    stk.push(s->str, s->strl + 1, s->dist + 1, s->repl + 1,
-                             s->ipos + 1, chi, Replacement);
-
-                /* try a deletion (i.e., the input is missing a character) */
-                if (s->typ != Insertion)
-                    stk.push(s->str, s->strl + 1, s->dist + 1, s->repl,
-                             s->ipos, chi, Deletion);
-            }
-
-            /* 
-             *   if we just did a replacement edit, check to see if it's
-             *   actually a transposition 
-             */
-            if (s->typ == Replacement
-                && s->ipos > 0 && s->ipos < wcnt
-                && wstr[s->ipos - 1] == chi->ch
-                && wstr[s->ipos] == s->str[s->strl - 1])
-                stk.push(s->str, s->strl + 1, s->dist, s->repl - 1,
-                         s->ipos + 1, chi, Transposition);
-        }
-
-        /* we've finished processing the current state */
-        delete s;
-    }
+    /* search the Trie for words within the maximum edit distance */
+    CVmDictCorrector corr(wstr, wcnt, max_dist, cmp, trunc_len);
+    corr.search(get_ext()->trie_);
+    corr_word *results = corr.results;
 
     /* done with the wchar_t version of the word */
     delete [] wstr;
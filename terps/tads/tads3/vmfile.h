@@ -276,6 +276,14 @@ public:
     /* seek to a position relative to the current file position */
     void set_pos_from_cur(long pos) { osfseek(fp_, pos, OSFSK_CUR); }
 
+    /*
+     *   Map the file into memory, read-only, from the base seek position
+     *   through the end of the file.  Returns null if the file can't be
+     *   mapped.  See os_map_file() for details.
+     */
+    const char *map(unsigned long *len, osfmaphdl_t *hdl)
+        { return os_map_file(fp_, seek_base_, len, hdl); }
+
 protected:
     /* our underlying OS file handle */
     osfildef *fp_;
@@ -23,6 +23,7 @@ Modified
 #include <stdlib.h>
 #include <string.h>
 #include <memory.h>
+#include <limits.h>
 
 #include "os.h"
 #include "t3std.h"
@@ -3154,6 +3155,94 @@ const char *CVmImageFileMem::alloc_and_read(size_t len, uchar xor_mask,
     return ret;
 }
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   Image file interface - OS memory-mapped file implementation 
+ */
+
+/*
+ *   map a file and create the interface 
+ */
+CVmImageFileMap *CVmImageFileMap::create(CVmFile *fp)
+{
+    const char *mem;
+    unsigned long len;
+    osfmaphdl_t map_hdl;
+
+    /* ask the OS to map the file; if it can't, let the caller read it */
+    if ((mem = fp->map(&len, &map_hdl)) == 0)
+        return 0;
+
+    /* our seek positions are longs, so the mapping has to fit in one */
+    if (len > LONG_MAX)
+    {
+        os_unmap_file(map_hdl);
+        return 0;
+    }
+
+    /* create the interface for the mapped data */
+    return new CVmImageFileMap(fp, mem, (long)len, map_hdl);
+}
+
+/*
+ *   delete 
+ */
+CVmImageFileMap::~CVmImageFileMap()
+{
+    CVmImageFileExt_blk *cur;
+    CVmImageFileExt_blk *nxt;
+
+    /* delete the blocks we allocated for decoded data */
+    for (cur = mem_head_ ; cur != 0 ; cur = nxt)
+    {
+        nxt = cur->nxt_;
+        delete cur;
+    }
+
+    /* release the mapping */
+    os_unmap_file(map_hdl_);
+}
+
+/*
+ *   allocate memory for and read data 
+ */
+const char *CVmImageFileMap::alloc_and_read(size_t len, uchar xor_mask,
+                                            ulong remaining_in_page)
+{
+    CVmImageFileExt_blk *blk;
+    char *mem;
+
+    /* unmasked data can be used directly out of the mapping */
+    if (xor_mask == 0)
+        return CVmImageFileMem::alloc_and_read(len, 0, remaining_in_page);
+
+    /* if we're past the end of the file, throw an error */
+    if (pos_ + len > len_)
+        err_throw(VMERR_READ_PAST_IMG_END);
+
+    /* 
+     *   Masked data have to be decoded into a copy.  These are whole pool
+     *   pages, so give each one its own block; link it into our list so
+     *   that we can free it when we're deleted.  
+     */
+    blk = new CVmImageFileExt_blk(len);
+    blk->nxt_ = mem_head_;
+    mem_head_ = blk;
+    if ((mem = blk->suballoc(len)) == 0)
+        err_throw(VMERR_OUT_OF_MEMORY);
+
+    /* read the data from the file, and remove the mask */
+    fp_->set_pos(pos_);
+    fp_->read_bytes(mem, len);
+    CVmImagePool::apply_xor_mask(mem, len, xor_mask);
+
+    /* seek past the data */
+    pos_ += len;
+
+    /* return the decoded copy */
+    return mem;
+}
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Generic stream implementation for an image file block 
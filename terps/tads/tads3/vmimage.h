@@ -33,7 +33,10 @@ Function
   The memory-mapped loader is meant for systems with no external storage,
   such as hand-held devices.  It can also be used on systems with large,
   flat address spaces to speed up loading by isolating all disk access
-  into a single bulk load of the image into memory.
+  into a single bulk load of the image into memory.  On systems with
+  OS-level memory-mapped files, the memory-mapped loader can also be used
+  on top of a mapping of the disk file, which avoids the bulk load
+  entirely: the system pages in the data as the VM touches them.
 
   The external file loader is useful for systems with smaller address
   spaces, and can be used with a swapping pool implementation to allow
@@ -928,7 +931,7 @@ public:
     /* skip the given number of bytes */
     void skip_ahead(long len) { pos_ += len; }
 
-private:
+protected:
     /* the underlying memory block */
     const char *mem_;
 
@@ -940,5 +943,63 @@ private:
 };
 
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   Image file interface - external disk file, mapped into memory through
+ *   the operating system.  Once the file is mapped, this works just like
+ *   the in-memory implementation: blocks are used in place, directly out of
+ *   the mapping.  Nothing is actually read from disk until the VM touches
+ *   it, and the pages are shared with the system's file cache rather than
+ *   copied into memory of our own.
+ *   
+ *   The one exception is data stored with an XOR mask (the compiler masks
+ *   the constant pool pages, for example).  Masked data can't be used in
+ *   place, so we decode those blocks into memory that we allocate.  We read
+ *   those through the ordinary file interface rather than the mapping, so
+ *   that the masked pages aren't faulted into our address space just to be
+ *   copied.  
+ */
+class CVmImageFileMap: public CVmImageFileMem
+{
+public:
+    /* 
+     *   Map the file underlying 'fp', from its base seek position to the
+     *   end of the file, and create an image file interface for it.
+     *   Returns null if the file can't be mapped, in which case the caller
+     *   should fall back on CVmImageFileExt.  We read masked data through
+     *   'fp', so it must stay open as long as we do.  
+     */
+    static CVmImageFileMap *create(class CVmFile *fp);
+
+    /* delete the interface - this releases the mapping */
+    ~CVmImageFileMap();
+
+    /* allocate memory for and read data */
+    const char *alloc_and_read(size_t len, uchar xor_mask,
+                               ulong remaining_in_page);
+
+private:
+    CVmImageFileMap(class CVmFile *fp, const char *mem, long len,
+                    osfmaphdl_t map_hdl)
+        : CVmImageFileMem(mem, len)
+    {
+        /* remember the file and the mapping */
+        fp_ = fp;
+        map_hdl_ = map_hdl;
+
+        /* we haven't decoded any masked blocks yet */
+        mem_head_ = 0;
+    }
+
+    /* the underlying file */
+    class CVmFile *fp_;
+
+    /* the OS file mapping */
+    osfmaphdl_t map_hdl_;
+
+    /* list of blocks we allocated to hold decoded masked data */
+    class CVmImageFileExt_blk *mem_head_;
+};
+
 #endif /* VMIMAGE_H */
 
@@ -2585,7 +2585,7 @@ int CVmObjList::getp_sort(VMG_ vm_val_t *retval,
 
     /* sort the new list if it has any elements */
     if (lst_len != 0)
-        sorter.sort(vmg_ 0, lst_len - 1);
+        sorter.sort_stable(vmg_ 0, lst_len - 1);
 
     /* discard the gc protection and arguments */
     G_stk->discard(2 + argc);
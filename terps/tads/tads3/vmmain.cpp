@@ -171,8 +171,15 @@ int vm_run_image(const vm_run_image_params *params)
             fp->open_read(G_os_gamename, OSFTT3IMG);
         }
 
-        /* create the loader */
-        imagefp = new CVmImageFileExt(fp);
+        /* 
+         *   Create the loader.  Map the image file into memory if the
+         *   caller wants it and the system allows it, so that we can run
+         *   straight out of the mapping; otherwise read the image from the
+         *   file. 
+         */
+        if (!params->map_image
+            || (imagefp = CVmImageFileMap::create(fp)) == 0)
+            imagefp = new CVmImageFileExt(fp);
         loader = new CVmImageLoader(imagefp, G_os_gamename, image_file_base);
 
         /* load the image */
@@ -201,9 +208,10 @@ int vm_run_image(const vm_run_image_params *params)
         }
 #endif /* TADSNET */
 
-        /* run the program from the main entrypoint */
-        loader->run(vmg_ params->prog_argv, params->prog_argc,
-                    0, 0, params->saved_state);
+        /* run the program from the main entrypoint, unless we're only loading */
+        if (!params->load_only)
+            loader->run(vmg_ params->prog_argv, params->prog_argc,
+                        0, 0, params->saved_state);
 
         /* tell the client we're done with execution */
         params->clientifc->post_exec(VMGLOB_ADDR);
@@ -138,6 +138,10 @@ struct vm_run_image_params
         /* assume we're loading from a separate .t3 file */
         load_from_exe = FALSE;
 
+        /* map the image file if possible, and run the program */
+        map_image = TRUE;
+        load_only = FALSE;
+
         /* assume we won't show the VM banner */
         show_banner = FALSE;
 
@@ -227,6 +231,19 @@ struct vm_run_image_params
      */
     int load_from_exe;
 
+    /*
+     *   Flag: map the image file into memory if the system allows it, and
+     *   run straight out of the mapping.  If this is false, we always read
+     *   the image into memory instead. 
+     */
+    int map_image;
+
+    /*
+     *   Flag: load the image file, then unload it without running the
+     *   program.  This is for timing the loader. 
+     */
+    int load_only;
+
     /* flag: show the VM version/copyright banner at startup */
     int show_banner;
 
@@ -61,11 +61,15 @@ struct
         cur_freed = 0;
         max_freed = 0;
         t = 0;
+        pauses = 0;
+        max_pause = 0;
+        idle_runs = 0;
+        idle_slices = 0;
+        idle_t = 0;
     }
 
     void begin_pass()
     {
-        t0 = os_get_sys_clock_ms();
         runs++;
         pass_start_bytes = cur_bytes;
         cur_freed = 0;
@@ -73,7 +77,6 @@ struct
 
     void end_pass()
     {
-        t += os_get_sys_clock_ms() - t0;
         if (cur_freed > max_freed)
             max_freed = cur_freed;
         long garbage_bytes = pass_start_bytes - cur_bytes;
@@ -81,6 +84,38 @@ struct
             max_garbage_bytes = garbage_bytes;
     }
 
+    void begin_pause()
+    {
+        t0 = os_get_sys_clock_ms();
+    }
+
+    void end_pause()
+    {
+        long dt = os_get_sys_clock_ms() - t0;
+        t += dt;
+        pauses++;
+        if (dt > max_pause)
+            max_pause = dt;
+    }
+
+    void begin_idle()
+    {
+        idle_t0 = os_get_sys_clock_ms();
+        idle_runs++;
+    }
+
+    void count_idle_slice()
+    {
+        idle_slices++;
+    }
+
+    void end_idle()
+    {
+        long dt = os_get_sys_clock_ms() - idle_t0;
+        t += dt;
+        idle_t += dt;
+    }
+
     void count_free()
     {
         ++cur_freed;
@@ -115,7 +150,13 @@ struct
                "  peak heap bytes:       %ld\n"
                "  peak garbage bytes:    %ld\n"
                "  total gc time (ms):    %ld\n"
-               "  average gc time (ms):  %ld\n",
+               "  average gc time (ms):  %ld\n"
+               "  pauses:                %ld\n"
+               "  average pause (ms):    %ld\n"
+               "  max pause (ms):        %ld\n"
+               "  idle-time runs:        %ld\n"
+               "  idle-time slices:      %ld\n"
+               "  idle gc time (ms):     %ld\n",
                runs,
                tot_freed,
                runs != 0 ? tot_freed/runs : 0,
@@ -123,7 +164,13 @@ struct
                max_bytes,
                max_garbage_bytes,
                t,
-               runs != 0 ? t/runs : 0);
+               runs != 0 ? t/runs : 0,
+               pauses,
+               pauses != 0 ? (t - idle_t)/pauses : 0,
+               max_pause,
+               idle_runs,
+               idle_slices,
+               idle_t);
     }
 
     /* number of times the gc has run */
@@ -150,12 +197,29 @@ struct
     /* peak garbage bytes */
     long max_garbage_bytes;
 
-    /* elapsed time in garbage collector */
+    /* elapsed time in garbage collector, paused or idle */
     long t;
 
-    /* starting time in ticks of current run */
+    /* starting time in ticks of current pause */
     long t0;
 
+    /* 
+     *   number of times the VM stopped for garbage collection (full passes
+     *   plus the completion of idle-time passes), and the longest stop 
+     */
+    long pauses;
+    long max_pause;
+
+    /* number of idle-time passes, and the slices they were divided into */
+    long idle_runs;
+    long idle_slices;
+
+    /* elapsed time collecting while waiting for input */
+    long idle_t;
+
+    /* starting time in ticks of the current idle-time pass */
+    long idle_t0;
+
 } gc_stats;
 
 #else /* VMOBJ_GC_STATS */
@@ -1495,6 +1559,11 @@ void CVmObjTable::init(VMG0_)
     /* enable the garbage collector */
     gc_enabled_ = TRUE;
 
+    /* we're not waiting for input, so there's no idle-time pass */
+    gc_idle_armed_ = FALSE;
+    gc_idle_pass_ = FALSE;
+    gc_idle_swept_ = FALSE;
+
     /* there are no saved image data pointers yet */
     image_ptr_head_ = 0;
     image_ptr_tail_ = 0;
@@ -1686,14 +1755,14 @@ vm_obj_id_t CVmObjTable::alloc_obj(VMG_ int in_root_set,
 void CVmObjTable::gc_before_alloc(VMG0_)
 {
     /* count it if in statistics mode */
-    IF_GC_STATS(gc_stats.begin_pass());
+    IF_GC_STATS((gc_stats.begin_pass(), gc_stats.begin_pause()));
 
     /* run a full garbage collection pass */
     gc_pass_init(vmg0_);
     gc_pass_finish(vmg0_);
 
     /* count it if in statistics mode */
-    IF_GC_STATS(gc_stats.end_pass());
+    IF_GC_STATS((gc_stats.end_pause(), gc_stats.end_pass()));
 }
 
 /*
@@ -1975,7 +2044,7 @@ void CVmObjTable::add_to_globals(vm_obj_id_t obj)
 void CVmObjTable::gc_full(VMG0_)
 {
     /* count it if in statistics mode */
-    IF_GC_STATS(gc_stats.begin_pass());
+    IF_GC_STATS((gc_stats.begin_pass(), gc_stats.begin_pause()));
 
     /* 
      *   run the initial pass to mark globally-reachable objects, then run
@@ -1985,7 +2054,7 @@ void CVmObjTable::gc_full(VMG0_)
     gc_pass_finish(vmg0_);
 
     /* count it if in statistics mode */
-    IF_GC_STATS(gc_stats.end_pass());
+    IF_GC_STATS((gc_stats.end_pause(), gc_stats.end_pass()));
 }
 
 /*
@@ -2093,6 +2162,23 @@ int CVmObjTable::gc_pass_continue(VMG_ int trace_transient)
  *   after any number of calls (even zero) to gc_pass_continue().  
  */
 void CVmObjTable::gc_pass_finish(VMG0_)
+{
+    /* finish tracing and delete the unreachable objects */
+    gc_pass_sweep(vmg0_);
+
+    /*
+     *   All of the finalizable objects are now in the finalizer queue.  Run
+     *   through the finalizer queue and run each such object's finalizer. 
+     */
+    run_finalizers(vmg0_);
+}
+
+/*
+ *   Finish tracing and sweep.  This does all of the work of
+ *   gc_pass_finish() except for running finalizers, which leaves the
+ *   finalizer queue ready for run_finalizers().  
+ */
+void CVmObjTable::gc_pass_sweep(VMG0_)
 {
     CVmObjPageEntry **pg;
     CVmObjPageEntry *entry;
@@ -2262,12 +2348,107 @@ void CVmObjTable::gc_pass_finish(VMG0_)
      *   contained in the undo list.  
      */
     G_undo->gc_remove_stale_weak_refs(vmg0_);
+}
 
-    /*
-     *   All of the finalizable objects are now in the finalizer queue.  Run
-     *   through the finalizer queue and run each such object's finalizer. 
+/*
+ *   Idle-time garbage collection: we're about to wait for input.  Returns
+ *   true if we have work to do while waiting. 
+ */
+int CVmObjTable::gc_idle_begin(VMG0_)
+{
+    /* 
+     *   if garbage collection is disabled, or we haven't allocated enough
+     *   since the last pass to make collecting worthwhile, don't bother 
      */
-    run_finalizers(vmg0_);
+    if (!gc_enabled_
+        || (allocs_since_gc_ < max_allocs_between_gc_ / VM_GC_IDLE_FRACTION
+            && bytes_since_gc_ < max_bytes_between_gc_ / VM_GC_IDLE_FRACTION))
+        return FALSE;
+
+    /* 
+     *   Don't start the pass yet: tracing the roots is part of the work,
+     *   so it's done in the first slice.  If the caller never gets around
+     *   to calling gc_idle_step(), there's nothing for gc_idle_end() to do.  
+     */
+    gc_idle_armed_ = TRUE;
+    return TRUE;
+}
+
+/*
+ *   Idle-time garbage collection: do one slice of work.  Returns true if
+ *   there's more work to do.  
+ */
+int CVmObjTable::gc_idle_step(VMG0_)
+{
+    /* if we're not waiting for input, there's nothing to do */
+    if (!gc_idle_armed_ || gc_idle_swept_)
+        return FALSE;
+
+    /* count the slice */
+    IF_GC_STATS(gc_stats.count_idle_slice());
+
+    /* if we haven't started the pass yet, trace the roots */
+    if (!gc_idle_pass_)
+    {
+        IF_GC_STATS((gc_stats.begin_pass(), gc_stats.begin_idle()));
+        gc_pass_init(vmg0_);
+        gc_idle_pass_ = TRUE;
+        return TRUE;
+    }
+
+    /* trace the next increment of the work queue */
+    if (gc_pass_continue(vmg_ TRUE))
+        return TRUE;
+
+    /* 
+     *   the queue is empty, so everything reachable is marked - finish up
+     *   by deleting the garbage; the finalizers have to wait until we're
+     *   back in the VM, since they run byte code 
+     */
+    gc_pass_sweep(vmg0_);
+    gc_idle_swept_ = TRUE;
+    IF_GC_STATS(gc_stats.end_idle());
+
+    /* we're done */
+    return FALSE;
+}
+
+/*
+ *   Idle-time garbage collection: we're done waiting for input, and we're
+ *   about to return to the VM. 
+ */
+void CVmObjTable::gc_idle_end(VMG0_)
+{
+    /* if we didn't arm the idle callback, there's nothing to do */
+    if (!gc_idle_armed_)
+        return;
+
+    /* finish the pass, if we started one */
+    if (gc_idle_pass_)
+    {
+        if (!gc_idle_swept_)
+        {
+            /* 
+             *   the player beat us to it, so we have to stop and finish the
+             *   remaining tracing and sweeping now 
+             */
+            IF_GC_STATS((gc_stats.end_idle(), gc_stats.begin_pause()));
+            gc_pass_finish(vmg0_);
+            IF_GC_STATS(gc_stats.end_pause());
+        }
+        else
+        {
+            /* the sweep is done; just run the finalizers */
+            run_finalizers(vmg0_);
+        }
+
+        IF_GC_STATS(gc_stats.end_pass());
+    }
+
+    /* we're no longer in an idle-time pass */
+    gc_idle_armed_ = FALSE;
+    gc_idle_pass_ = FALSE;
+    gc_idle_swept_ = FALSE;
 }
 
 /*
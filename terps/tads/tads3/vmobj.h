@@ -106,6 +106,16 @@ Modified
  */
 const int VM_GC_WORK_INCREMENT = 500;
 
+/*
+ *   Idle-time collection threshold.  When the VM is about to wait for a
+ *   line of input, we start an incremental pass if at least this fraction
+ *   (1/N) of the allocation limit that would force a collection has been
+ *   used up since the last pass.  Collecting while the player is typing
+ *   keeps the allocation counters low enough that we rarely have to stop
+ *   in the middle of a turn to collect garbage.  
+ */
+const int VM_GC_IDLE_FRACTION = 4;
+
 
 
 /* ------------------------------------------------------------------------ */
@@ -1859,6 +1869,29 @@ public:
     int  gc_pass_continue(VMG0_) { return gc_pass_continue(vmg_ TRUE); }
     void gc_pass_finish(VMG0_);
 
+    /*
+     *   Idle-time garbage collection.  The console calls gc_idle_begin()
+     *   just before it blocks waiting for a line of input, and
+     *   gc_idle_end() as soon as the wait returns, before any byte-code
+     *   runs.  If enough has been allocated since the last pass,
+     *   gc_idle_begin() returns true, and the console registers
+     *   gc_idle_step() with the OS layer, which calls it repeatedly while
+     *   the player is typing.  The first step starts the pass, each
+     *   further step traces one work increment, and the step that empties
+     *   the work queue sweeps the unreachable objects.  gc_idle_end()
+     *   completes whatever work is left (this is the only part of an idle
+     *   pass that the player can notice) and then runs any pending
+     *   finalizers.
+     *   
+     *   Because the pass is always completed before control returns to
+     *   the VM, the restriction on VM activity described above for
+     *   gc_pass_init() is satisfied without a write barrier: no object
+     *   can be created or modified while the pass is partially marked.  
+     */
+    int  gc_idle_begin(VMG0_);
+    int  gc_idle_step(VMG0_);
+    void gc_idle_end(VMG0_);
+
     /*
      *   Run pending finalizers.  This can be run at any time other than
      *   during garbage collection (i.e., between gc_pass_init() and
@@ -2356,6 +2389,13 @@ private:
     /* garbage collection: trace objects reachable from machine globals */
     void gc_trace_globals(VMG0_);
 
+    /* 
+     *   Garbage collection: process the rest of the work queue and delete
+     *   unreachable objects.  This is all of gc_pass_finish() except
+     *   running finalizers.  
+     */
+    void gc_pass_sweep(VMG0_);
+
     /* garbage collection: trace all objects reachable from the work queue */
     void gc_trace_work_queue(VMG_ int trace_transient);
 
@@ -2458,6 +2498,15 @@ private:
 
     /* garbage collection enabled */
     uint gc_enabled_ : 1;
+
+    /* 
+     *   idle-time collection state (see gc_idle_begin()): we're waiting for
+     *   input with gc_idle_step() registered; the pass has been started;
+     *   the pass has finished its sweep 
+     */
+    uint gc_idle_armed_ : 1;
+    uint gc_idle_pass_ : 1;
+    uint gc_idle_swept_ : 1;
 };
 
 /* ------------------------------------------------------------------------ */
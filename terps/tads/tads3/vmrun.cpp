@@ -816,10 +816,23 @@ public:
         switch(self.typ)
         {
         case VM_OBJ:
-            /* get the property value from the target object */
-            return vm_objp(vmg_ self.val.obj)
-                ->get_prop(vmg_ target_prop, &val, self.val.obj,
-                           &defining_obj, &argc);
+            {
+                /* 
+                 *   TadsObjects can use the inline property cache for this
+                 *   instruction - caller_ofs is the offset of the next
+                 *   instruction, which identifies the call site 
+                 */
+                CVmObject *objp = vm_objp(vmg_ self.val.obj);
+                if (objp->get_metaclass_reg() == CVmObjTads::metaclass_reg_)
+                    return ((CVmObjTads *)objp)->get_prop_cached(
+                        vmg_ G_interpreter->get_entry_ptr() + caller_ofs,
+                        target_prop, &val, self.val.obj,
+                        &defining_obj, &argc);
+
+                /* get the property value from the target object */
+                return objp->get_prop(vmg_ target_prop, &val, self.val.obj,
+                                      &defining_obj, &argc);
+            }
 
         case VM_LIST:
             f_const_get_prop = &CVmObjList::const_get_prop;
@@ -11,9 +11,9 @@ static char RCSid[] =
  */
 /*
 Name
-  vmsort.cpp - T3 VM quicksort implementation
+  vmsort.cpp - T3 VM sorting implementation
 Function
-  Implements quicksort.  We use our own implementation rather than the
+  Implements introsort.  We use our own implementation rather than the
   standard C library's qsort() routine for two reasons.  First, we might
   want to throw an exception out of the comparison routine, and it is
   not clear that it is safe to longjmp() past qsort() on every type of
@@ -36,57 +36,178 @@ Modified
 
 /* ------------------------------------------------------------------------ */
 /*
- *   perform a quicksort
+ *   perform an introsort
  */
 void CVmQSortData::sort(VMG_ size_t l, size_t r)
 {
     /* proceed if we have a non-empty range */
     if (r > l)
     {
-        size_t i, j;
-        size_t v_idx = r;
+        /* 
+         *   allow partitioning to recurse to twice the depth we'd expect
+         *   with perfect splits before we give up and use heapsort 
+         */
+        int depth = 0;
+        for (size_t n = r - l + 1 ; n > 1 ; n >>= 1)
+            depth += 2;
 
-        /* start at the ends of the range */
-        i = l - 1;
-        j = r;
+        /* sort the range */
+        introsort(vmg_ l, r, depth);
+    }
+}
+
+/*
+ *   introsort a range 
+ */
+void CVmQSortData::introsort(VMG_ size_t l, size_t r, int depth)
+{
+    /* 
+     *   Keep going until the remaining range is small.  After partitioning,
+     *   we recurse into the smaller subrange and loop on the larger, so the
+     *   recursion depth is at most log2 of the range size.  
+     */
+    while (r - l + 1 > VMSORT_INSERTION_MAX)
+    {
+        /* 
+         *   if we've run out of depth budget, this range is giving us bad
+         *   splits, so heapsort it instead 
+         */
+        if (depth-- == 0)
+        {
+            heapsort(vmg_ l, r);
+            return;
+        }
 
         /* partition the range */
-        do
+        size_t i = partition(vmg_ l, r);
+
+        /* sort the smaller side recursively, and the larger side here */
+        if (i - l < r - i)
         {
-            /* find the leftmost element >= the right element */
-            do
-            {
-                ++i;
-            } while (i != r && compare(vmg_ i, v_idx) < 0);
+            if (i > l)
+                introsort(vmg_ l, i - 1, depth);
+            l = i + 1;
+        }
+        else
+        {
+            if (i < r)
+                introsort(vmg_ i + 1, r, depth);
+            r = i - 1;
+        }
+    }
 
-            /* find the rightmost element <= the right element */
-            do
-            {
-                --j;
-            } while (j != l && compare(vmg_ j, v_idx) > 0);
+    /* finish the small range with an insertion sort */
+    insertion_sort(vmg_ l, r);
+}
+
+/*
+ *   Partition a range.  We choose the median of the first, middle, and last
+ *   elements as the pivot, then rearrange the range so that the elements
+ *   before the pivot are no greater than the pivot and the elements after
+ *   it are no less than the pivot.  Returns the pivot's final index.  The
+ *   range must have at least three elements.
+ *   
+ *   We're careful to stay within the range even if the comparison function
+ *   is inconsistent, as a user-defined comparison function might be.  
+ */
+size_t CVmQSortData::partition(VMG_ size_t l, size_t r)
+{
+    /* put the first, middle, and last elements in order */
+    size_t m = l + (r - l)/2;
+    if (compare(vmg_ m, l) < 0)
+        exchange(vmg_ m, l);
+    if (compare(vmg_ r, l) < 0)
+        exchange(vmg_ r, l);
+    if (compare(vmg_ r, m) < 0)
+        exchange(vmg_ r, m);
 
-            /* exchange elements i and j */
-            exchange(vmg_ i, j);
+    /* the middle one is the median, so use it as the pivot at the right */
+    exchange(vmg_ m, r);
 
-            /* if we moved the 'v' element, follow that in the index */
-            if (v_idx == i)
-                v_idx = j;
-            else if (v_idx == j)
-                v_idx = i;
+    /* 
+     *   Scan inwards from the ends of the range, exchanging out-of-place
+     *   pairs.  Everything before 'i' belongs before the pivot, and
+     *   everything from 'j' up to the pivot belongs after it.  Both scans
+     *   stop at elements equal to the pivot, which keeps the split even
+     *   when there are many equal elements.  
+     */
+    size_t i = l, j = r;
+    for (;;)
+    {
+        while (i < j && compare(vmg_ i, r) < 0)
+            ++i;
+        while (i < j && compare(vmg_ j - 1, r) > 0)
+            --j;
 
-        } while (j > i);
+        /* stop when the scans meet */
+        if (j - i <= 1)
+            break;
 
-        /* undo the last exchange */
-        exchange(vmg_ i, j);
+        /* exchange the out-of-place pair and move past them */
+        exchange(vmg_ i, j - 1);
+        ++i;
+        --j;
+    }
 
-        /* exchange the right value into the pivot point */
+    /* move the pivot into its final position */
+    if (i != r)
         exchange(vmg_ i, r);
+    return i;
+}
+
+/*
+ *   heapsort a range 
+ */
+void CVmQSortData::heapsort(VMG_ size_t l, size_t r)
+{
+    size_t n = r - l + 1;
 
-        /* recursively sort the subranges */
-        if (i > l)
-            sort(vmg_ l, i - 1);
-        if (i < r)
-            sort(vmg_ i + 1, r);
+    /* build a max-heap */
+    for (size_t i = n/2 ; i != 0 ; --i)
+        sift_down(vmg_ l, i - 1, n);
+
+    /* repeatedly move the largest remaining element to the end */
+    for (size_t end = n - 1 ; end != 0 ; --end)
+    {
+        exchange(vmg_ l, l + end);
+        sift_down(vmg_ l, 0, end);
+    }
+}
+
+/*
+ *   sift a heap element down to its proper level; 'i' is relative to 'l' 
+ */
+void CVmQSortData::sift_down(VMG_ size_t l, size_t i, size_t n)
+{
+    for (;;)
+    {
+        /* find the larger child */
+        size_t c = 2*i + 1;
+        if (c >= n)
+            break;
+        if (c + 1 < n && compare(vmg_ l + c, l + c + 1) < 0)
+            ++c;
+
+        /* if the child isn't larger than the parent, we're done */
+        if (compare(vmg_ l + i, l + c) >= 0)
+            break;
+
+        /* move the child up, and continue from there */
+        exchange(vmg_ l + i, l + c);
+        i = c;
+    }
+}
+
+/*
+ *   insertion sort a range 
+ */
+void CVmQSortData::insertion_sort(VMG_ size_t l, size_t r)
+{
+    for (size_t i = l + 1 ; i <= r ; ++i)
+    {
+        /* move element i back until it's in order */
+        for (size_t j = i ; j > l && compare(vmg_ j - 1, j) > 0 ; --j)
+            exchange(vmg_ j - 1, j);
     }
 }
 
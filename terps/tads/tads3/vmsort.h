@@ -8,7 +8,7 @@
  */
 /*
 Name
-  vmsort.h - T3 VM quicksort implementation
+  vmsort.h - T3 VM sorting implementation
 Function
   
 Notes
@@ -27,6 +27,15 @@ Modified
 #include "vmrun.h"
 
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   Ranges of this many elements or fewer are sorted by straight insertion
+ *   rather than by partitioning or merging.  Insertion sort does fewer
+ *   comparisons than the general algorithms on ranges this small, and
+ *   comparisons can be expensive (they might call back into byte code).  
+ */
+const size_t VMSORT_INSERTION_MAX = 8;
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Quicksort data interface 
@@ -36,7 +45,13 @@ class CVmQSortData
 public:
     /* 
      *   sort a range; to sort the entire array, provide the indices of
-     *   the first and last elements of the array, inclusive 
+     *   the first and last elements of the array, inclusive
+     *   
+     *   This is an introsort: a quicksort with median-of-three pivot
+     *   selection that switches to heapsort for any range where the
+     *   partitioning recurses too deeply, and to insertion sort for small
+     *   ranges.  It runs in O(n log n) time in the worst case, but it's not
+     *   stable - elements that compare equal can end up in any order.  
      */
     void sort(VMG_ size_t l, size_t r);
     
@@ -49,6 +64,22 @@ public:
 
     /* exchange two elements */
     virtual void exchange(VMG_ size_t idx_a, size_t idx_b) = 0;
+
+protected:
+    /* introsort a range, with the given partitioning depth budget */
+    void introsort(VMG_ size_t l, size_t r, int depth);
+
+    /* partition a range around a median-of-three pivot */
+    size_t partition(VMG_ size_t l, size_t r);
+
+    /* heapsort a range */
+    void heapsort(VMG_ size_t l, size_t r);
+
+    /* sift an element down into a heap occupying l..l+n-1 */
+    void sift_down(VMG_ size_t l, size_t i, size_t n);
+
+    /* insertion sort a range */
+    void insertion_sort(VMG_ size_t l, size_t r);
 };
 
 /* ------------------------------------------------------------------------ */
@@ -67,7 +98,21 @@ public:
     /* get/set an element */
     virtual void get_ele(VMG_ size_t idx, vm_val_t *val) = 0;
     virtual void set_ele(VMG_ size_t idx, const vm_val_t *val) = 0;
-    
+
+    /*
+     *   Sort a range (given by inclusive indices, as with sort()) with a
+     *   stable merge sort: elements that compare equal keep their original
+     *   relative order.  This also runs in O(n log n) time in the worst
+     *   case, and in linear time when the range is already in order.
+     *   
+     *   Rather than working through compare() and exchange(), we copy the
+     *   values out into a temporary array, sort the array directly, and
+     *   store each value back once at the end.  This needs temporary
+     *   memory for two copies of the range; if that's not available, we
+     *   fall back on the in-place sort().  
+     */
+    void sort_stable(VMG_ size_t l, size_t r);
+
     /* compare */
     virtual int compare(VMG_ size_t idx_a, size_t idx_b);
 
@@ -85,6 +130,16 @@ public:
 
     /* recursive native caller context */
     vm_rcdesc rc;
+
+protected:
+    /* compare two values */
+    int compare_vals(VMG_ const vm_val_t *val_a, const vm_val_t *val_b);
+
+    /* 
+     *   merge sort an array of 'n' values, using 'tmp' (also 'n' values)
+     *   as scratch space; returns whichever of the two holds the result 
+     */
+    vm_val_t *merge_sort(VMG_ vm_val_t *arr, vm_val_t *tmp, size_t n);
 };
 
 #endif /* VMSORT_H */
@@ -21,6 +21,7 @@ Modified
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include "t3std.h"
 #include "vmglob.h"
 #include "vmsort.h"
@@ -32,11 +33,10 @@ Modified
 
 /* ------------------------------------------------------------------------ */
 /*
- *   compare two vm_val_t values 
+ *   compare two elements by index 
  */
 int CVmQSortVal::compare(VMG_ size_t a, size_t b)
 {
-    int result;
     vm_val_t val_a;
     vm_val_t val_b;
 
@@ -44,14 +44,26 @@ int CVmQSortVal::compare(VMG_ size_t a, size_t b)
     get_ele(vmg_ a, &val_a);
     get_ele(vmg_ b, &val_b);
 
+    /* compare them */
+    return compare_vals(vmg_ &val_a, &val_b);
+}
+
+/*
+ *   compare two vm_val_t values 
+ */
+int CVmQSortVal::compare_vals(VMG_ const vm_val_t *val_a,
+                              const vm_val_t *val_b)
+{
+    int result;
+
     /* check for an explicit comparison function */
     if (compare_fn_.typ != VM_NIL)
     {
         vm_val_t val;
 
         /* push the values (in reverse order) */
-        G_stk->push(&val_b);
-        G_stk->push(&val_a);
+        G_stk->push(val_b);
+        G_stk->push(val_a);
 
         /* invoke the callback */
         G_interpreter->call_func_ptr(vmg_ &compare_fn_, 2, &rc, 0);
@@ -65,7 +77,7 @@ int CVmQSortVal::compare(VMG_ size_t a, size_t b)
     else
     {
         /* compare the values */
-        result = val_a.compare_to(vmg_ &val_b);
+        result = val_a->compare_to(vmg_ val_b);
     }
 
     /* if we're sorting in descending order, reverse the result */
@@ -93,3 +105,131 @@ void CVmQSortVal::exchange(VMG_ size_t a, size_t b)
     set_ele(vmg_ a, &val_b);
 }
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   perform a stable sort 
+ */
+void CVmQSortVal::sort_stable(VMG_ size_t l, size_t r)
+{
+    /* there's nothing to do unless we have at least two elements */
+    if (r <= l)
+        return;
+
+    /* 
+     *   allocate space for the values plus the merge scratch space; if
+     *   that fails, fall back on the in-place sort, which needs no extra
+     *   memory, but isn't stable 
+     */
+    size_t n = r - l + 1;
+    vm_val_t *arr = (vm_val_t *)t3malloc(n * 2 * sizeof(vm_val_t));
+    if (arr == 0)
+    {
+        sort(vmg_ l, r);
+        return;
+    }
+
+    err_try
+    {
+        size_t i;
+
+        /* 
+         *   Load the values.  The originals stay in place in our container
+         *   while we sort, so they remain reachable if the comparison
+         *   function triggers garbage collection. 
+         */
+        for (i = 0 ; i < n ; ++i)
+            get_ele(vmg_ l + i, &arr[i]);
+
+        /* sort them */
+        const vm_val_t *res = merge_sort(vmg_ arr, arr + n, n);
+
+        /* store them back in their new order */
+        for (i = 0 ; i < n ; ++i)
+            set_ele(vmg_ l + i, &res[i]);
+    }
+    err_finally
+    {
+        /* done with the temporary arrays */
+        t3free(arr);
+    }
+    err_end;
+}
+
+/*
+ *   Merge sort an array of values.  We sort short runs by insertion, then
+ *   merge runs bottom-up, alternating between the array and the scratch
+ *   space.  
+ */
+vm_val_t *CVmQSortVal::merge_sort(VMG_ vm_val_t *arr, vm_val_t *tmp,
+                                  size_t n)
+{
+    size_t lo;
+
+    /* 
+     *   insertion sort each run - an element moves back only past elements
+     *   that are strictly greater, which keeps the sort stable 
+     */
+    for (lo = 0 ; lo < n ; lo += VMSORT_INSERTION_MAX)
+    {
+        size_t hi = (n - lo > VMSORT_INSERTION_MAX
+                     ? lo + VMSORT_INSERTION_MAX : n);
+        for (size_t i = lo + 1 ; i < hi ; ++i)
+        {
+            vm_val_t val = arr[i];
+            size_t j;
+            for (j = i ; j > lo && compare_vals(vmg_ &arr[j-1], &val) > 0 ;
+                 --j)
+                arr[j] = arr[j-1];
+            arr[j] = val;
+        }
+    }
+
+    /* merge pairs of runs, doubling the run width on each pass */
+    vm_val_t *src = arr, *dst = tmp;
+    for (size_t width = VMSORT_INSERTION_MAX ; width < n ; width *= 2)
+    {
+        for (lo = 0 ; lo < n ; lo += 2*width)
+        {
+            size_t mid = (n - lo > width ? lo + width : n);
+            size_t hi = (n - mid > width ? mid + width : n);
+
+            /* 
+             *   if there's no second run, or the runs are already in order
+             *   relative to each other, just copy the pair through 
+             */
+            if (mid == hi
+                || compare_vals(vmg_ &src[mid-1], &src[mid]) <= 0)
+            {
+                memcpy(dst + lo, src + lo, (hi - lo) * sizeof(src[0]));
+                continue;
+            }
+
+            /* 
+             *   merge the runs, taking from the first run on ties to keep
+             *   the sort stable 
+             */
+            size_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi)
+            {
+                if (compare_vals(vmg_ &src[i], &src[j]) <= 0)
+                    dst[k++] = src[i++];
+                else
+                    dst[k++] = src[j++];
+            }
+
+            /* copy whichever run has elements left */
+            if (i < mid)
+                memcpy(dst + k, src + i, (mid - i) * sizeof(src[0]));
+            else
+                memcpy(dst + k, src + j, (hi - j) * sizeof(src[0]));
+        }
+
+        /* the merged runs are now the source for the next pass */
+        vm_val_t *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    /* return the array holding the final result */
+    return src;
+}
@@ -322,6 +322,11 @@ void CVmObjTads::class_init(VMG0_)
     VM_IFELSE_ALLOC_PRE_GLOBAL(
         G_tadsobj_queue = new CVmObjTadsInhQueue(),
         G_tadsobj_queue->init());
+
+    /* allocate the inline property cache */
+    VM_IFELSE_ALLOC_PRE_GLOBAL(
+        G_tadsobj_ic = new CVmObjTadsPropCache(),
+        G_tadsobj_ic->init());
 }
 
 /*
@@ -329,13 +334,48 @@ void CVmObjTads::class_init(VMG0_)
  */
 void CVmObjTads::class_term(VMG0_)
 {
-    /* delete the inheritance analysis object */
+    /* delete the inheritance analysis object and property cache */
     VM_IF_ALLOC_PRE_GLOBAL(
         delete G_tadsobj_queue;
         G_tadsobj_queue = 0;
+
+        delete G_tadsobj_ic;
+        G_tadsobj_ic = 0;
     )
 }
 
+/*
+ *   Invalidate the inline property cache.  Objects can be deleted after
+ *   class termination has discarded the cache, so check that it's there. 
+ */
+static void inval_prop_cache(VMG0_)
+{
+    if (G_tadsobj_ic != 0)
+        G_tadsobj_ic->invalidate();
+}
+
+/*
+ *   Invalidate the inline property cache on a change to the given object's
+ *   property table or superclasses.  Only objects searched by a cached
+ *   lookup can affect the cache, so ignore anything else. 
+ */
+static void inval_prop_cache(VMG_ const vm_tadsobj_hdr *hdr)
+{
+    if (hdr != 0 && (hdr->intern_obj_flags & VMTO_OBJ_IC) != 0)
+        inval_prop_cache(vmg0_);
+}
+
+/*
+ *   Invalidate cached lookups of one property on adding it to the given
+ *   object's property table. 
+ */
+static void inval_prop_cache(VMG_ const vm_tadsobj_hdr *hdr,
+                             vm_prop_id_t prop)
+{
+    if ((hdr->intern_obj_flags & VMTO_OBJ_IC) != 0)
+        G_tadsobj_ic->invalidate_prop(prop);
+}
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Static creation methods 
@@ -640,6 +680,12 @@ CVmObjTads::CVmObjTads(VMG_ ushort superclass_count, ushort prop_count)
  */
 void CVmObjTads::notify_delete(VMG_ int in_root_set)
 {
+    /* 
+     *   our object ID could be reused, and our property table is going
+     *   away, so forget any cached lookups 
+     */
+    inval_prop_cache(vmg_ get_hdr());
+
     /* free our extension */
     if (ext_ != 0)
     {
@@ -786,6 +832,9 @@ void CVmObjTads::set_prop(VMG_ CVmUndo *undo, vm_obj_id_t self,
          */
         if (!hdr->has_free_entries(1))
         {
+            /* the table is about to move, so cached slots will be stale */
+            inval_prop_cache(vmg_ hdr);
+
             /* expand the extension to make room for more properties */
             ext_ = (char *)vm_tadsobj_hdr::expand(vmg_ this, hdr);
 
@@ -796,6 +845,9 @@ void CVmObjTads::set_prop(VMG_ CVmUndo *undo, vm_obj_id_t self,
         /* allocate a new entry */
         entry = hdr->alloc_prop_entry(prop, val, 0);
 
+        /* the new property could override an inherited definition */
+        inval_prop_cache(vmg_ hdr, prop);
+
         /* 
          *   The old value didn't exist, so mark it emtpy, with an intval of
          *   zero.  The zero indicates that this is a newly created property
@@ -1013,24 +1065,46 @@ struct tadsobj_sc_search_ctx
      *   in *val and *source.  Returns false if not found.  
      */
     int find_prop(VMG_ uint prop, vm_val_t *val, vm_obj_id_t *source)
+    {
+        /* find the property's slot */
+        vm_tadsobj_prop *entry = find_prop_entry(vmg_ prop, FALSE);
+        if (entry != 0)
+        {
+            /* we found the property - return it */
+            *val = entry->val;
+            *source = cur;
+            return TRUE;
+        }
+
+        /* we've exhausted the search path - return failure */
+        return FALSE;
+    }
+
+    /*
+     *   Find the property table slot for the given property, searching our
+     *   superclass list until we find an object providing the property.
+     *   Returns the slot, with 'cur' set to the object containing it, or
+     *   null if the property isn't found.  If 'mark_cached' is true, we flag
+     *   each object we search as having inline property cache dependents.  
+     */
+    vm_tadsobj_prop *find_prop_entry(VMG_ uint prop, int mark_cached)
     {
         /* keep going until we find the property */
         do
         {
+            /* note that a cached lookup depends on this object */
+            if (mark_cached)
+                curhdr->intern_obj_flags |= VMTO_OBJ_IC;
+
             /* look for this property in the current object */
             vm_tadsobj_prop *entry = curhdr->find_prop_entry(prop);
             if (entry != 0)
-            {
-                /* we found the property - return it */
-                *val = entry->val;
-                *source = cur;
-                return TRUE;
-            }
+                return entry;
         }
         while (to_next(vmg0_));
 
-        /* we've exhausted the search path - return failure */
-        return FALSE;
+        /* we've exhausted the search path */
+        return 0;
     }
 
     /*  
@@ -1257,6 +1331,69 @@ int CVmObjTads::get_prop(VMG_ vm_prop_id_t prop, vm_val_t *val,
     return CVmObject::get_prop(vmg_ prop, val, self, source_obj, argc);
 }
 
+/*
+ *   Get a property on behalf of a byte-code instruction, using the inline
+ *   property cache. 
+ */
+int CVmObjTads::get_prop_cached(VMG_ const uchar *site, vm_prop_id_t prop,
+                                vm_val_t *val, vm_obj_id_t self,
+                                vm_obj_id_t *source_obj, uint *argc)
+{
+    vm_tadsobj_hdr *hdr = get_hdr();
+    vm_tadsobj_prop *entry;
+
+    /* 
+     *   Our own property table overrides anything inherited, and checking
+     *   it is as fast as checking the cache, so always look here first.
+     */
+    if ((entry = hdr->find_prop_entry(prop)) != 0)
+    {
+        *val = entry->val;
+        *source_obj = self;
+        return TRUE;
+    }
+
+    /* 
+     *   If we have a single superclass, the rest of the search is exactly
+     *   the search of that superclass, so the result is the same for every
+     *   direct instance of the class: key the cache on the superclass, so
+     *   that all of them share an entry.  Otherwise the search path is
+     *   particular to this object, so key the cache on 'self'. 
+     */
+    vm_obj_id_t key = self;
+    CVmObjTads *keyp = this;
+    if (hdr->sc_cnt == 1)
+    {
+        key = hdr->sc[0].id;
+        keyp = hdr->sc[0].objp;
+    }
+
+    /* check the cache */
+    if (G_tadsobj_ic->find(site, key, prop, val, source_obj))
+        return TRUE;
+
+    /* 
+     *   search the inherited property tables; if we find it, remember where
+     *   for the next evaluation from the same instruction 
+     */
+    tadsobj_sc_search_ctx curpos(vmg_ key, keyp);
+    if ((entry = curpos.find_prop_entry(vmg_ prop, TRUE)) != 0)
+    {
+        G_tadsobj_ic->store(site, key, prop, curpos.cur, entry);
+        *val = entry->val;
+        *source_obj = curpos.cur;
+        return TRUE;
+    }
+
+    /* 
+     *   it's not in a property table, so proceed as in get_prop() - try the
+     *   intrinsic class methods, then the base metaclass 
+     */
+    if (get_prop_intrinsic(vmg_ prop, val, self, source_obj, argc))
+        return TRUE;
+    return CVmObject::get_prop(vmg_ prop, val, self, source_obj, argc);
+}
+
 /*
  *   Inherit a property.  
  */
@@ -1442,6 +1579,9 @@ void CVmObjTads::apply_undo(VMG_ CVmUndoRecord *rec)
     /* get my header */
     vm_tadsobj_hdr *hdr = get_hdr();
 
+    /* undo can remove properties or change superclasses */
+    inval_prop_cache(vmg_ hdr);
+
     /* 
      *   if the property is valid, it's a simple property change record;
      *   otherwise it's some other object-level change 
@@ -1725,6 +1865,9 @@ void CVmObjTads::restore_from_file(VMG_ vm_obj_id_t self,
         hdr->sc[i].objp = 0;
     }
 
+    /* our property table has been rebuilt */
+    inval_prop_cache(vmg0_);
+
     /* request post-load initialization, to set up the superclass list */
     G_obj_table->request_post_load_init(self);
 
@@ -1782,6 +1925,12 @@ void CVmObjTads::post_load_init(VMG_ vm_obj_id_t self)
     /* cache the superclass object pointers */
     for (int i = 0 ; i < hdr->sc_cnt ; ++i)
         hdr->sc[i].objp = (CVmObjTads *)vm_objp(vmg_ hdr->sc[i].id);
+
+    /* 
+     *   we've just been loaded, reset or restored, so any cached property
+     *   lookups involving us are out of date 
+     */
+    inval_prop_cache(vmg0_);
 }
 
 /* ------------------------------------------------------------------------ */
@@ -1824,6 +1973,9 @@ void CVmObjTads::load_from_image(VMG_ vm_obj_id_t self,
     /* load the image file properties */
     load_image_props_and_scs(vmg_ ptr, siz);
 
+    /* our property table has been rebuilt */
+    inval_prop_cache(vmg0_);
+
     /* request post-load initialization, to set up the superclass list */
     G_obj_table->request_post_load_init(self);
 }
@@ -1865,6 +2017,9 @@ void CVmObjTads::reload_from_image(VMG_ vm_obj_id_t self,
     /* we're now unmodified from the image file state */
     hdr->intern_obj_flags &= ~VMTO_OBJ_MOD;
 
+    /* our property table has been rebuilt */
+    inval_prop_cache(vmg0_);
+
     /* request post-load initialization, to set up the superclass list */
     G_obj_table->request_post_load_init(self);
 }
@@ -2267,6 +2422,9 @@ void CVmObjTads::change_superclass_list(VMG_ const vm_val_t *lst, int cnt)
 
     /* invalidate the cached inheritance path */
     hdr->inval_inh_path();
+
+    /* the cached property lookups are no longer valid either */
+    inval_prop_cache(vmg_ hdr);
 }
 
 /* ------------------------------------------------------------------------ */
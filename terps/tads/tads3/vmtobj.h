@@ -47,6 +47,18 @@ Modified
 /* forward-declare our main class */
 class CVmObjTads;
 
+/* 
+ *   Inline property cache statistics.  Define VMTOBJ_IC_STATS to count
+ *   cache lookups and hits, and display the totals at VM termination. 
+ */
+//#define VMTOBJ_IC_STATS
+#ifdef VMTOBJ_IC_STATS
+# include <stdio.h>
+# define IF_IC_STATS(x) x
+#else
+# define IF_IC_STATS(x)
+#endif
+
 /* ------------------------------------------------------------------------ */
 /*
  *   TADS-Object image file data.  The image file state is loaded into an
@@ -230,6 +242,12 @@ struct vm_tadsobj_prop
 /* modified - object has been modified since being loaded from image */
 #define VMTO_OBJ_MOD     0x0002
 
+/* 
+ *   cached - the inline property cache might hold lookups that searched
+ *   this object's property table 
+ */
+#define VMTO_OBJ_IC      0x0004
+
 
 /*
  *   Property entry flags 
@@ -398,6 +416,16 @@ public:
     int get_prop(VMG_ vm_prop_id_t prop, vm_val_t *val,
                  vm_obj_id_t self, vm_obj_id_t *source_obj, uint *argc);
 
+    /* 
+     *   Get a property on behalf of the byte-code instruction at 'site'.
+     *   This is the same as get_prop(), but inherited properties are looked
+     *   up through the inline property cache, so that repeated evaluations
+     *   from the same instruction can skip the superclass search. 
+     */
+    int get_prop_cached(VMG_ const uchar *site, vm_prop_id_t prop,
+                        vm_val_t *val, vm_obj_id_t self,
+                        vm_obj_id_t *source_obj, uint *argc);
+
     /* inherit a property */
     int inh_prop(VMG_ vm_prop_id_t prop, vm_val_t *val,
                  vm_obj_id_t self,
@@ -1073,7 +1101,238 @@ protected:
     pfq_page *alloc_;
 };
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   Inline property cache.  Property evaluations in byte code (GETPROP,
+ *   CALLPROP and their variants) tend to see the same few objects over and
+ *   over at any given instruction, so we remember the results of recent
+ *   inherited lookups, keyed by the address of the instruction plus the
+ *   object where the superclass search started and the property.  A hit
+ *   gives us the defining object and the property table slot holding the
+ *   value, which saves searching the superclass chain.
+ *   
+ *   TADS objects don't have classes in the usual sense - any object can
+ *   serve as a prototype for others - so we can't key on a class the way
+ *   a conventional inline cache would.  What we can do is observe that an
+ *   object with a single superclass searches its own table and then
+ *   exactly the superclass's search path.  get_prop_cached() always checks
+ *   'self' directly, and keys the rest of the search on the superclass,
+ *   so all of the direct instances of a class share cache entries.
+ *   Objects with multiple superclasses have their own linearized search
+ *   paths, so their lookups are keyed on 'self'.
+ *   
+ *   The cache is organized as a set-associative table: each instruction
+ *   address hashes to one set, and each set holds a few entries, so a
+ *   given instruction can have a few different objects cached at once.  
+ *   
+ *   Because we cache the slot rather than the value, storing a new value
+ *   in an existing property doesn't affect the cache.  Anything that can
+ *   change which slot a lookup finds - reallocating an object's property
+ *   table, changing a superclass list, deleting an object, undo, restore -
+ *   must call invalidate(), which simply advances the cache epoch.  An
+ *   entry is only valid if it was stored during the current epoch.
+ *   
+ *   Adding a property to an object is by far the most common of these
+ *   changes, and it can only affect lookups of that one property, so it
+ *   calls invalidate_prop() instead.  This advances a generation counter
+ *   for the property (properties share counters by hash), which must also
+ *   match for an entry to be valid.  
+ */
+
+/* number of sets - must be a power of 2 */
+const size_t VMTOBJ_IC_SETS = 1024;
+
+/* number of entries per set */
+const int VMTOBJ_IC_WAYS = 4;
+
+/* number of property generation counters - must be a power of 2 */
+const size_t VMTOBJ_IC_PROP_GENS = 256;
+
+/* a cache entry */
+struct vm_tadsobj_ic_entry
+{
+    /* the instruction, starting object, and property of the lookup */
+    const uchar *site;
+    vm_obj_id_t obj;
+    vm_prop_id_t prop;
+
+    /* the object that defines the property, and its property slot */
+    vm_obj_id_t defining_obj;
+    vm_tadsobj_prop *slot;
+
+    /* the cache epoch and property generation when the entry was stored */
+    uint32_t epoch;
+    uint32_t gen;
+};
+
+class CVmObjTadsPropCache
+{
+public:
+    CVmObjTadsPropCache()
+    {
+        init();
+    }
+
+    void init()
+    {
+        /* clear the table */
+        clear();
+
+        /* no statistics yet */
+        IF_IC_STATS(lookups_ = hits_ = stores_ = invals_ = prop_invals_ = 0);
+    }
+
+    ~CVmObjTadsPropCache()
+    {
+        /* show statistics if applicable */
+        IF_IC_STATS(display());
+    }
+
+    /*
+     *   Look up a property.  If we have a valid entry for the site,
+     *   starting object and property, fill in the value and defining object
+     *   and return true; otherwise return false.  
+     */
+    int find(const uchar *site, vm_obj_id_t obj, vm_prop_id_t prop,
+             vm_val_t *val, vm_obj_id_t *defining_obj)
+    {
+        IF_IC_STATS(++lookups_);
+
+        /* check each entry in the site's set */
+        vm_tadsobj_ic_entry *e = &tab_[set_idx(site)][0];
+        for (int i = VMTOBJ_IC_WAYS ; i != 0 ; --i, ++e)
+        {
+            if (e->site == site && e->obj == obj && e->prop == prop
+                && e->epoch == epoch_ && e->gen == prop_gen(prop))
+            {
+                /* got it - return the current value in the slot */
+                IF_IC_STATS(++hits_);
+                *val = e->slot->val;
+                *defining_obj = e->defining_obj;
+                return TRUE;
+            }
+        }
+
+        /* not found */
+        return FALSE;
+    }
+
+    /* store a lookup result */
+    void store(const uchar *site, vm_obj_id_t obj, vm_prop_id_t prop,
+               vm_obj_id_t defining_obj, vm_tadsobj_prop *slot)
+    {
+        IF_IC_STATS(++stores_);
+
+        /* 
+         *   pick the entry to replace: a stale entry if there is one,
+         *   otherwise the set's next victim in rotation 
+         */
+        size_t idx = set_idx(site);
+        vm_tadsobj_ic_entry *set = tab_[idx], *e = 0;
+        for (int i = 0 ; i < VMTOBJ_IC_WAYS ; ++i)
+        {
+            if (set[i].epoch != epoch_)
+            {
+                e = &set[i];
+                break;
+            }
+        }
+        if (e == 0)
+        {
+            e = &set[victim_[idx]];
+            victim_[idx] = (uchar)((victim_[idx] + 1) % VMTOBJ_IC_WAYS);
+        }
+
+        /* fill in the entry */
+        e->site = site;
+        e->obj = obj;
+        e->prop = prop;
+        e->defining_obj = defining_obj;
+        e->slot = slot;
+        e->epoch = epoch_;
+        e->gen = prop_gen(prop);
+    }
+
+    /* invalidate all entries */
+    void invalidate()
+    {
+        IF_IC_STATS(++invals_);
+
+        /* 
+         *   advance the epoch; if it wraps around to zero, clear the table
+         *   so that very old entries can't come back to life 
+         */
+        if (++epoch_ == 0)
+            clear();
+    }
+
+    /* invalidate entries for the given property */
+    void invalidate_prop(vm_prop_id_t prop)
+    {
+        IF_IC_STATS(++prop_invals_);
+
+        /* advance the property's generation, handling wraparound as above */
+        if (++prop_gen_[prop & (VMTOBJ_IC_PROP_GENS - 1)] == 0)
+            clear();
+    }
+
+protected:
+    /* get the set index for a site */
+    static size_t set_idx(const uchar *site)
+    {
+        size_t a = (size_t)site;
+        return (a ^ (a >> 10)) & (VMTOBJ_IC_SETS - 1);
+    }
+
+    /* get the current generation for a property */
+    uint32_t prop_gen(vm_prop_id_t prop) const
+        { return prop_gen_[prop & (VMTOBJ_IC_PROP_GENS - 1)]; }
 
+    /* clear the table */
+    void clear()
+    {
+        /* epoch 0 is never current, so a zeroed entry is always invalid */
+        memset(tab_, 0, sizeof(tab_));
+        memset(victim_, 0, sizeof(victim_));
+        memset(prop_gen_, 0, sizeof(prop_gen_));
+        epoch_ = 1;
+    }
+
+#ifdef VMTOBJ_IC_STATS
+    void display()
+    {
+        printf("Inline property cache statistics:\n"
+               "  lookups:        %lu\n"
+               "  hits:           %lu\n"
+               "  hit rate (%%):   %lu\n"
+               "  stores:         %lu\n"
+               "  invalidations:  %lu\n"
+               "  prop invals:    %lu\n",
+               lookups_, hits_,
+               lookups_ != 0 ? (ulong)(hits_ * 100.0 / lookups_) : 0,
+               stores_, invals_, prop_invals_);
+    }
+
+    /* statistics counters */
+    ulong lookups_;
+    ulong hits_;
+    ulong stores_;
+    ulong invals_;
+    ulong prop_invals_;
+#endif
+
+    /* the cache table */
+    vm_tadsobj_ic_entry tab_[VMTOBJ_IC_SETS][VMTOBJ_IC_WAYS];
+
+    /* next entry to replace in each set */
+    uchar victim_[VMTOBJ_IC_SETS];
+
+    /* current epoch */
+    uint32_t epoch_;
+
+    /* property generations */
+    uint32_t prop_gen_[VMTOBJ_IC_PROP_GENS];
+};
 
 
 #endif /* VMTOBJ_H */
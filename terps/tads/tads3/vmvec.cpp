@@ -2405,7 +2405,7 @@ int CVmObjVector::getp_sort(VMG_ vm_obj_id_t self, vm_val_t *retval,
 
     /* sort the vector, if we have any elements */
     if (len != 0)
-        sorter.sort(vmg_ 0, len - 1);
+        sorter.sort_stable(vmg_ 0, len - 1);
 
     /* discard the gc protection and arguments */
     G_stk->discard(1 + argc);
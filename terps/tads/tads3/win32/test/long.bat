@@ -99,6 +99,8 @@ call %tstbat%\testmake -nodef rand rand
 call %tstbat%\testmake rand3 rand3
 call %tstbat%\testmake strcomp2 strcomp2
 call %tstbat%\testmake -cp latin1 strcomp3 strcomp3
+call %tstbat%\testmake spellcorr spellcorr
+call %tstbat%\testmake sortstab sortstab
 call %tstbat%\testmake findreplace findreplace
 call %tstbat%\testmake findall findall
 call %tstbat%\testmake rexreplace rexreplace
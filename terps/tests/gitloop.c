@@ -0,0 +1,85 @@
+// gitloop.c: Time Git's main loop on a generated story file.
+//
+// Usage: gitloop [count [hot]]
+//
+// Runs the loop story (see loopstory.c) count times round its loop,
+// checks what it printed, and reports how long it took, including
+// compiling the story's code. hot sets gHotThreshold, as -hot does.
+
+#include "git.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "loopstory.h"
+
+#define CACHE_SIZE (256 * 1024L)
+#define UNDO_SIZE (2 * 1024 * 1024L)
+
+void fatalError (const char * s)
+{
+    printf ("gitloop: %s\n", s);
+    exit (1);
+}
+
+// The story makes no Glk calls, so the dispatch layer (glkop.c) is
+// replaced by these.
+
+int git_init_dispatch ()
+{
+    return 1;
+}
+
+glui32 git_perform_glk (glui32 funcnum, glui32 numargs, glui32 * arglist)
+{
+    fatalError ("Glk call in the loop benchmark.");
+}
+
+strid_t git_find_stream_by_id (glui32 id)
+{
+    return NULL;
+}
+
+glui32 git_find_id_for_stream (strid_t str)
+{
+    return 0;
+}
+
+int main (int argc, char * argv [])
+{
+    unsigned long count = 3000000;
+    glui32 len;
+    unsigned char * story;
+    char expected [64];
+    clock_t start, elapsed;
+
+    if (argc > 1)
+        count = strtoul (argv [1], NULL, 10);
+    if (argc > 2)
+        gHotThreshold = strtoul (argv [2], NULL, 10);
+    if (count < 1 || count > 0x7FFFFFFF)
+    {
+        printf ("gitloop: count must be between 1 and 2147483647\n");
+        return 1;
+    }
+
+    story = loopstory_build (count, &len);
+    if (story == NULL)
+        fatalError ("unable to allocate the story");
+
+    start = clock ();
+    git (story, len, CACHE_SIZE, UNDO_SIZE);
+    elapsed = clock () - start;
+
+    loopstory_expected (count, expected, sizeof (expected));
+    if (strcmp (loopstory_output (), expected) != 0)
+    {
+        printf ("gitloop: printed \"%s\", expected \"%s\"\n",
+            loopstory_output (), expected);
+        return 1;
+    }
+
+    printf ("git: %lu loops, %.3f seconds\n", count,
+        (double) elapsed / CLOCKS_PER_SEC);
+    free (story);
+    return 0;
+}
@@ -0,0 +1,262 @@
+/* glkstubs.c: Just enough of Glk to run a story file from memory.
+
+   The loop benchmarks link the interpreter core against these instead
+   of a real Glk library, so that they time only the interpreter. The
+   story is read from memory, and everything printed is collected so it
+   can be checked. Any call which would need a real library does
+   nothing, or fails.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "glk.h"
+#include "gi_blorb.h"
+#include "loopstory.h"
+
+struct glk_stream_struct {
+  unsigned char *buf;
+  glui32 len;
+  glui32 pos;
+};
+
+static struct glk_stream_struct storystream;
+
+static char *output = NULL;
+static size_t outputlen = 0, outputsize = 0;
+
+strid_t loopstory_stream(unsigned char *story, glui32 len)
+{
+  storystream.buf = story;
+  storystream.len = len;
+  storystream.pos = 0;
+  return &storystream;
+}
+
+const char *loopstory_output(void)
+{
+  return output ? output : "";
+}
+
+static void put_char(glui32 ch)
+{
+  if (outputlen + 1 >= outputsize) {
+    outputsize = outputsize ? 2 * outputsize : 256;
+    output = realloc(output, outputsize);
+    if (!output)
+      abort();
+  }
+  output[outputlen++] = (ch < 0x100) ? (char)ch : '?';
+  output[outputlen] = '\0';
+}
+
+static void put_buffer(char *buf, glui32 len)
+{
+  glui32 ix;
+  for (ix=0; ix<len; ix++)
+    put_char((unsigned char)buf[ix]);
+}
+
+void glk_exit(void)
+{
+  exit(1);
+}
+
+void glk_tick(void)
+{
+}
+
+glui32 glk_gestalt(glui32 sel, glui32 val)
+{
+  return 0;
+}
+
+unsigned char glk_char_to_lower(unsigned char ch)
+{
+  return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+}
+
+unsigned char glk_char_to_upper(unsigned char ch)
+{
+  return (ch >= 'a' && ch <= 'z') ? ch - ('a' - 'A') : ch;
+}
+
+glui32 glk_buffer_to_lower_case_uni(glui32 *buf, glui32 len, glui32 numchars)
+{
+  return numchars;
+}
+
+glui32 glk_buffer_to_upper_case_uni(glui32 *buf, glui32 len, glui32 numchars)
+{
+  return numchars;
+}
+
+winid_t glk_window_get_root(void)
+{
+  return NULL;
+}
+
+winid_t glk_window_open(winid_t split, glui32 method, glui32 size,
+  glui32 wintype, glui32 rock)
+{
+  return NULL;
+}
+
+strid_t glk_window_get_stream(winid_t win)
+{
+  return NULL;
+}
+
+void glk_set_window(winid_t win)
+{
+}
+
+void glk_select_poll(event_t *event)
+{
+  event->type = evtype_None;
+}
+
+void glk_request_timer_events(glui32 millisecs)
+{
+}
+
+void glk_current_time(glktimeval_t *time)
+{
+  memset(time, 0, sizeof(*time));
+}
+
+glsi32 glk_current_simple_time(glui32 factor)
+{
+  return 0;
+}
+
+strid_t glk_stream_get_current(void)
+{
+  return NULL;
+}
+
+void glk_stream_set_current(strid_t str)
+{
+}
+
+void glk_put_char(unsigned char ch)
+{
+  put_char(ch);
+}
+
+void glk_put_char_uni(glui32 ch)
+{
+  put_char(ch);
+}
+
+void glk_put_string(char *s)
+{
+  put_buffer(s, strlen(s));
+}
+
+void glk_put_buffer(char *buf, glui32 len)
+{
+  put_buffer(buf, len);
+}
+
+void glk_put_char_stream(strid_t str, unsigned char ch)
+{
+  put_char(ch);
+}
+
+void glk_put_char_stream_uni(strid_t str, glui32 ch)
+{
+  put_char(ch);
+}
+
+void glk_put_string_stream(strid_t str, char *s)
+{
+  put_buffer(s, strlen(s));
+}
+
+void glk_put_buffer_stream(strid_t str, char *buf, glui32 len)
+{
+  put_buffer(buf, len);
+}
+
+glsi32 glk_get_char_stream(strid_t str)
+{
+  if (str != &storystream || str->pos >= str->len)
+    return -1;
+  return str->buf[str->pos++];
+}
+
+glui32 glk_get_buffer_stream(strid_t str, char *buf, glui32 len)
+{
+  if (str != &storystream)
+    return 0;
+  if (len > str->len - str->pos)
+    len = str->len - str->pos;
+  memcpy(buf, str->buf + str->pos, len);
+  str->pos += len;
+  return len;
+}
+
+void glk_stream_set_position(strid_t str, glsi32 pos, glui32 seekmode)
+{
+  if (str != &storystream)
+    return;
+  if (seekmode == seekmode_Current)
+    pos += str->pos;
+  else if (seekmode == seekmode_End)
+    pos += str->len;
+  if (pos < 0)
+    pos = 0;
+  if ((glui32)pos > str->len)
+    pos = str->len;
+  str->pos = pos;
+}
+
+glui32 glk_stream_get_position(strid_t str)
+{
+  return (str == &storystream) ? str->pos : 0;
+}
+
+strid_t glk_stream_open_memory(char *buf, glui32 buflen, glui32 fmode,
+  glui32 rock)
+{
+  return NULL;
+}
+
+strid_t glk_stream_open_file(frefid_t fileref, glui32 fmode, glui32 rock)
+{
+  return NULL;
+}
+
+void glk_stream_close(strid_t str, stream_result_t *result)
+{
+  if (result) {
+    result->readcount = 0;
+    result->writecount = 0;
+  }
+}
+
+frefid_t glk_fileref_create_by_prompt(glui32 usage, glui32 fmode,
+  glui32 rock)
+{
+  return NULL;
+}
+
+void glk_fileref_destroy(frefid_t fref)
+{
+}
+
+giblorb_map_t *giblorb_get_resource_map(void)
+{
+  return NULL;
+}
+
+giblorb_err_t giblorb_set_resource_map(strid_t file)
+{
+  return giblorb_err_NotAMap;
+}
+
+giblorb_err_t giblorb_load_resource(giblorb_map_t *map, glui32 method,
+  giblorb_result_t *res, glui32 usage, glui32 resnum)
+{
+  return giblorb_err_NotFound;
+}
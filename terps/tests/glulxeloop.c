@@ -0,0 +1,100 @@
+/* glulxeloop.c: Time Glulxe's main loop on a generated story file.
+
+   Usage: glulxeloop [count]
+
+   Runs the loop story (see loopstory.c) count times round its loop,
+   checks what it printed, and reports how long execute_loop() took.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "glk.h"
+#include "glulxe.h"
+#include "loopstory.h"
+
+/* The story makes no Glk calls, so the dispatch layer (glkop.c) is
+   replaced by these. */
+
+int init_dispatch(void)
+{
+  return TRUE;
+}
+
+glui32 perform_glk(glui32 funcnum, glui32 numargs, glui32 *arglist)
+{
+  fatal_error_i("Glk call in the loop benchmark.", funcnum);
+  return 0;
+}
+
+strid_t find_stream_by_id(glui32 objid)
+{
+  return NULL;
+}
+
+glui32 find_id_for_window(winid_t win)
+{
+  return 0;
+}
+
+glui32 find_id_for_stream(strid_t str)
+{
+  return 0;
+}
+
+glui32 find_id_for_fileref(frefid_t fref)
+{
+  return 0;
+}
+
+glui32 find_id_for_schannel(schanid_t schan)
+{
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  glui32 count = 3000000;
+  glui32 len;
+  unsigned char *story;
+  char expected[64];
+  clock_t starttime, elapsed;
+
+  if (argc > 1)
+    count = strtoul(argv[1], NULL, 10);
+  if (count < 1 || count > 0x7FFFFFFF) {
+    printf("glulxeloop: count must be between 1 and 2147483647\n");
+    return 1;
+  }
+
+  story = loopstory_build(count, &len);
+  if (!story) {
+    printf("glulxeloop: unable to allocate the story\n");
+    return 1;
+  }
+
+  gamefile = loopstory_stream(story, len);
+  gamefile_start = 0;
+  gamefile_len = len;
+  if (!init_float())
+    return 1;
+
+  setup_vm();
+  starttime = clock();
+  execute_loop();
+  elapsed = clock() - starttime;
+  finalize_vm();
+
+  loopstory_expected(count, expected, sizeof(expected));
+  if (strcmp(loopstory_output(), expected)) {
+    printf("glulxeloop: printed \"%s\", expected \"%s\"\n",
+      loopstory_output(), expected);
+    return 1;
+  }
+
+  printf("glulxe: %lu loops, %.3f seconds\n", (unsigned long)count,
+    (double)elapsed / CLOCKS_PER_SEC);
+  free(story);
+  return 0;
+}
@@ -0,0 +1,301 @@
+/* loopstory.c: A Glulx story file for benchmarking interpreter loops.
+
+   The story is assembled here rather than shipped, so that the loop
+   count can be chosen at run time. The main function is:
+
+     setiosys 2 0
+     copy 0 l0; copy 0 l2
+   loop:
+     bitand l0 255 l1
+     aload ARR l1 sp; add sp l2 l2
+     astore ARR l1 l0
+     aloadb ARR l1 sp; bitand sp 7 l4
+     jz l4 skip; sub l2 l4 l2
+   skip:
+     copy l0 sp; copy 3 sp; call square 2 l3
+     add l2 l3 l2
+     copy COUNTER l5; add l5 1 sp; copy sp COUNTER
+     add l0 1 l0
+     jlt l0 count loop
+     streamnum l2; streamnum COUNTER
+     return 0
+
+   and the called function returns (l0 * l1) & 0xFFFF.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "loopstory.h"
+
+#define RAMSTART (0x1000)
+#define ENDMEM (0x2000)
+#define STACKSIZE (0x10000)
+#define CODESTART (0x40)
+
+/* The array used by the loop, and a counter just past it, both in
+   main memory. */
+#define ARR (RAMSTART)
+#define COUNTER (RAMSTART + 0x404)
+
+/* Operand addressing modes. */
+#define MODE_CONST (0)
+#define MODE_LABEL (2)
+#define MODE_STACK (8)
+#define MODE_LOCAL (9)
+#define MODE_RAM (0xE)
+
+typedef struct operand_struct {
+  int mode;
+  glui32 val;
+} operand_t;
+
+static unsigned char *image;
+static glui32 pos;
+
+static operand_t cnst(glui32 val)
+{
+  operand_t op;
+  op.mode = MODE_CONST;
+  op.val = val;
+  return op;
+}
+
+static operand_t local(int num)
+{
+  operand_t op;
+  op.mode = MODE_LOCAL;
+  op.val = num * 4;
+  return op;
+}
+
+static operand_t ram(glui32 addr)
+{
+  operand_t op;
+  op.mode = MODE_RAM;
+  op.val = addr - RAMSTART;
+  return op;
+}
+
+static operand_t label(void)
+{
+  operand_t op;
+  op.mode = MODE_LABEL;
+  op.val = 0;
+  return op;
+}
+
+static const operand_t SP = { MODE_STACK, 0 };
+
+static void emit1(glui32 val)
+{
+  image[pos++] = val & 0xFF;
+}
+
+static void emit2(glui32 val)
+{
+  emit1(val >> 8);
+  emit1(val);
+}
+
+static void emit4(glui32 val)
+{
+  emit2(val >> 16);
+  emit2(val);
+}
+
+static void write4(glui32 addr, glui32 val)
+{
+  image[addr] = (val >> 24) & 0xFF;
+  image[addr+1] = (val >> 16) & 0xFF;
+  image[addr+2] = (val >> 8) & 0xFF;
+  image[addr+3] = val & 0xFF;
+}
+
+/* Emit an instruction, returning the address of its last operand.
+   Constants are encoded in as few bytes as they fit in. A label
+   operand gets a two-byte placeholder, which set_branch() fills in. */
+static glui32 op(glui32 opcode, int numops, const operand_t *ops)
+{
+  int ix, mode;
+  glui32 modepos, last = 0;
+  glsi32 val;
+
+  if (opcode < 0x80)
+    emit1(opcode);
+  else
+    emit2(0x8000 | opcode);
+
+  modepos = pos;
+  for (ix=0; ix<(numops+1)/2; ix++)
+    emit1(0);
+
+  for (ix=0; ix<numops; ix++) {
+    mode = ops[ix].mode;
+    val = (glsi32)ops[ix].val;
+    last = pos;
+    if (mode == MODE_CONST) {
+      if (val == 0)
+        mode = 0;
+      else if (val >= -0x80 && val < 0x80)
+        mode = 1;
+      else if (val >= -0x8000 && val < 0x8000)
+        mode = 2;
+      else
+        mode = 3;
+      if (mode == 1)
+        emit1(val);
+      else if (mode == 2)
+        emit2(val);
+      else if (mode == 3)
+        emit4(val);
+    }
+    else if (mode == MODE_LABEL || mode == MODE_RAM) {
+      emit2(val);
+    }
+    else if (mode == MODE_LOCAL) {
+      emit1(val);
+    }
+    image[modepos + ix/2] |= mode << (4 * (ix & 1));
+  }
+
+  return last;
+}
+
+#define OP(opcode, ...) \
+  do { \
+    operand_t ops_[] = { __VA_ARGS__ }; \
+    op(opcode, sizeof(ops_) / sizeof(ops_[0]), ops_); \
+  } while (0)
+
+/* Point the two-byte branch operand at addr to the target. Branch
+   offsets are relative to the end of the instruction, less two. */
+static void set_branch(glui32 addr, glui32 target)
+{
+  glsi32 offset = (glsi32)target - (glsi32)(addr + 2) + 2;
+  image[addr] = (offset >> 8) & 0xFF;
+  image[addr+1] = offset & 0xFF;
+}
+
+/* A function with the given number of four-byte locals, whose
+   arguments are passed in locals. */
+static glui32 function(int numlocals)
+{
+  glui32 addr = pos;
+  emit1(0xC1);
+  emit1(4);
+  emit1(numlocals);
+  emit1(0);
+  emit1(0);
+  return addr;
+}
+
+unsigned char *loopstory_build(glui32 count, glui32 *len)
+{
+  glui32 loop, skip, square, branch, jump, call, addr, sum;
+  operand_t ops[3];
+
+  image = calloc(ENDMEM, 1);
+  if (!image)
+    return NULL;
+  pos = CODESTART;
+
+  function(6);
+  OP(0x149, cnst(2), cnst(0));                 /* setiosys */
+  OP(0x40, cnst(0), local(0));                 /* copy */
+  OP(0x40, cnst(0), local(2));
+
+  loop = pos;
+  OP(0x18, local(0), cnst(255), local(1));     /* bitand */
+  OP(0x48, cnst(ARR), local(1), SP);           /* aload */
+  OP(0x10, SP, local(2), local(2));            /* add */
+  OP(0x4C, cnst(ARR), local(1), local(0));     /* astore */
+  OP(0x4A, cnst(ARR), local(1), SP);           /* aloadb */
+  OP(0x18, SP, cnst(7), local(4));
+
+  ops[0] = local(4);
+  ops[1] = label();
+  branch = op(0x22, 2, ops);                   /* jz */
+  OP(0x11, local(2), local(4), local(2));      /* sub */
+
+  skip = pos;
+  OP(0x40, local(0), SP);
+  OP(0x40, cnst(3), SP);
+  ops[0] = cnst(0x7FFFFFFF);                   /* patched below */
+  ops[1] = cnst(2);
+  ops[2] = local(3);
+  call = op(0x30, 3, ops);                     /* call */
+  OP(0x10, local(2), local(3), local(2));
+  OP(0x40, ram(COUNTER), local(5));
+  OP(0x10, local(5), cnst(1), SP);
+  OP(0x40, SP, ram(COUNTER));
+  OP(0x10, local(0), cnst(1), local(0));
+
+  ops[0] = local(0);
+  ops[1] = cnst(count);
+  ops[2] = label();
+  jump = op(0x26, 3, ops);                     /* jlt */
+  OP(0x71, local(2));                          /* streamnum */
+  OP(0x71, ram(COUNTER));
+  OP(0x31, cnst(0));                           /* return */
+
+  square = function(2);
+  OP(0x12, local(0), local(1), SP);            /* mul */
+  OP(0x18, SP, cnst(0xFFFF), SP);
+  OP(0x31, SP);
+
+  set_branch(branch, skip);
+  set_branch(jump, loop);
+  /* call points at the store operand. The placeholder forced a
+     four-byte function address, which comes before the one-byte
+     argument count. */
+  write4(call - 5, square);
+
+  /* The header, then the checksum of the whole file. */
+  memcpy(image, "Glul", 4);
+  write4(4, 0x00030103);
+  write4(8, RAMSTART);
+  write4(12, ENDMEM);
+  write4(16, ENDMEM);
+  write4(20, STACKSIZE);
+  write4(24, CODESTART);
+  write4(28, 0);
+  sum = 0;
+  for (addr=0; addr<ENDMEM; addr+=4) {
+    sum += ((glui32)image[addr] << 24) | ((glui32)image[addr+1] << 16)
+      | ((glui32)image[addr+2] << 8) | image[addr+3];
+  }
+  write4(32, sum);
+
+  *len = ENDMEM;
+  return image;
+}
+
+void loopstory_expected(glui32 count, char *buf, size_t size)
+{
+  unsigned char arr[1024];
+  glui32 l0, l1, l2, l4, val;
+
+  memset(arr, 0, sizeof(arr));
+  /* The story tests the loop condition at the bottom, so the body
+     always runs at least once. */
+  l0 = 0;
+  l2 = 0;
+  do {
+    l1 = l0 & 255;
+    val = ((glui32)arr[4*l1] << 24) | ((glui32)arr[4*l1+1] << 16)
+      | ((glui32)arr[4*l1+2] << 8) | arr[4*l1+3];
+    l2 += val;
+    arr[4*l1] = (l0 >> 24) & 0xFF;
+    arr[4*l1+1] = (l0 >> 16) & 0xFF;
+    arr[4*l1+2] = (l0 >> 8) & 0xFF;
+    arr[4*l1+3] = l0 & 0xFF;
+    l4 = arr[l1] & 7;
+    if (l4)
+      l2 -= l4;
+    l2 += (3 * l0) & 0xFFFF;
+    l0++;
+  } while ((glsi32)l0 < (glsi32)count);
+
+  snprintf(buf, size, "%ld%ld", (long)(glsi32)l2, (long)(glsi32)l0);
+}
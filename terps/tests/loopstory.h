@@ -0,0 +1,24 @@
+/* loopstory.h: A Glulx story file for benchmarking interpreter loops. */
+
+#ifndef LOOPSTORY_H
+#define LOOPSTORY_H
+
+#include <stddef.h>
+#include "glk.h"
+
+/* Assemble a story file whose main loop runs count times, doing
+   arithmetic, array loads and stores, a branch, a function call, and a
+   read-modify-write of main memory on each pass. It then prints two
+   numbers and quits. Returns a buffer from malloc(), and sets *len to
+   its length. */
+extern unsigned char *loopstory_build(glui32 count, glui32 *len);
+
+/* Write what the story prints into buf, by running the same loop in C. */
+extern void loopstory_expected(glui32 count, char *buf, size_t size);
+
+/* The Glk stubs which the benchmark drivers link against. These read
+   the story from memory, and collect everything printed. */
+extern strid_t loopstory_stream(unsigned char *story, glui32 len);
+extern const char *loopstory_output(void);
+
+#endif /* LOOPSTORY_H */
@@ -0,0 +1,144 @@
+/*
+ *   t3loadbench.cpp: time loading a TADS 3 image, mapped and read.
+ *
+ *   Usage: t3loadbench image.t3 [count]
+ *
+ *   Loads and unloads the image count times (default 20) through
+ *   CVmImageFileMap, which runs out of a read-only mapping of the file,
+ *   and then through CVmImageFileExt, which reads the image into memory.
+ *   For each, it reports the fastest and average load times, and the
+ *   resident memory just after a load, split into memory backed by the
+ *   image file and the process's own (anonymous) memory.
+ *
+ *   The program isn't run, so this measures the loader alone: reading or
+ *   mapping the file, and creating the pools and static objects.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "os.h"
+#include "t3std.h"
+#include "vmmain.h"
+#include "vmhost.h"
+#include "vmhostsi.h"
+#include "vmvsn.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+/*
+ *   Resident memory, in kilobytes, split into file-backed and anonymous.
+ *   This is only known on Linux; elsewhere both are reported as zero.
+ */
+struct resident_mem
+{
+    long file_kb;
+    long anon_kb;
+};
+
+static resident_mem get_resident_mem()
+{
+    resident_mem mem = { 0, 0 };
+
+#if defined(__linux__)
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp != 0)
+    {
+        long size, resident, shared;
+        if (fscanf(fp, "%ld %ld %ld", &size, &resident, &shared) == 3)
+        {
+            long page_kb = sysconf(_SC_PAGESIZE) / 1024;
+            mem.file_kb = shared * page_kb;
+            mem.anon_kb = (resident - shared) * page_kb;
+        }
+        fclose(fp);
+    }
+#endif
+
+    return mem;
+}
+
+/*
+ *   Client interface: the stdio version, noting resident memory once the
+ *   image is loaded.
+ */
+class CLoadBenchClientIfc: public CVmMainClientIfcStdio
+{
+public:
+    CLoadBenchClientIfc() { loaded.file_kb = loaded.anon_kb = 0; }
+
+    virtual void pre_exec(struct vm_globals *) { loaded = get_resident_mem(); }
+
+    resident_mem loaded;
+};
+
+/*
+ *   Load the image count times, and report the timings and the memory in
+ *   use after the last load.  Returns zero on success.
+ */
+static int bench(const char *image, int count, int map_image,
+                 CVmHostIfc *hostifc)
+{
+    CLoadBenchClientIfc clientifc;
+    double best = 0, total = 0;
+
+    for (int i = 0 ; i < count ; ++i)
+    {
+        vm_run_image_params params(&clientifc, hostifc, image);
+        params.map_image = map_image;
+        params.load_only = TRUE;
+        params.seed_rand = FALSE;
+
+        auto start = std::chrono::steady_clock::now();
+        int stat = vm_run_image(&params);
+        auto end = std::chrono::steady_clock::now();
+
+        if (stat != 0)
+            return stat;
+
+        double ms = std::chrono::duration<double, std::milli>(
+            end - start).count();
+        if (i == 0 || ms < best)
+            best = ms;
+        total += ms;
+    }
+
+    printf("%-6s  best %8.2f ms  mean %8.2f ms  "
+           "resident %7ld KB file + %7ld KB anon\n",
+           map_image ? "mapped" : "read", best, total / count,
+           clientifc.loaded.file_kb, clientifc.loaded.anon_kb);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        printf("usage: t3loadbench image.t3 [count]\n");
+        return OSEXFAIL;
+    }
+
+    int count = (argc > 2 ? atoi(argv[2]) : 20);
+    if (count < 1)
+        count = 1;
+
+    /*
+     *   The OS layer isn't initialized, since that would open the Glk
+     *   windows; nothing is displayed while loading.
+     */
+    CVmHostIfc *hostifc = new CVmHostIfcStdio(argv[0]);
+
+    printf("TADS %s: %s, %d loads each\n", T3VM_VSN_STRING, argv[1], count);
+    int stat = bench(argv[1], count, TRUE, hostifc);
+    if (stat == 0)
+        stat = bench(argv[1], count, FALSE, hostifc);
+
+    delete hostifc;
+
+    return (stat == 0 ? OSEXSUCC : OSEXFAIL);
+}